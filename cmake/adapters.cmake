@@ -13,6 +13,7 @@ foreach(NAME ${GVOX_INPUT_ADAPTERS})
             .blit_end = gvox_input_adapter_${NAME}_blit_end,
         },
         .read = gvox_input_adapter_${NAME}_read,
+        .prefetch = gvox_input_adapter_${NAME}_prefetch,
     },")
 endforeach()
     foreach(NAME ${GVOX_OUTPUT_ADAPTERS})
@@ -30,6 +31,8 @@ endforeach()
         },
         .write = gvox_output_adapter_${NAME}_write,
         .reserve = gvox_output_adapter_${NAME}_reserve,
+        .writev = gvox_output_adapter_${NAME}_writev,
+        .map = gvox_output_adapter_${NAME}_map,
     },")
 endforeach()
     foreach(NAME ${GVOX_PARSE_ADAPTERS})
@@ -104,6 +107,7 @@ extern \"C\" void gvox_input_adapter_${NAME}_blit_begin(GvoxBlitContext *blit_ct
 extern \"C\" void gvox_input_adapter_${NAME}_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx);
 
 extern \"C\" void gvox_input_adapter_${NAME}_read(GvoxAdapterContext *ctx, size_t position, size_t size, void *data);
+extern \"C\" void gvox_input_adapter_${NAME}_prefetch(GvoxAdapterContext *ctx, size_t position, size_t size);
 ")
 endforeach()
     foreach(NAME ${GVOX_OUTPUT_ADAPTERS})
@@ -118,6 +122,8 @@ extern \"C\" void gvox_output_adapter_${NAME}_blit_end(GvoxBlitContext *blit_ctx
 
 extern \"C\" void gvox_output_adapter_${NAME}_write(GvoxAdapterContext *ctx, size_t position, size_t size, void const *data);
 extern \"C\" void gvox_output_adapter_${NAME}_reserve(GvoxAdapterContext *ctx, size_t size);
+extern \"C\" void gvox_output_adapter_${NAME}_writev(GvoxAdapterContext *ctx, GvoxIoVec const *iovs, size_t iov_n);
+extern \"C\" void *gvox_output_adapter_${NAME}_map(GvoxAdapterContext *ctx, size_t position, size_t size);
 ")
 endforeach()
 foreach(NAME ${GVOX_PARSE_ADAPTERS})
@@ -2,6 +2,10 @@
 include(CMakePackageConfigHelpers)
 file(WRITE ${CMAKE_BINARY_DIR}/config.cmake.in [=[
 @PACKAGE_INIT@
+include(CMakeFindDependencyMacro)
+if("@GVOX_ENABLE_ZSTD@")
+    find_dependency(zstd CONFIG)
+endif()
 include(${CMAKE_CURRENT_LIST_DIR}/gvox-targets.cmake)
 check_required_components(gvox)
 
@@ -0,0 +1,18 @@
+#ifndef GVOX_ZSTD_INPUT_ADAPTER_H
+#define GVOX_ZSTD_INPUT_ADAPTER_H
+
+#include <gvox/gvox.h>
+
+// Decompresses a zstd stream read through another input adapter context.
+// Streams written in the zstd seekable format (with a trailing seek table)
+// only decompress the frames covering each read. Anything else is fully
+// decompressed at blit begin.
+typedef struct {
+    GvoxAdapterContext *input_ctx;
+    // Size in bytes of the compressed stream within `input_ctx`
+    size_t size;
+    // Number of decompressed frames kept around between reads. 0 means default
+    size_t frame_cache_size;
+} GvoxZstdInputAdapterConfig;
+
+#endif
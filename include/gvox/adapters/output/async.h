@@ -0,0 +1,16 @@
+#ifndef GVOX_ASYNC_OUTPUT_ADAPTER_H
+#define GVOX_ASYNC_OUTPUT_ADAPTER_H
+
+#include <gvox/gvox.h>
+
+// Queues writes into a ring of buffers, which a background thread drains
+// into `output_ctx` in order. Everything is written by the end of the blit.
+typedef struct {
+    GvoxAdapterContext *output_ctx;
+    // Size in bytes of each buffer. 0 means default
+    size_t buffer_size;
+    // Number of buffers in the ring. 0 means default
+    size_t buffer_count;
+} GvoxAsyncOutputAdapterConfig;
+
+#endif
@@ -8,6 +8,16 @@ typedef struct {
     uint8_t **out_byte_buffer_ptr;
 
     void *(*allocate)(size_t size);
+    // When set, the output is written straight into `*out_byte_buffer_ptr`,
+    // which holds `capacity` bytes up front (it may be null with a capacity
+    // of 0), and is grown with realloc semantics through this callback.
+    // `*out_byte_buffer_ptr` is updated each time it grows, so it's still
+    // the caller's to free if the blit fails. Both of these modes need
+    // `out_byte_buffer_ptr`, and are ignored without it.
+    void *(*reallocate)(void *ptr, size_t size);
+    // Without `reallocate`, a non-zero capacity means `*out_byte_buffer_ptr`
+    // is a fixed-size buffer the output must fit in.
+    size_t capacity;
 } GvoxByteBufferOutputAdapterConfig;
 
 #endif
@@ -0,0 +1,14 @@
+#ifndef GVOX_FD_OUTPUT_ADAPTER_H
+#define GVOX_FD_OUTPUT_ADAPTER_H
+
+// Writes to an already open file descriptor (such as a pipe), which is not
+// closed by the adapter. Positions are relative to where the descriptor was
+// at blit begin. Writes behind what has already been flushed need the
+// descriptor to be seekable.
+typedef struct {
+    int fd;
+    // Size of the internal buffer in bytes. 0 means default
+    size_t buffer_size;
+} GvoxFdOutputAdapterConfig;
+
+#endif
@@ -3,6 +3,8 @@
 
 typedef struct {
     char const *filepath;
+    // Size of the write-back buffer in bytes. 0 means default
+    size_t buffer_size;
 } GvoxFileOutputAdapterConfig;
 
 #endif
@@ -0,0 +1,11 @@
+#ifndef GVOX_MMAP_OUTPUT_ADAPTER_H
+#define GVOX_MMAP_OUTPUT_ADAPTER_H
+
+// Writes into a memory mapping of the output file. Reserving truncates the
+// file to that size and maps it, after which gvox_output_map can hand out
+// pointers into the mapped pages.
+typedef struct {
+    char const *filepath;
+} GvoxMmapOutputAdapterConfig;
+
+#endif
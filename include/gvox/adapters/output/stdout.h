@@ -1,6 +1,10 @@
 #ifndef GVOX_STDOUT_OUTPUT_ADAPTER_H
 #define GVOX_STDOUT_OUTPUT_ADAPTER_H
 
-// This adapter has no config
+// The config is optional
+typedef struct {
+    // Size of the internal buffer in bytes. 0 means default
+    size_t buffer_size;
+} GvoxStdoutOutputAdapterConfig;
 
 #endif
@@ -0,0 +1,19 @@
+#ifndef GVOX_ZSTD_OUTPUT_ADAPTER_H
+#define GVOX_ZSTD_OUTPUT_ADAPTER_H
+
+#include <gvox/gvox.h>
+
+// Compresses everything written into independent zstd frames, and writes
+// them through another output adapter context at blit end, followed by a
+// seek table in the zstd seekable format. The zstd input adapter can then
+// read it back with random access. Frames are kept compressed in memory
+// until blit end, so that writes behind the end can still patch them.
+typedef struct {
+    GvoxAdapterContext *output_ctx;
+    // Decompressed size in bytes of each frame. 0 means default
+    size_t frame_size;
+    // zstd compression level. 0 means zstd's default
+    int compression_level;
+} GvoxZstdOutputAdapterConfig;
+
+#endif
@@ -1,6 +1,12 @@
 #ifndef GVOX_GVOX_PALETTE_PARSE_ADAPTER_H
 #define GVOX_GVOX_PALETTE_PARSE_ADAPTER_H
 
-// This adapter has no config
+// The config is optional
+typedef struct {
+    // How many decoded regions (per channel) to keep in memory. Regions are
+    // only read from the input once something inside them is sampled.
+    // 0 means default
+    size_t region_cache_size;
+} GvoxPaletteParseAdapterConfig;
 
 #endif
@@ -1,6 +1,16 @@
 #ifndef GVOX_GLOBAL_PALETTE_SERIALIZE_ADAPTER_H
 #define GVOX_GLOBAL_PALETTE_SERIALIZE_ADAPTER_H
 
-// This adapter has no config
+#include <stdint.h>
+
+// The config is optional
+typedef struct {
+    // When non-zero, each channel's indices are stored in bricks of this edge
+    // length, each with its own offset, rather than in x-fastest order over
+    // the whole range. This keeps spatially local reads contiguous. It must be
+    // a power of two, up to 32.
+    // 0 means the linear layout
+    uint32_t brick_size;
+} GvoxGlobalPaletteSerializeAdapterConfig;
 
 #endif
@@ -1,6 +1,15 @@
 #ifndef GVOX_GVOX_PALETTE_SERIALIZE_ADAPTER_H
 #define GVOX_GVOX_PALETTE_SERIALIZE_ADAPTER_H
 
-// This adapter has no config
+#include <stdint.h>
+
+// The config is optional
+typedef struct {
+    // The edge length of each palette region, in voxels. It must be a power
+    // of two, up to 32. Larger regions compress smooth data better and have
+    // less header overhead, while smaller ones suit noisy data.
+    // 0 means default (8)
+    uint32_t region_size;
+} GvoxPaletteSerializeAdapterConfig;
 
 #endif
@@ -60,6 +60,10 @@ typedef enum {
 #define GVOX_CHANNEL_BIT_LAST (1 << GVOX_CHANNEL_ID_LAST)
 
 #define GVOX_REGION_FLAG_UNIFORM 0x00000001
+// The region's `data` points to its voxels, laid out densely: for each
+// channel in `channels` (by increasing channel id), extent.x * extent.y *
+// extent.z uint32_t values with x varying fastest, then y, then z.
+#define GVOX_REGION_FLAG_DENSE 0x00000002
 
 typedef struct _GvoxContext GvoxContext;
 typedef struct _GvoxAdapter GvoxAdapter;
@@ -97,6 +101,11 @@ GVOX_EXPORT GvoxResult gvox_get_result(GvoxContext *ctx);
 GVOX_EXPORT void gvox_get_result_message(GvoxContext *ctx, char *const str_buffer, size_t *str_size);
 GVOX_EXPORT void gvox_pop_result(GvoxContext *ctx);
 
+// Limits how many bytes of staging storage adapters may hold in memory at
+// once. Anything past it is backed by temporary files instead. 0 (the
+// default) means no limit.
+GVOX_EXPORT void gvox_set_memory_budget(GvoxContext *ctx, size_t budget);
+
 GVOX_EXPORT GvoxAdapter *gvox_get_input_adapter(GvoxContext *ctx, char const *adapter_name);
 GVOX_EXPORT GvoxAdapter *gvox_get_output_adapter(GvoxContext *ctx, char const *adapter_name);
 GVOX_EXPORT GvoxAdapter *gvox_get_parse_adapter(GvoxContext *ctx, char const *adapter_name);
@@ -146,6 +155,12 @@ typedef struct {
     GvoxBlitMode preferred_blit_mode;
 } GvoxParseAdapterDetails;
 
+typedef struct {
+    size_t position;
+    size_t size;
+    void const *data;
+} GvoxIoVec;
+
 typedef struct {
     char const *name_str;
     void (*create)(GvoxAdapterContext *ctx, void const *config);
@@ -157,12 +172,20 @@ typedef struct {
 typedef struct {
     GvoxAdapterBaseInfo base_info;
     void (*read)(GvoxAdapterContext *ctx, size_t position, size_t size, void *data);
+    // Optional. A hint that the range will be read soon, so the adapter may start fetching it
+    void (*prefetch)(GvoxAdapterContext *ctx, size_t position, size_t size);
 } GvoxInputAdapterInfo;
 
 typedef struct {
     GvoxAdapterBaseInfo base_info;
     void (*write)(GvoxAdapterContext *ctx, size_t position, size_t size, void const *data);
     void (*reserve)(GvoxAdapterContext *ctx, size_t size);
+    // Optional. Writes each of the (positional) buffers, same as calling write for each
+    void (*writev)(GvoxAdapterContext *ctx, GvoxIoVec const *iovs, size_t iov_n);
+    // Optional. Returns a writable pointer to the given range of the output, or null if the adapter
+    // can't provide one. Bytes that weren't written yet read as zero. The pointer stays valid until
+    // the next write, reserve or the end of the blit.
+    void *(*map)(GvoxAdapterContext *ctx, size_t position, size_t size);
 } GvoxOutputAdapterInfo;
 
 typedef struct {
@@ -201,12 +224,29 @@ GVOX_EXPORT void gvox_adapter_push_error(GvoxAdapterContext *ctx, GvoxResult res
 GVOX_EXPORT void gvox_adapter_set_user_pointer(GvoxAdapterContext *ctx, void *ptr);
 GVOX_EXPORT void *gvox_adapter_get_user_pointer(GvoxAdapterContext *ctx);
 
+// Zero-initialized scratch storage that counts against the context's memory budget
+GVOX_EXPORT void *gvox_adapter_allocate_staging(GvoxAdapterContext *ctx, size_t size);
+GVOX_EXPORT void gvox_adapter_free_staging(GvoxAdapterContext *ctx, void *ptr);
+
 GVOX_EXPORT void gvox_input_read(GvoxBlitContext *blit_ctx, size_t position, size_t size, void *data);
+GVOX_EXPORT void gvox_input_prefetch(GvoxBlitContext *blit_ctx, size_t position, size_t size);
 GVOX_EXPORT void gvox_output_write(GvoxBlitContext *blit_ctx, size_t position, size_t size, void const *data);
 GVOX_EXPORT void gvox_output_reserve(GvoxBlitContext *blit_ctx, size_t size);
+GVOX_EXPORT void gvox_output_writev(GvoxBlitContext *blit_ctx, GvoxIoVec const *iovs, size_t iov_n);
+GVOX_EXPORT void *gvox_output_map(GvoxBlitContext *blit_ctx, size_t position, size_t size);
 
 GVOX_EXPORT void gvox_emit_region(GvoxBlitContext *blit_ctx, GvoxRegion const *region);
 
+// For adapters that wrap another adapter context
+GVOX_EXPORT void gvox_adapter_blit_begin(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags);
+GVOX_EXPORT void gvox_adapter_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx);
+GVOX_EXPORT void gvox_adapter_input_read(GvoxAdapterContext *input_ctx, size_t position, size_t size, void *data);
+GVOX_EXPORT void gvox_adapter_input_prefetch(GvoxAdapterContext *input_ctx, size_t position, size_t size);
+GVOX_EXPORT void gvox_adapter_output_write(GvoxAdapterContext *output_ctx, size_t position, size_t size, void const *data);
+GVOX_EXPORT void gvox_adapter_output_reserve(GvoxAdapterContext *output_ctx, size_t size);
+GVOX_EXPORT void gvox_adapter_output_writev(GvoxAdapterContext *output_ctx, GvoxIoVec const *iovs, size_t iov_n);
+GVOX_EXPORT void *gvox_adapter_output_map(GvoxAdapterContext *output_ctx, size_t position, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -7,6 +7,7 @@ set(SOURCE_PATH "${CMAKE_CURRENT_LIST_DIR}")
 vcpkg_check_features(OUT_FEATURE_OPTIONS FEATURE_OPTIONS
     FEATURES
     file-io WITH_FILE_IO
+    zstd WITH_ZSTD
 )
 
 set(GVOX_DEFINES "-DGVOX_ENABLE_MULTITHREADED_ADAPTERS=true" "-DGVOX_ENABLE_THREADSAFETY=true")
@@ -14,6 +15,9 @@ set(GVOX_DEFINES "-DGVOX_ENABLE_MULTITHREADED_ADAPTERS=true" "-DGVOX_ENABLE_THRE
 if(WITH_FILE_IO)
     list(APPEND GVOX_DEFINES "-DGVOX_ENABLE_FILE_IO=true")
 endif()
+if(WITH_ZSTD)
+    list(APPEND GVOX_DEFINES "-DGVOX_ENABLE_ZSTD=true")
+endif()
 
 vcpkg_configure_cmake(
     SOURCE_PATH "${SOURCE_PATH}"
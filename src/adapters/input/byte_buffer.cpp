@@ -43,3 +43,7 @@ extern "C" void gvox_input_adapter_byte_buffer_read(GvoxAdapterContext *ctx, siz
     }
     std::copy(user_state.bytes.data() + position, user_state.bytes.data() + position + size, static_cast<uint8_t *>(data));
 }
+
+extern "C" void gvox_input_adapter_byte_buffer_prefetch(GvoxAdapterContext * /*unused*/, size_t /*unused*/, size_t /*unused*/) {
+    // Already resident in memory
+}
@@ -13,15 +13,36 @@
 #include <mutex>
 #endif
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#define GVOX_FILE_INPUT_USE_FADVISE 1
+#else
+#define GVOX_FILE_INPUT_USE_FADVISE 0
+#endif
+
 struct FileInputUserState {
     std::filesystem::path path{};
     std::ifstream file{};
     size_t byte_offset{};
+#if GVOX_FILE_INPUT_USE_FADVISE
+    // Only used for handing read-ahead hints to the kernel
+    int advice_fd{-1};
+#endif
 #if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
     std::mutex mtx{};
 #endif
 };
 
+#if GVOX_FILE_INPUT_USE_FADVISE
+static void close_advice_fd(FileInputUserState &user_state) {
+    if (user_state.advice_fd != -1) {
+        close(user_state.advice_fd);
+        user_state.advice_fd = -1;
+    }
+}
+#endif
+
 // Base
 extern "C" void gvox_input_adapter_file_create(GvoxAdapterContext *ctx, void const *config) {
     auto *user_state_ptr = malloc(sizeof(FileInputUserState));
@@ -34,18 +55,32 @@ extern "C" void gvox_input_adapter_file_create(GvoxAdapterContext *ctx, void con
 
 extern "C" void gvox_input_adapter_file_destroy(GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<FileInputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_FILE_INPUT_USE_FADVISE
+    // blit_end never ran if the blit failed
+    close_advice_fd(user_state);
+#endif
     user_state.~FileInputUserState();
     free(&user_state);
 }
 
 extern "C" void gvox_input_adapter_file_blit_begin(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {
     auto &user_state = *static_cast<FileInputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    // Still open if the previous blit failed before reaching blit_end
+    user_state.file.close();
+    user_state.file.clear();
     user_state.file.open(user_state.path, std::ios::binary);
+#if GVOX_FILE_INPUT_USE_FADVISE
+    close_advice_fd(user_state);
+    user_state.advice_fd = open(user_state.path.c_str(), O_RDONLY);
+#endif
 }
 
 extern "C" void gvox_input_adapter_file_blit_end(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<FileInputUserState *>(gvox_adapter_get_user_pointer(ctx));
     user_state.file.close();
+#if GVOX_FILE_INPUT_USE_FADVISE
+    close_advice_fd(user_state);
+#endif
 }
 
 // General
@@ -57,3 +92,12 @@ extern "C" void gvox_input_adapter_file_read(GvoxAdapterContext *ctx, size_t pos
     user_state.file.seekg(static_cast<std::streamoff>(position), std::ios_base::beg);
     user_state.file.read(static_cast<char *>(data), static_cast<std::streamsize>(size));
 }
+
+extern "C" void gvox_input_adapter_file_prefetch([[maybe_unused]] GvoxAdapterContext *ctx, [[maybe_unused]] size_t position, [[maybe_unused]] size_t size) {
+#if GVOX_FILE_INPUT_USE_FADVISE
+    auto &user_state = *static_cast<FileInputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (user_state.advice_fd != -1) {
+        posix_fadvise(user_state.advice_fd, static_cast<off_t>(position), static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+    }
+#endif
+}
@@ -0,0 +1,297 @@
+#include <gvox/gvox.h>
+#include <gvox/adapters/input/zstd.h>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+#include <array>
+#include <vector>
+#include <new>
+#include <algorithm>
+
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+#include <mutex>
+#endif
+
+#include <zstd.h>
+
+#include "../shared/thread_pool.hpp"
+
+using namespace gvox_detail::thread_pool;
+
+// See the zstd seekable format specification (contrib/seekable_format)
+static constexpr auto ZSTD_SEEKABLE_SKIPPABLE_MAGIC = uint32_t{0x184D2A5E};
+static constexpr auto ZSTD_SEEKABLE_MAGIC = uint32_t{0x8F92EAB1};
+static constexpr auto ZSTD_SEEKABLE_FOOTER_SIZE = size_t{9};
+static constexpr auto ZSTD_SEEKABLE_CHECKSUM_FLAG = uint8_t{1u << 7};
+static constexpr auto DEFAULT_FRAME_CACHE_SIZE = size_t{8};
+
+struct ZstdFrame {
+    size_t compressed_offset;
+    size_t compressed_size;
+    size_t decompressed_offset;
+    size_t decompressed_size;
+};
+
+struct ZstdCachedFrame {
+    size_t frame_index;
+    uint64_t last_use;
+    std::vector<uint8_t> data;
+};
+
+struct ZstdInputUserState {
+    GvoxAdapterContext *input_ctx{};
+    size_t size{};
+    size_t frame_cache_size{};
+    bool is_seekable{};
+    std::vector<ZstdFrame> frames{};
+    std::vector<ZstdCachedFrame> frame_cache{};
+    uint64_t use_counter{};
+    // Only used when the stream has no seek table
+    std::vector<uint8_t> decompressed{};
+    ThreadPool thread_pool{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    std::mutex mtx{};
+#endif
+};
+
+static auto read_u32(uint8_t const *data) -> uint32_t {
+    return static_cast<uint32_t>(data[0]) |
+           (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) |
+           (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static auto load_seek_table(ZstdInputUserState &user_state) -> bool {
+    if (user_state.size < ZSTD_SEEKABLE_FOOTER_SIZE) {
+        return false;
+    }
+    auto footer = std::array<uint8_t, ZSTD_SEEKABLE_FOOTER_SIZE>{};
+    gvox_adapter_input_read(user_state.input_ctx, user_state.size - footer.size(), footer.size(), footer.data());
+    if (read_u32(footer.data() + 5) != ZSTD_SEEKABLE_MAGIC) {
+        return false;
+    }
+    auto const frame_n = static_cast<size_t>(read_u32(footer.data()));
+    auto const entry_size = size_t{8} + ((footer[4] & ZSTD_SEEKABLE_CHECKSUM_FLAG) != 0 ? 4 : 0);
+    auto const table_size = 8 + frame_n * entry_size + ZSTD_SEEKABLE_FOOTER_SIZE;
+    if (table_size > user_state.size) {
+        return false;
+    }
+    auto table = std::vector<uint8_t>(table_size - ZSTD_SEEKABLE_FOOTER_SIZE);
+    gvox_adapter_input_read(user_state.input_ctx, user_state.size - table_size, table.size(), table.data());
+    if (read_u32(table.data()) != ZSTD_SEEKABLE_SKIPPABLE_MAGIC) {
+        return false;
+    }
+    user_state.frames.resize(frame_n);
+    auto compressed_offset = size_t{0};
+    auto decompressed_offset = size_t{0};
+    for (size_t i = 0; i < frame_n; ++i) {
+        auto const *entry = table.data() + 8 + i * entry_size;
+        auto &frame = user_state.frames[i];
+        frame.compressed_offset = compressed_offset;
+        frame.compressed_size = read_u32(entry + 0);
+        frame.decompressed_offset = decompressed_offset;
+        frame.decompressed_size = read_u32(entry + 4);
+        compressed_offset += frame.compressed_size;
+        decompressed_offset += frame.decompressed_size;
+    }
+    if (compressed_offset > user_state.size - table_size) {
+        user_state.frames.clear();
+        return false;
+    }
+    return true;
+}
+
+static auto decompress_all(ZstdInputUserState &user_state) -> bool {
+    auto *dstream = ZSTD_createDStream();
+    if (dstream == nullptr) {
+        return false;
+    }
+    ZSTD_initDStream(dstream);
+    auto in_buffer = std::vector<uint8_t>(ZSTD_DStreamInSize());
+    auto out_buffer = std::vector<uint8_t>(ZSTD_DStreamOutSize());
+    auto result = true;
+    for (size_t position = 0; position < user_state.size && result;) {
+        auto const chunk_size = std::min(in_buffer.size(), user_state.size - position);
+        gvox_adapter_input_read(user_state.input_ctx, position, chunk_size, in_buffer.data());
+        position += chunk_size;
+        auto input = ZSTD_inBuffer{in_buffer.data(), chunk_size, 0};
+        while (input.pos < input.size) {
+            auto output = ZSTD_outBuffer{out_buffer.data(), out_buffer.size(), 0};
+            auto const ret = ZSTD_decompressStream(dstream, &output, &input);
+            if (ZSTD_isError(ret) != 0u) {
+                result = false;
+                break;
+            }
+            user_state.decompressed.insert(user_state.decompressed.end(), out_buffer.data(), out_buffer.data() + output.pos);
+        }
+    }
+    ZSTD_freeDStream(dstream);
+    return result;
+}
+
+// Base
+extern "C" void gvox_input_adapter_zstd_create(GvoxAdapterContext *ctx, void const *config) {
+    auto *user_state_ptr = malloc(sizeof(ZstdInputUserState));
+    auto &user_state = *(new (user_state_ptr) ZstdInputUserState());
+    gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    const auto &user_config = *static_cast<GvoxZstdInputAdapterConfig const *>(config);
+    user_state.input_ctx = user_config.input_ctx;
+    user_state.size = user_config.size;
+    user_state.frame_cache_size = user_config.frame_cache_size != 0 ? user_config.frame_cache_size : DEFAULT_FRAME_CACHE_SIZE;
+    if (user_state.input_ctx == nullptr) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INVALID_PARAMETER, "The zstd input adapter requires an input adapter context to read from");
+    }
+}
+
+extern "C" void gvox_input_adapter_zstd_destroy(GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<ZstdInputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    // A blit that failed part way through never reaches blit_end, so the pool may still be running
+    user_state.thread_pool.stop();
+    user_state.~ZstdInputUserState();
+    free(&user_state);
+}
+
+extern "C" void gvox_input_adapter_zstd_blit_begin(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) {
+    auto &user_state = *static_cast<ZstdInputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (user_state.input_ctx == nullptr) {
+        return;
+    }
+    gvox_adapter_blit_begin(blit_ctx, user_state.input_ctx, range, channel_flags);
+    user_state.is_seekable = load_seek_table(user_state);
+    if (!user_state.is_seekable && !decompress_all(user_state)) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INPUT_ADAPTER, "Failed to decompress the zstd input stream");
+        return;
+    }
+    user_state.thread_pool.start();
+}
+
+extern "C" void gvox_input_adapter_zstd_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<ZstdInputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (user_state.input_ctx == nullptr) {
+        return;
+    }
+    user_state.thread_pool.stop();
+    user_state.frames.clear();
+    user_state.frame_cache.clear();
+    user_state.decompressed = {};
+    gvox_adapter_blit_end(blit_ctx, user_state.input_ctx);
+}
+
+// General
+extern "C" void gvox_input_adapter_zstd_read(GvoxAdapterContext *ctx, size_t position, size_t size, void *data) {
+    auto &user_state = *static_cast<ZstdInputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    if (!user_state.is_seekable) {
+        if (position + size > user_state.decompressed.size()) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INPUT_ADAPTER, "Tried reading past the end of the decompressed zstd stream");
+            return;
+        }
+        std::copy(user_state.decompressed.data() + position, user_state.decompressed.data() + position + size, static_cast<uint8_t *>(data));
+        return;
+    }
+    if (size == 0) {
+        return;
+    }
+    if (user_state.frames.empty() || position + size > user_state.frames.back().decompressed_offset + user_state.frames.back().decompressed_size) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INPUT_ADAPTER, "Tried reading past the end of the decompressed zstd stream");
+        return;
+    }
+
+    auto first_frame_iter = std::upper_bound(
+        user_state.frames.begin(), user_state.frames.end(), position,
+        [](size_t pos, ZstdFrame const &frame) { return pos < frame.decompressed_offset; });
+    auto const first_frame = static_cast<size_t>(first_frame_iter - user_state.frames.begin()) - 1;
+    auto last_frame_index = first_frame;
+    while (user_state.frames[last_frame_index].decompressed_offset + user_state.frames[last_frame_index].decompressed_size < position + size) {
+        ++last_frame_index;
+    }
+
+    // Find which of the covering frames are already cached, and decompress
+    // the rest in parallel.
+    auto const frame_n = last_frame_index - first_frame + 1;
+    auto covering = std::vector<std::vector<uint8_t> const *>(frame_n, nullptr);
+    auto missing = std::vector<size_t>{};
+    ++user_state.use_counter;
+    for (size_t i = 0; i < frame_n; ++i) {
+        auto cache_iter = std::find_if(
+            user_state.frame_cache.begin(), user_state.frame_cache.end(),
+            [frame_index = first_frame + i](ZstdCachedFrame const &cached) { return cached.frame_index == frame_index; });
+        if (cache_iter != user_state.frame_cache.end()) {
+            cache_iter->last_use = user_state.use_counter;
+            covering[i] = &cache_iter->data;
+        } else {
+            missing.push_back(i);
+        }
+    }
+    auto decoded = std::vector<std::vector<uint8_t>>(missing.size());
+    auto decode_failed = std::vector<uint8_t>(missing.size(), 0);
+    for (size_t mi = 0; mi < missing.size(); ++mi) {
+        user_state.thread_pool.enqueue([&user_state, &decoded, &decode_failed, mi, frame_index = first_frame + missing[mi]]() {
+            auto const &frame = user_state.frames[frame_index];
+            auto compressed = std::vector<uint8_t>(frame.compressed_size);
+            gvox_adapter_input_read(user_state.input_ctx, frame.compressed_offset, frame.compressed_size, compressed.data());
+            decoded[mi].resize(frame.decompressed_size);
+            auto const ret = ZSTD_decompress(decoded[mi].data(), decoded[mi].size(), compressed.data(), compressed.size());
+            decode_failed[mi] = (ZSTD_isError(ret) != 0u || ret != frame.decompressed_size) ? 1 : 0;
+        });
+    }
+    user_state.thread_pool.wait();
+    for (size_t mi = 0; mi < missing.size(); ++mi) {
+        if (decode_failed[mi] != 0) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INPUT_ADAPTER, "Failed to decompress a frame of the zstd input stream");
+            return;
+        }
+        covering[missing[mi]] = &decoded[mi];
+    }
+
+    auto *out = static_cast<uint8_t *>(data);
+    for (size_t i = 0; i < frame_n; ++i) {
+        auto const &frame = user_state.frames[first_frame + i];
+        auto const copy_begin = std::max(position, frame.decompressed_offset);
+        auto const copy_end = std::min(position + size, frame.decompressed_offset + frame.decompressed_size);
+        std::memcpy(out + (copy_begin - position), covering[i]->data() + (copy_begin - frame.decompressed_offset), copy_end - copy_begin);
+    }
+
+    // Keep the freshly decoded frames around, evicting the least recently used
+    for (size_t mi = 0; mi < missing.size(); ++mi) {
+        auto new_entry = ZstdCachedFrame{
+            .frame_index = first_frame + missing[mi],
+            .last_use = user_state.use_counter,
+            .data = std::move(decoded[mi]),
+        };
+        if (user_state.frame_cache.size() < user_state.frame_cache_size) {
+            user_state.frame_cache.push_back(std::move(new_entry));
+        } else {
+            auto lru_iter = std::min_element(
+                user_state.frame_cache.begin(), user_state.frame_cache.end(),
+                [](ZstdCachedFrame const &a, ZstdCachedFrame const &b) { return a.last_use < b.last_use; });
+            *lru_iter = std::move(new_entry);
+        }
+    }
+}
+
+extern "C" void gvox_input_adapter_zstd_prefetch(GvoxAdapterContext *ctx, size_t position, size_t size) {
+    auto &user_state = *static_cast<ZstdInputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (!user_state.is_seekable || user_state.frames.empty() || size == 0) {
+        // Non-seekable streams are fully decompressed up front
+        return;
+    }
+    auto first_frame_iter = std::upper_bound(
+        user_state.frames.begin(), user_state.frames.end(), position,
+        [](size_t pos, ZstdFrame const &frame) { return pos < frame.decompressed_offset; });
+    auto last_frame_iter = std::lower_bound(
+        user_state.frames.begin(), user_state.frames.end(), position + size,
+        [](ZstdFrame const &frame, size_t pos) { return frame.decompressed_offset < pos; });
+    if (first_frame_iter == user_state.frames.begin() || last_frame_iter == user_state.frames.begin()) {
+        return;
+    }
+    auto const &first_frame = *(first_frame_iter - 1);
+    auto const &last_frame = *(last_frame_iter - 1);
+    gvox_adapter_input_prefetch(
+        user_state.input_ctx, first_frame.compressed_offset,
+        last_frame.compressed_offset + last_frame.compressed_size - first_frame.compressed_offset);
+}
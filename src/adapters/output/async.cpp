@@ -0,0 +1,230 @@
+#include <gvox/gvox.h>
+#include <gvox/adapters/output/async.h>
+
+#include <cstdlib>
+#include <cstdint>
+
+#include <algorithm>
+#include <vector>
+#include <new>
+
+#define ENABLE_ASYNC_WRITER (GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY)
+
+#if ENABLE_ASYNC_WRITER
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#endif
+
+static constexpr auto DEFAULT_BUFFER_SIZE = size_t{1024} * 1024;
+static constexpr auto DEFAULT_BUFFER_COUNT = size_t{4};
+static constexpr auto NO_BUFFER = ~size_t{0};
+
+struct AsyncOutputBuffer {
+    size_t position{};
+    size_t used{};
+    std::vector<uint8_t> data{};
+};
+
+// Either a filled buffer to write out, or a reserve call to forward
+struct AsyncOutputOp {
+    size_t buffer_index;
+    size_t reserve_size;
+};
+
+struct AsyncOutputUserState {
+    GvoxAdapterContext *output_ctx{};
+    size_t buffer_size{};
+    size_t buffer_count{};
+#if ENABLE_ASYNC_WRITER
+    std::vector<AsyncOutputBuffer> buffers{};
+    std::deque<size_t> free_buffers{};
+    std::deque<AsyncOutputOp> pending_ops{};
+    size_t current_buffer = NO_BUFFER;
+    bool writer_busy = false;
+    bool should_terminate = false;
+    std::mutex mtx{};
+    std::condition_variable pending_condition{};
+    std::condition_variable free_condition{};
+    std::thread writer{};
+#endif
+};
+
+#if ENABLE_ASYNC_WRITER
+static void writer_loop(AsyncOutputUserState &user_state) {
+    auto lock = std::unique_lock{user_state.mtx};
+    while (true) {
+        user_state.pending_condition.wait(lock, [&user_state] {
+            return !user_state.pending_ops.empty() || user_state.should_terminate;
+        });
+        if (user_state.pending_ops.empty()) {
+            return;
+        }
+        auto op = user_state.pending_ops.front();
+        user_state.pending_ops.pop_front();
+        user_state.writer_busy = true;
+        lock.unlock();
+        if (op.buffer_index == NO_BUFFER) {
+            gvox_adapter_output_reserve(user_state.output_ctx, op.reserve_size);
+        } else {
+            auto const &buffer = user_state.buffers[op.buffer_index];
+            gvox_adapter_output_write(user_state.output_ctx, buffer.position, buffer.used, buffer.data.data());
+        }
+        lock.lock();
+        user_state.writer_busy = false;
+        if (op.buffer_index != NO_BUFFER) {
+            user_state.free_buffers.push_back(op.buffer_index);
+        }
+        user_state.free_condition.notify_all();
+    }
+}
+
+// Must be called with the mutex held
+static void submit_current_buffer(AsyncOutputUserState &user_state) {
+    if (user_state.current_buffer == NO_BUFFER) {
+        return;
+    }
+    user_state.pending_ops.push_back({.buffer_index = user_state.current_buffer, .reserve_size = 0});
+    user_state.current_buffer = NO_BUFFER;
+    user_state.pending_condition.notify_one();
+}
+
+static void wait_until_drained(AsyncOutputUserState &user_state, std::unique_lock<std::mutex> &lock) {
+    user_state.free_condition.wait(lock, [&user_state] {
+        return user_state.pending_ops.empty() && !user_state.writer_busy;
+    });
+}
+#endif
+
+// Base
+extern "C" void gvox_output_adapter_async_create(GvoxAdapterContext *ctx, void const *config) {
+    auto *user_state_ptr = malloc(sizeof(AsyncOutputUserState));
+    auto &user_state = *(new (user_state_ptr) AsyncOutputUserState());
+    gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    if (config == nullptr || static_cast<GvoxAsyncOutputAdapterConfig const *>(config)->output_ctx == nullptr) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INVALID_PARAMETER, "The async output adapter requires an output adapter context to write to");
+        return;
+    }
+    const auto &user_config = *static_cast<GvoxAsyncOutputAdapterConfig const *>(config);
+    user_state.output_ctx = user_config.output_ctx;
+    user_state.buffer_size = user_config.buffer_size != 0 ? user_config.buffer_size : DEFAULT_BUFFER_SIZE;
+    // At least two, so that one can fill while another drains
+    user_state.buffer_count = std::max(user_config.buffer_count != 0 ? user_config.buffer_count : DEFAULT_BUFFER_COUNT, size_t{2});
+}
+
+extern "C" void gvox_output_adapter_async_destroy(GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<AsyncOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if ENABLE_ASYNC_WRITER
+    // The writer is still running if the blit failed before reaching blit_end,
+    // in which case whatever it hasn't written yet is dropped
+    if (user_state.writer.joinable()) {
+        {
+            auto lock = std::unique_lock{user_state.mtx};
+            user_state.pending_ops.clear();
+            user_state.should_terminate = true;
+        }
+        user_state.pending_condition.notify_all();
+        user_state.writer.join();
+    }
+#endif
+    user_state.~AsyncOutputUserState();
+    free(&user_state);
+}
+
+extern "C" void gvox_output_adapter_async_blit_begin(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) {
+    auto &user_state = *static_cast<AsyncOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (user_state.output_ctx == nullptr) {
+        return;
+    }
+    gvox_adapter_blit_begin(blit_ctx, user_state.output_ctx, range, channel_flags);
+#if ENABLE_ASYNC_WRITER
+    user_state.buffers.resize(user_state.buffer_count);
+    user_state.free_buffers.clear();
+    for (size_t i = 0; i < user_state.buffer_count; ++i) {
+        user_state.buffers[i].data.resize(user_state.buffer_size);
+        user_state.free_buffers.push_back(i);
+    }
+    user_state.current_buffer = NO_BUFFER;
+    user_state.should_terminate = false;
+    user_state.writer = std::thread(writer_loop, std::ref(user_state));
+#endif
+}
+
+extern "C" void gvox_output_adapter_async_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<AsyncOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (user_state.output_ctx == nullptr) {
+        return;
+    }
+#if ENABLE_ASYNC_WRITER
+    {
+        auto lock = std::unique_lock{user_state.mtx};
+        submit_current_buffer(user_state);
+        wait_until_drained(user_state, lock);
+        user_state.should_terminate = true;
+    }
+    user_state.pending_condition.notify_all();
+    user_state.writer.join();
+    user_state.buffers.clear();
+#endif
+    gvox_adapter_blit_end(blit_ctx, user_state.output_ctx);
+}
+
+// General
+extern "C" void gvox_output_adapter_async_write(GvoxAdapterContext *ctx, size_t position, size_t size, void const *data) {
+    auto &user_state = *static_cast<AsyncOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if ENABLE_ASYNC_WRITER
+    auto lock = std::unique_lock{user_state.mtx};
+    const auto *bytes = static_cast<uint8_t const *>(data);
+    while (size > 0) {
+        if (user_state.current_buffer != NO_BUFFER) {
+            auto &buffer = user_state.buffers[user_state.current_buffer];
+            if (position == buffer.position + buffer.used) {
+                auto const copy_size = std::min(size, buffer.data.size() - buffer.used);
+                std::copy(bytes, bytes + copy_size, buffer.data.data() + buffer.used);
+                buffer.used += copy_size;
+                position += copy_size;
+                bytes += copy_size;
+                size -= copy_size;
+                if (buffer.used == buffer.data.size()) {
+                    submit_current_buffer(user_state);
+                }
+                continue;
+            }
+            // Not contiguous, so the queue keeps it ordered after what's buffered
+            submit_current_buffer(user_state);
+        }
+        user_state.free_condition.wait(lock, [&user_state] { return !user_state.free_buffers.empty(); });
+        user_state.current_buffer = user_state.free_buffers.front();
+        user_state.free_buffers.pop_front();
+        auto &buffer = user_state.buffers[user_state.current_buffer];
+        buffer.position = position;
+        buffer.used = 0;
+    }
+#else
+    gvox_adapter_output_write(user_state.output_ctx, position, size, data);
+#endif
+}
+
+extern "C" void gvox_output_adapter_async_reserve(GvoxAdapterContext *ctx, size_t size) {
+    auto &user_state = *static_cast<AsyncOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if ENABLE_ASYNC_WRITER
+    auto lock = std::unique_lock{user_state.mtx};
+    submit_current_buffer(user_state);
+    user_state.pending_ops.push_back({.buffer_index = NO_BUFFER, .reserve_size = size});
+    user_state.pending_condition.notify_one();
+#else
+    gvox_adapter_output_reserve(user_state.output_ctx, size);
+#endif
+}
+
+extern "C" void gvox_output_adapter_async_writev(GvoxAdapterContext *ctx, GvoxIoVec const *iovs, size_t iov_n) {
+    for (size_t i = 0; i < iov_n; ++i) {
+        gvox_output_adapter_async_write(ctx, iovs[i].position, iovs[i].size, iovs[i].data);
+    }
+}
+
+extern "C" auto gvox_output_adapter_async_map(GvoxAdapterContext * /*unused*/, size_t /*unused*/, size_t /*unused*/) -> void * {
+    // The wrapped output is only touched from the writer thread
+    return nullptr;
+}
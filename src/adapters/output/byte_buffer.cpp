@@ -5,14 +5,59 @@
 #include <cstdint>
 
 #include <algorithm>
-#include <vector>
 #include <new>
 
+static constexpr auto MIN_GROWTH_SIZE = size_t{4096};
+
 struct ByteBufferOutputUserState {
     GvoxByteBufferOutputAdapterConfig config{};
-    std::vector<uint8_t> bytes{};
+    // Either caller-owned storage (when using `reallocate` or a fixed
+    // capacity), or our own malloc'd storage
+    uint8_t *data{};
+    size_t capacity{};
+    // Bytes up to `size` have been written or zero-filled
+    size_t size{};
+    size_t reserved_size{};
+    bool is_caller_storage{};
 };
 
+static auto grow(GvoxAdapterContext *ctx, ByteBufferOutputUserState &user_state, size_t required_size) -> bool {
+    if (required_size <= user_state.capacity) {
+        return true;
+    }
+    if (user_state.is_caller_storage && user_state.config.reallocate == nullptr) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "The output doesn't fit in the provided byte buffer");
+        return false;
+    }
+    auto const new_capacity = std::max({required_size, user_state.capacity * 2, MIN_GROWTH_SIZE});
+    void *new_data = nullptr;
+    if (user_state.is_caller_storage) {
+        new_data = user_state.config.reallocate(user_state.data, new_capacity);
+    } else {
+        new_data = realloc(user_state.data, new_capacity);
+    }
+    if (new_data == nullptr) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to grow the output byte buffer");
+        return false;
+    }
+    user_state.data = static_cast<uint8_t *>(new_data);
+    user_state.capacity = new_capacity;
+    if (user_state.is_caller_storage) {
+        // The old pointer may have been freed, and blit_end may never be
+        // reached if the blit fails, so the caller has to see it right away
+        *user_state.config.out_byte_buffer_ptr = user_state.data;
+    }
+    return true;
+}
+
+static void release_own_storage(ByteBufferOutputUserState &user_state) {
+    if (!user_state.is_caller_storage) {
+        free(user_state.data);
+    }
+    user_state.data = nullptr;
+    user_state.capacity = 0;
+}
+
 // Base
 extern "C" void gvox_output_adapter_byte_buffer_create(GvoxAdapterContext *ctx, void const *config) {
     auto *user_state_ptr = malloc(sizeof(ByteBufferOutputUserState));
@@ -27,40 +72,94 @@ extern "C" void gvox_output_adapter_byte_buffer_create(GvoxAdapterContext *ctx,
 
 extern "C" void gvox_output_adapter_byte_buffer_destroy(GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<ByteBufferOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    release_own_storage(user_state);
     user_state.~ByteBufferOutputUserState();
     free(&user_state);
 }
 
-extern "C" void gvox_output_adapter_byte_buffer_blit_begin(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {
+extern "C" void gvox_output_adapter_byte_buffer_blit_begin(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {
+    auto &user_state = *static_cast<ByteBufferOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    release_own_storage(user_state);
+    // Without somewhere to hand caller storage back, our own is used, so that it can't leak
+    user_state.is_caller_storage = (user_state.config.reallocate != nullptr || user_state.config.capacity != 0) && user_state.config.out_byte_buffer_ptr != nullptr;
+    if (user_state.is_caller_storage) {
+        user_state.data = *user_state.config.out_byte_buffer_ptr;
+        user_state.capacity = user_state.data != nullptr ? user_state.config.capacity : 0;
+    }
+    user_state.size = 0;
+    user_state.reserved_size = 0;
 }
 
 extern "C" void gvox_output_adapter_byte_buffer_blit_end(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<ByteBufferOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
-    void *bytes = nullptr;
+    if (user_state.config.out_byte_buffer_ptr == nullptr || user_state.config.out_size == nullptr) {
+        return;
+    }
+    // Reserved bytes that were never written are still part of the output
+    if (user_state.reserved_size > user_state.size && grow(ctx, user_state, user_state.reserved_size)) {
+        std::fill(user_state.data + user_state.size, user_state.data + user_state.reserved_size, uint8_t{0});
+        user_state.size = user_state.reserved_size;
+    }
     // NOTE: This needs to be manually cleaned up by the user!
-    if (user_state.config.allocate != nullptr) {
-        bytes = user_state.config.allocate(user_state.bytes.size());
+    if (!user_state.is_caller_storage && user_state.config.allocate != nullptr) {
+        // The custom allocator can't adopt our storage, so this still copies
+        auto *bytes = static_cast<uint8_t *>(user_state.config.allocate(user_state.size));
+        std::copy(user_state.data, user_state.data + user_state.size, bytes);
+        release_own_storage(user_state);
+        *user_state.config.out_byte_buffer_ptr = bytes;
     } else {
-        bytes = malloc(user_state.bytes.size());
+        *user_state.config.out_byte_buffer_ptr = user_state.data;
+        // Ownership has been handed off
+        user_state.data = nullptr;
+        user_state.capacity = 0;
     }
-    std::copy(user_state.bytes.begin(), user_state.bytes.end(), static_cast<uint8_t *>(bytes));
-    *user_state.config.out_byte_buffer_ptr = static_cast<uint8_t *>(bytes);
-    *user_state.config.out_size = user_state.bytes.size();
+    *user_state.config.out_size = user_state.size;
 }
 
 // General
 extern "C" void gvox_output_adapter_byte_buffer_write(GvoxAdapterContext *ctx, size_t position, size_t size, void const *data) {
     auto &user_state = *static_cast<ByteBufferOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
-    if (position + size > user_state.bytes.size()) {
-        user_state.bytes.resize(position + size);
+    if (!grow(ctx, user_state, position + size)) {
+        return;
+    }
+    if (position > user_state.size) {
+        std::fill(user_state.data + user_state.size, user_state.data + position, uint8_t{0});
     }
     const auto *bytes = static_cast<uint8_t const *>(data);
-    std::copy(bytes, bytes + size, user_state.bytes.data() + position);
+    std::copy(bytes, bytes + size, user_state.data + position);
+    user_state.size = std::max(user_state.size, position + size);
 }
 
 extern "C" void gvox_output_adapter_byte_buffer_reserve(GvoxAdapterContext *ctx, size_t size) {
     auto &user_state = *static_cast<ByteBufferOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
-    if (size > user_state.bytes.size()) {
-        user_state.bytes.resize(size);
+    if (grow(ctx, user_state, size)) {
+        user_state.reserved_size = std::max(user_state.reserved_size, size);
+    }
+}
+
+extern "C" void gvox_output_adapter_byte_buffer_writev(GvoxAdapterContext *ctx, GvoxIoVec const *iovs, size_t iov_n) {
+    auto &user_state = *static_cast<ByteBufferOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    auto required_size = size_t{0};
+    for (size_t i = 0; i < iov_n; ++i) {
+        required_size = std::max(required_size, iovs[i].position + iovs[i].size);
+    }
+    // Grow once up front, rather than for each write
+    if (!grow(ctx, user_state, required_size)) {
+        return;
+    }
+    for (size_t i = 0; i < iov_n; ++i) {
+        gvox_output_adapter_byte_buffer_write(ctx, iovs[i].position, iovs[i].size, iovs[i].data);
+    }
+}
+
+extern "C" auto gvox_output_adapter_byte_buffer_map(GvoxAdapterContext *ctx, size_t position, size_t size) -> void * {
+    auto &user_state = *static_cast<ByteBufferOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (!grow(ctx, user_state, position + size)) {
+        return nullptr;
+    }
+    if (position + size > user_state.size) {
+        std::fill(user_state.data + user_state.size, user_state.data + position + size, uint8_t{0});
+        user_state.size = position + size;
     }
+    return user_state.data + position;
 }
@@ -0,0 +1,159 @@
+#include <gvox/gvox.h>
+#include <gvox/adapters/output/fd.h>
+
+#include <cstdlib>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <new>
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#endif
+
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+#include <mutex>
+#endif
+
+#include "../shared/buffered_fd.hpp"
+
+using namespace gvox_detail::buffered_fd;
+
+struct FdOutputUserState {
+    GvoxFdOutputAdapterConfig config{};
+    BufferedFd out{};
+    // Where the descriptor was at blit begin, or -1 if it can't seek
+    int64_t base_offset = -1;
+    // Everything before this has been flushed or is buffered
+    size_t stream_position{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    std::mutex mtx{};
+#endif
+};
+
+static auto append_zeros(FdOutputUserState &user_state, size_t size) -> bool {
+    static constexpr auto zeros = std::array<uint8_t, 4096>{};
+    while (size > 0) {
+        auto const chunk_size = std::min(size, zeros.size());
+        if (!user_state.out.write(zeros.data(), chunk_size)) {
+            return false;
+        }
+        user_state.stream_position += chunk_size;
+        size -= chunk_size;
+    }
+    return true;
+}
+
+static void write_behind(GvoxAdapterContext *ctx, FdOutputUserState &user_state, size_t position, size_t size, uint8_t const *bytes) {
+    auto const buffered_start = user_state.stream_position - user_state.out.used;
+    if (position >= buffered_start) {
+        std::copy(bytes, bytes + size, user_state.out.buffer.data() + (position - buffered_start));
+        return;
+    }
+#if defined(_WIN32)
+    gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "The fd output adapter can't write behind what it already flushed on this platform");
+#else
+    if (user_state.base_offset < 0) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Can't write behind what was already flushed to a descriptor that can't seek");
+        return;
+    }
+    if (!user_state.out.flush()) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to write to the file descriptor");
+        return;
+    }
+    auto offset = static_cast<off_t>(user_state.base_offset) + static_cast<off_t>(position);
+    while (size > 0) {
+        auto const written = ::pwrite(user_state.config.fd, bytes, size, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to write to the file descriptor");
+            return;
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+        offset += written;
+    }
+#endif
+}
+
+// Base
+extern "C" void gvox_output_adapter_fd_create(GvoxAdapterContext *ctx, void const *config) {
+    auto *user_state_ptr = malloc(sizeof(FdOutputUserState));
+    auto &user_state = *(new (user_state_ptr) FdOutputUserState());
+    gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    if (config != nullptr) {
+        user_state.config = *static_cast<GvoxFdOutputAdapterConfig const *>(config);
+    } else {
+        user_state.config.fd = -1;
+    }
+    if (user_state.config.fd < 0) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INVALID_PARAMETER, "The fd output adapter requires an open file descriptor");
+    }
+}
+
+extern "C" void gvox_output_adapter_fd_destroy(GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<FdOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    user_state.~FdOutputUserState();
+    free(&user_state);
+}
+
+extern "C" void gvox_output_adapter_fd_blit_begin(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {
+    auto &user_state = *static_cast<FdOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    user_state.out.start(user_state.config.fd, user_state.config.buffer_size);
+    user_state.stream_position = 0;
+#if defined(_WIN32)
+    user_state.base_offset = -1;
+#else
+    // Pipes and sockets fail here, and so can only be written front to back
+    user_state.base_offset = static_cast<int64_t>(::lseek(user_state.config.fd, 0, SEEK_CUR));
+#endif
+}
+
+extern "C" void gvox_output_adapter_fd_blit_end(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<FdOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (!user_state.out.flush()) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to write to the file descriptor");
+    }
+    user_state.out.buffer = {};
+}
+
+// General
+extern "C" void gvox_output_adapter_fd_write(GvoxAdapterContext *ctx, size_t position, size_t size, void const *data) {
+    auto &user_state = *static_cast<FdOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    const auto *bytes = static_cast<uint8_t const *>(data);
+    if (position < user_state.stream_position) {
+        auto const behind_size = std::min(size, user_state.stream_position - position);
+        write_behind(ctx, user_state, position, behind_size, bytes);
+        position += behind_size;
+        bytes += behind_size;
+        size -= behind_size;
+        if (size == 0) {
+            return;
+        }
+    }
+    if (!append_zeros(user_state, position - user_state.stream_position) || !user_state.out.write(bytes, size)) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to write to the file descriptor");
+        return;
+    }
+    user_state.stream_position += size;
+}
+
+extern "C" void gvox_output_adapter_fd_reserve(GvoxAdapterContext * /*unused*/, size_t /*unused*/) {
+}
+
+extern "C" void gvox_output_adapter_fd_writev(GvoxAdapterContext *ctx, GvoxIoVec const *iovs, size_t iov_n) {
+    for (size_t i = 0; i < iov_n; ++i) {
+        gvox_output_adapter_fd_write(ctx, iovs[i].position, iovs[i].size, iovs[i].data);
+    }
+}
+
+extern "C" auto gvox_output_adapter_fd_map(GvoxAdapterContext * /*unused*/, size_t /*unused*/, size_t /*unused*/) -> void * {
+    // A descriptor may well be a pipe, which can't be mapped
+    return nullptr;
+}
@@ -6,23 +6,180 @@
 
 #include <algorithm>
 #include <filesystem>
-#include <fstream>
 #include <vector>
 #include <new>
 
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+#include <mutex>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define GVOX_FILE_OUTPUT_USE_POSIX 1
+#if defined(__linux__)
+#include <sys/uio.h>
+#define GVOX_FILE_OUTPUT_USE_PWRITEV 1
+#else
+#define GVOX_FILE_OUTPUT_USE_PWRITEV 0
+#endif
+#else
+#include <fstream>
+#define GVOX_FILE_OUTPUT_USE_POSIX 0
+#define GVOX_FILE_OUTPUT_USE_PWRITEV 0
+#endif
+
+static constexpr auto DEFAULT_BUFFER_SIZE = size_t{4} * 1024 * 1024;
+#if GVOX_FILE_OUTPUT_USE_PWRITEV
+// UIO_MAXIOV
+static constexpr auto MAX_IOVEC_N = size_t{1024};
+#endif
+
 struct OutputFileUserState {
     std::filesystem::path path{};
-    std::vector<uint8_t> bytes{};
+#if GVOX_FILE_OUTPUT_USE_POSIX
+    int fd{-1};
+#else
+    std::ofstream file{};
+#endif
+    // Write-back buffer holding `buffer_used` contiguous bytes, which belong
+    // at `buffer_position` in the file
+    std::vector<uint8_t> buffer{};
+    size_t buffer_size{};
+    size_t buffer_position{};
+    size_t buffer_used{};
+    size_t file_size{};
+    size_t reserved_size{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    std::mutex mtx{};
+#endif
 };
 
+static auto is_open(OutputFileUserState const &user_state) -> bool {
+#if GVOX_FILE_OUTPUT_USE_POSIX
+    return user_state.fd != -1;
+#else
+    return user_state.file.is_open();
+#endif
+}
+
+static void write_to_file(GvoxAdapterContext *ctx, OutputFileUserState &user_state, size_t position, size_t size, uint8_t const *data) {
+    if (size == 0 || !is_open(user_state)) {
+        return;
+    }
+#if GVOX_FILE_OUTPUT_USE_POSIX
+    while (size > 0) {
+        auto const written = pwrite(user_state.fd, data, size, static_cast<off_t>(position));
+        if (written < 0) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to write to the output file");
+            return;
+        }
+        position += static_cast<size_t>(written);
+        size -= static_cast<size_t>(written);
+        data += written;
+    }
+#else
+    user_state.file.seekp(static_cast<std::streamoff>(position), std::ios_base::beg);
+    user_state.file.write(reinterpret_cast<char const *>(data), static_cast<std::streamsize>(size));
+    if (!user_state.file) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to write to the output file");
+        return;
+    }
+    position += size;
+#endif
+    user_state.file_size = std::max(user_state.file_size, position);
+}
+
+static void flush_buffer(GvoxAdapterContext *ctx, OutputFileUserState &user_state) {
+    write_to_file(ctx, user_state, user_state.buffer_position, user_state.buffer_used, user_state.buffer.data());
+    user_state.buffer_position += user_state.buffer_used;
+    user_state.buffer_used = 0;
+}
+
+// Writes a run of contiguous buffers starting at `position`
+static void write_run_to_file(GvoxAdapterContext *ctx, OutputFileUserState &user_state, size_t position, GvoxIoVec const *iovs, size_t iov_n) {
+#if GVOX_FILE_OUTPUT_USE_PWRITEV
+    if (!is_open(user_state)) {
+        return;
+    }
+    auto vecs = std::vector<iovec>(iov_n);
+    for (size_t i = 0; i < iov_n; ++i) {
+        vecs[i].iov_base = const_cast<void *>(iovs[i].data);
+        vecs[i].iov_len = iovs[i].size;
+    }
+    size_t vec_i = 0;
+    while (vec_i < iov_n) {
+        auto written = pwritev(user_state.fd, vecs.data() + vec_i, static_cast<int>(std::min(iov_n - vec_i, MAX_IOVEC_N)), static_cast<off_t>(position));
+        if (written < 0) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to write to the output file");
+            return;
+        }
+        position += static_cast<size_t>(written);
+        // Skip past whatever was written, which may end part way through a buffer
+        while (vec_i < iov_n && static_cast<size_t>(written) >= vecs[vec_i].iov_len) {
+            written -= static_cast<ssize_t>(vecs[vec_i].iov_len);
+            ++vec_i;
+        }
+        if (written > 0) {
+            vecs[vec_i].iov_base = static_cast<uint8_t *>(vecs[vec_i].iov_base) + written;
+            vecs[vec_i].iov_len -= static_cast<size_t>(written);
+        }
+    }
+    user_state.file_size = std::max(user_state.file_size, position);
+#else
+    for (size_t i = 0; i < iov_n; ++i) {
+        write_to_file(ctx, user_state, position, iovs[i].size, static_cast<uint8_t const *>(iovs[i].data));
+        position += iovs[i].size;
+    }
+#endif
+}
+
+// Gets the buffer out of the way of a write that bypasses it
+static void prepare_direct_write(GvoxAdapterContext *ctx, OutputFileUserState &user_state, size_t position, size_t size) {
+    auto const buffer_end = user_state.buffer_position + user_state.buffer_used;
+    if (position >= buffer_end) {
+        flush_buffer(ctx, user_state);
+        user_state.buffer_position = position + size;
+    } else if (position + size > user_state.buffer_position) {
+        // Overlaps the buffered bytes, which must land first
+        flush_buffer(ctx, user_state);
+    }
+}
+
+static void write_buffered(GvoxAdapterContext *ctx, OutputFileUserState &user_state, size_t position, size_t size, uint8_t const *bytes) {
+    auto const buffer_end = user_state.buffer_position + user_state.buffer_used;
+    auto const buffer_capacity_end = user_state.buffer_position + user_state.buffer.size();
+    if (position >= user_state.buffer_position && position <= buffer_end && position + size <= buffer_capacity_end) {
+        // Continues (or overwrites part of) what's buffered
+        std::copy(bytes, bytes + size, user_state.buffer.data() + (position - user_state.buffer_position));
+        user_state.buffer_used = std::max(user_state.buffer_used, position + size - user_state.buffer_position);
+        return;
+    }
+    if (position >= buffer_end && size < user_state.buffer.size()) {
+        // Moving forward, so start buffering from here
+        flush_buffer(ctx, user_state);
+        user_state.buffer_position = position;
+        std::copy(bytes, bytes + size, user_state.buffer.data());
+        user_state.buffer_used = size;
+        return;
+    }
+    // Large writes, and back-patches of already flushed data
+    prepare_direct_write(ctx, user_state, position, size);
+    write_to_file(ctx, user_state, position, size, bytes);
+}
+
 // Base
 extern "C" void gvox_output_adapter_file_create(GvoxAdapterContext *ctx, void const *config) {
     auto *user_state_ptr = malloc(sizeof(OutputFileUserState));
     auto &user_state = *(new (user_state_ptr) OutputFileUserState());
     gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    user_state.buffer_size = DEFAULT_BUFFER_SIZE;
     if (config != nullptr) {
         const auto *user_config = static_cast<GvoxFileOutputAdapterConfig const *>(config);
         user_state.path = user_config->filepath;
+        if (user_config->buffer_size != 0) {
+            user_state.buffer_size = user_config->buffer_size;
+        }
     } else {
         user_state.path = "gvox_file_out.bin";
     }
@@ -30,30 +187,111 @@ extern "C" void gvox_output_adapter_file_create(GvoxAdapterContext *ctx, void co
 
 extern "C" void gvox_output_adapter_file_destroy(GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<OutputFileUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_FILE_OUTPUT_USE_POSIX
+    if (user_state.fd != -1) {
+        close(user_state.fd);
+    }
+#endif
     user_state.~OutputFileUserState();
     free(&user_state);
 }
 
-extern "C" void gvox_output_adapter_file_blit_begin(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {
+extern "C" void gvox_output_adapter_file_blit_begin(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {
+    auto &user_state = *static_cast<OutputFileUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_FILE_OUTPUT_USE_POSIX
+    user_state.fd = open(user_state.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#else
+    user_state.file.open(user_state.path, std::ios_base::binary | std::ios_base::trunc);
+#endif
+    if (!is_open(user_state)) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to open the output file");
+    }
+    user_state.buffer.resize(user_state.buffer_size);
+    user_state.buffer_position = 0;
+    user_state.buffer_used = 0;
+    user_state.file_size = 0;
+    user_state.reserved_size = 0;
 }
 
 extern "C" void gvox_output_adapter_file_blit_end(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<OutputFileUserState *>(gvox_adapter_get_user_pointer(ctx));
-    auto file = std::ofstream(user_state.path, std::ios_base::binary);
-    file.write(reinterpret_cast<char const *>(user_state.bytes.data()), static_cast<std::streamsize>(user_state.bytes.size()));
+    flush_buffer(ctx, user_state);
+    if (is_open(user_state) && user_state.reserved_size > user_state.file_size) {
+        // Reserved space that was never written is still part of the output
+#if GVOX_FILE_OUTPUT_USE_POSIX
+        if (ftruncate(user_state.fd, static_cast<off_t>(user_state.reserved_size)) != 0) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to resize the output file");
+        }
+#else
+        uint8_t const zero = 0;
+        write_to_file(ctx, user_state, user_state.reserved_size - 1, 1, &zero);
+#endif
+    }
+#if GVOX_FILE_OUTPUT_USE_POSIX
+    if (user_state.fd != -1) {
+        close(user_state.fd);
+        user_state.fd = -1;
+    }
+#else
+    user_state.file.close();
+#endif
+    user_state.buffer = {};
 }
 
 // General
 extern "C" void gvox_output_adapter_file_reserve(GvoxAdapterContext *ctx, size_t size) {
     auto &user_state = *static_cast<OutputFileUserState *>(gvox_adapter_get_user_pointer(ctx));
-    if (size > user_state.bytes.size()) {
-        user_state.bytes.resize(size);
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    if (size <= user_state.reserved_size) {
+        return;
+    }
+    user_state.reserved_size = size;
+#if defined(__linux__)
+    if (user_state.fd != -1) {
+        // Failure (e.g. EOPNOTSUPP) is fine, blit_end extends the file instead
+        if (posix_fallocate(user_state.fd, 0, static_cast<off_t>(size)) == 0) {
+            user_state.file_size = std::max(user_state.file_size, size);
+        }
     }
+#endif
 }
 
 extern "C" void gvox_output_adapter_file_write(GvoxAdapterContext *ctx, size_t position, size_t size, void const *data) {
     auto &user_state = *static_cast<OutputFileUserState *>(gvox_adapter_get_user_pointer(ctx));
-    gvox_output_adapter_file_reserve(ctx, position + size);
-    const auto *bytes = static_cast<uint8_t const *>(data);
-    std::copy(bytes, bytes + size, user_state.bytes.data() + position);
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    write_buffered(ctx, user_state, position, size, static_cast<uint8_t const *>(data));
+}
+
+extern "C" void gvox_output_adapter_file_writev(GvoxAdapterContext *ctx, GvoxIoVec const *iovs, size_t iov_n) {
+    auto &user_state = *static_cast<OutputFileUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    size_t run_begin = 0;
+    while (run_begin < iov_n) {
+        auto run_end = run_begin + 1;
+        auto run_size = iovs[run_begin].size;
+        while (run_end < iov_n && iovs[run_end].position == iovs[run_end - 1].position + iovs[run_end - 1].size) {
+            run_size += iovs[run_end].size;
+            ++run_end;
+        }
+        if (run_size < user_state.buffer.size()) {
+            for (size_t i = run_begin; i < run_end; ++i) {
+                write_buffered(ctx, user_state, iovs[i].position, iovs[i].size, static_cast<uint8_t const *>(iovs[i].data));
+            }
+        } else {
+            prepare_direct_write(ctx, user_state, iovs[run_begin].position, run_size);
+            write_run_to_file(ctx, user_state, iovs[run_begin].position, iovs + run_begin, run_end - run_begin);
+        }
+        run_begin = run_end;
+    }
+}
+
+extern "C" auto gvox_output_adapter_file_map(GvoxAdapterContext * /*unused*/, size_t /*unused*/, size_t /*unused*/) -> void * {
+    // Writes go through the write-back buffer, the mmap adapter can do this
+    return nullptr;
 }
@@ -0,0 +1,146 @@
+#include <gvox/gvox.h>
+#include <gvox/adapters/output/mmap.h>
+
+#include <cstdlib>
+#include <cstdint>
+
+#include <algorithm>
+#include <filesystem>
+#include <new>
+
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+#include <mutex>
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct MmapOutputUserState {
+    std::filesystem::path path{};
+    int fd{-1};
+    uint8_t *mapping{};
+    size_t mapped_size{};
+    size_t file_size{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    std::mutex mtx{};
+#endif
+};
+
+static void unmap(MmapOutputUserState &user_state) {
+    if (user_state.mapping != nullptr) {
+        munmap(user_state.mapping, user_state.mapped_size);
+        user_state.mapping = nullptr;
+        user_state.mapped_size = 0;
+    }
+}
+
+// Base
+extern "C" void gvox_output_adapter_mmap_create(GvoxAdapterContext *ctx, void const *config) {
+    auto *user_state_ptr = malloc(sizeof(MmapOutputUserState));
+    auto &user_state = *(new (user_state_ptr) MmapOutputUserState());
+    gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    if (config != nullptr) {
+        const auto *user_config = static_cast<GvoxMmapOutputAdapterConfig const *>(config);
+        user_state.path = user_config->filepath;
+    } else {
+        user_state.path = "gvox_file_out.bin";
+    }
+}
+
+extern "C" void gvox_output_adapter_mmap_destroy(GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<MmapOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    unmap(user_state);
+    if (user_state.fd != -1) {
+        close(user_state.fd);
+    }
+    user_state.~MmapOutputUserState();
+    free(&user_state);
+}
+
+extern "C" void gvox_output_adapter_mmap_blit_begin(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {
+    auto &user_state = *static_cast<MmapOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    // Needs read access too, in order to map the file
+    user_state.fd = open(user_state.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (user_state.fd == -1) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to open the output file");
+    }
+    user_state.file_size = 0;
+}
+
+extern "C" void gvox_output_adapter_mmap_blit_end(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<MmapOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    unmap(user_state);
+    if (user_state.fd != -1) {
+        close(user_state.fd);
+        user_state.fd = -1;
+    }
+}
+
+// General
+extern "C" void gvox_output_adapter_mmap_reserve(GvoxAdapterContext *ctx, size_t size) {
+    auto &user_state = *static_cast<MmapOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    if (user_state.fd == -1 || size <= user_state.mapped_size) {
+        return;
+    }
+    if (size > user_state.file_size) {
+        if (ftruncate(user_state.fd, static_cast<off_t>(size)) != 0) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to resize the output file");
+            return;
+        }
+        user_state.file_size = size;
+    }
+    unmap(user_state);
+    auto *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, user_state.fd, 0);
+    if (mapping == MAP_FAILED) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to map the output file");
+        return;
+    }
+    user_state.mapping = static_cast<uint8_t *>(mapping);
+    user_state.mapped_size = size;
+}
+
+extern "C" void gvox_output_adapter_mmap_write(GvoxAdapterContext *ctx, size_t position, size_t size, void const *data) {
+    auto &user_state = *static_cast<MmapOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    const auto *bytes = static_cast<uint8_t const *>(data);
+    if (position + size <= user_state.mapped_size) {
+        std::copy(bytes, bytes + size, user_state.mapping + position);
+        return;
+    }
+    // Past the reserved size, so this grows the file (the page cache keeps it coherent with the mapping)
+    while (size > 0 && user_state.fd != -1) {
+        auto const written = pwrite(user_state.fd, bytes, size, static_cast<off_t>(position));
+        if (written < 0) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to write to the output file");
+            return;
+        }
+        position += static_cast<size_t>(written);
+        size -= static_cast<size_t>(written);
+        bytes += written;
+    }
+    user_state.file_size = std::max(user_state.file_size, position);
+}
+
+extern "C" void gvox_output_adapter_mmap_writev(GvoxAdapterContext *ctx, GvoxIoVec const *iovs, size_t iov_n) {
+    for (size_t i = 0; i < iov_n; ++i) {
+        gvox_output_adapter_mmap_write(ctx, iovs[i].position, iovs[i].size, iovs[i].data);
+    }
+}
+
+extern "C" auto gvox_output_adapter_mmap_map(GvoxAdapterContext *ctx, size_t position, size_t size) -> void * {
+    auto &user_state = *static_cast<MmapOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    // Only what has been reserved is mapped
+    if (position + size > user_state.mapped_size) {
+        return nullptr;
+    }
+    return user_state.mapping + position;
+}
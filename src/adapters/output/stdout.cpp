@@ -1,26 +1,83 @@
 #include <gvox/gvox.h>
 #include <gvox/adapters/output/stdout.h>
 
-#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+
+#include <new>
+
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+#include <mutex>
+#endif
+
+#include "../shared/buffered_fd.hpp"
+
+using namespace gvox_detail::buffered_fd;
+
+struct StdoutOutputUserState {
+    size_t buffer_size{};
+    BufferedFd out{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    std::mutex mtx{};
+#endif
+};
 
 // Base
-extern "C" void gvox_output_adapter_stdout_create(GvoxAdapterContext * /*unused*/, void const * /*unused*/) {
+extern "C" void gvox_output_adapter_stdout_create(GvoxAdapterContext *ctx, void const *config) {
+    auto *user_state_ptr = malloc(sizeof(StdoutOutputUserState));
+    auto &user_state = *(new (user_state_ptr) StdoutOutputUserState());
+    gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    if (config != nullptr) {
+        user_state.buffer_size = static_cast<GvoxStdoutOutputAdapterConfig const *>(config)->buffer_size;
+    }
 }
 
-extern "C" void gvox_output_adapter_stdout_destroy(GvoxAdapterContext * /*unused*/) {
+extern "C" void gvox_output_adapter_stdout_destroy(GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<StdoutOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    user_state.~StdoutOutputUserState();
+    free(&user_state);
 }
 
-extern "C" void gvox_output_adapter_stdout_blit_begin(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {
+extern "C" void gvox_output_adapter_stdout_blit_begin(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {
+    auto &user_state = *static_cast<StdoutOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    // Whatever the program already printed through stdio has to come first
+    fflush(stdout);
+#if defined(_WIN32)
+    user_state.out.start(_fileno(stdout), user_state.buffer_size);
+#else
+    user_state.out.start(fileno(stdout), user_state.buffer_size);
+#endif
 }
 
-extern "C" void gvox_output_adapter_stdout_blit_end(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/) {
+extern "C" void gvox_output_adapter_stdout_blit_end(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<StdoutOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (!user_state.out.flush()) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to write to stdout");
+    }
+    user_state.out.buffer = {};
 }
 
 // General
-extern "C" void gvox_output_adapter_stdout_write(GvoxAdapterContext * /*unused*/, size_t /*unused*/, size_t size, void const *data) {
-    auto str = std::string_view{static_cast<char const *>(data), size};
-    std::cout << str;
+extern "C" void gvox_output_adapter_stdout_write(GvoxAdapterContext *ctx, size_t /*unused*/, size_t size, void const *data) {
+    auto &user_state = *static_cast<StdoutOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    if (!user_state.out.write(data, size)) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to write to stdout");
+    }
 }
 
 extern "C" void gvox_output_adapter_stdout_reserve(GvoxAdapterContext * /*unused*/, size_t /*unused*/) {
 }
+
+extern "C" void gvox_output_adapter_stdout_writev(GvoxAdapterContext *ctx, GvoxIoVec const *iovs, size_t iov_n) {
+    for (size_t i = 0; i < iov_n; ++i) {
+        gvox_output_adapter_stdout_write(ctx, iovs[i].position, iovs[i].size, iovs[i].data);
+    }
+}
+
+extern "C" auto gvox_output_adapter_stdout_map(GvoxAdapterContext * /*unused*/, size_t /*unused*/, size_t /*unused*/) -> void * {
+    // A stream can't be mapped
+    return nullptr;
+}
@@ -0,0 +1,245 @@
+#include <gvox/gvox.h>
+#include <gvox/adapters/output/zstd.h>
+
+#include <cstdlib>
+#include <cstdint>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <new>
+
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+#include <mutex>
+#endif
+
+#include <zstd.h>
+
+#include "../shared/thread_pool.hpp"
+
+using namespace gvox_detail::thread_pool;
+
+// See the zstd seekable format specification (contrib/seekable_format)
+static constexpr auto ZSTD_SEEKABLE_SKIPPABLE_MAGIC = uint32_t{0x184D2A5E};
+static constexpr auto ZSTD_SEEKABLE_MAGIC = uint32_t{0x8F92EAB1};
+static constexpr auto ZSTD_SEEKABLE_MAX_FRAME_SIZE = size_t{0x40000000};
+static constexpr auto DEFAULT_FRAME_SIZE = size_t{256} * 1024;
+
+enum struct ZstdFrameState {
+    RAW,
+    QUEUED,
+    COMPRESSED,
+};
+
+struct ZstdOutputFrame {
+    ZstdFrameState state = ZstdFrameState::RAW;
+    bool compress_failed{};
+    // Only valid while RAW
+    std::vector<uint8_t> data{};
+    // Only valid once COMPRESSED
+    std::vector<uint8_t> compressed{};
+    size_t decompressed_size{};
+};
+
+struct ZstdOutputUserState {
+    GvoxAdapterContext *output_ctx{};
+    size_t frame_size{};
+    int compression_level{};
+    // A deque, so that frames being compressed on the pool stay put when more are added
+    std::deque<ZstdOutputFrame> frames{};
+    size_t size{};
+    size_t reserved_size{};
+    ThreadPool thread_pool{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    std::mutex mtx{};
+#endif
+};
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 0));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 24));
+}
+
+static void enqueue_compression(ZstdOutputUserState &user_state, ZstdOutputFrame &frame) {
+    frame.state = ZstdFrameState::QUEUED;
+    user_state.thread_pool.enqueue([&frame, compression_level = user_state.compression_level]() {
+        // Frames are kept until blit_end, so they only hold what they
+        // compressed to, rather than the compress bound
+        thread_local auto scratch = std::vector<uint8_t>{};
+        scratch.resize(ZSTD_compressBound(frame.data.size()));
+        auto const ret = ZSTD_compress(scratch.data(), scratch.size(), frame.data.data(), frame.data.size(), compression_level);
+        frame.compress_failed = ZSTD_isError(ret) != 0u;
+        if (!frame.compress_failed) {
+            frame.compressed.assign(scratch.data(), scratch.data() + ret);
+        }
+        frame.decompressed_size = frame.data.size();
+        frame.data = {};
+    });
+}
+
+// Makes the frame's data writable again, which means undoing its compression
+static auto make_raw(ZstdOutputUserState &user_state, ZstdOutputFrame &frame) -> bool {
+    if (frame.state == ZstdFrameState::QUEUED) {
+        user_state.thread_pool.wait();
+        frame.state = ZstdFrameState::COMPRESSED;
+    }
+    if (frame.state == ZstdFrameState::COMPRESSED) {
+        frame.data.resize(frame.decompressed_size);
+        auto const ret = ZSTD_decompress(frame.data.data(), frame.data.size(), frame.compressed.data(), frame.compressed.size());
+        if (frame.compress_failed || ZSTD_isError(ret) != 0u || ret != frame.decompressed_size) {
+            return false;
+        }
+        frame.compressed = {};
+        frame.state = ZstdFrameState::RAW;
+    }
+    return true;
+}
+
+// Base
+extern "C" void gvox_output_adapter_zstd_create(GvoxAdapterContext *ctx, void const *config) {
+    auto *user_state_ptr = malloc(sizeof(ZstdOutputUserState));
+    auto &user_state = *(new (user_state_ptr) ZstdOutputUserState());
+    gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    if (config == nullptr || static_cast<GvoxZstdOutputAdapterConfig const *>(config)->output_ctx == nullptr) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INVALID_PARAMETER, "The zstd output adapter requires an output adapter context to write to");
+        return;
+    }
+    const auto &user_config = *static_cast<GvoxZstdOutputAdapterConfig const *>(config);
+    user_state.output_ctx = user_config.output_ctx;
+    // The seek table stores frame sizes in 32 bits
+    user_state.frame_size = std::min(user_config.frame_size != 0 ? user_config.frame_size : DEFAULT_FRAME_SIZE, ZSTD_SEEKABLE_MAX_FRAME_SIZE);
+    user_state.compression_level = user_config.compression_level;
+}
+
+extern "C" void gvox_output_adapter_zstd_destroy(GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<ZstdOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    // blit_end never ran if the blit failed, and it's what normally stops the pool
+    user_state.thread_pool.stop();
+    user_state.~ZstdOutputUserState();
+    free(&user_state);
+}
+
+extern "C" void gvox_output_adapter_zstd_blit_begin(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) {
+    auto &user_state = *static_cast<ZstdOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (user_state.output_ctx == nullptr) {
+        return;
+    }
+    gvox_adapter_blit_begin(blit_ctx, user_state.output_ctx, range, channel_flags);
+    user_state.frames.clear();
+    user_state.size = 0;
+    user_state.reserved_size = 0;
+    user_state.thread_pool.start();
+}
+
+extern "C" void gvox_output_adapter_zstd_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<ZstdOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (user_state.output_ctx == nullptr) {
+        return;
+    }
+    // Compress whatever is left, including the trailing partial frame, and
+    // any frames that were skipped over or only reserved (as zeros)
+    auto const total_size = std::max(user_state.size, user_state.reserved_size);
+    auto const frame_n = (total_size + user_state.frame_size - 1) / user_state.frame_size;
+    user_state.frames.resize(frame_n);
+    user_state.thread_pool.wait();
+    for (size_t i = 0; i < frame_n; ++i) {
+        auto &frame = user_state.frames[i];
+        if (frame.state == ZstdFrameState::QUEUED) {
+            frame.state = ZstdFrameState::COMPRESSED;
+        } else if (frame.state == ZstdFrameState::RAW) {
+            frame.data.resize(std::min(user_state.frame_size, total_size - i * user_state.frame_size));
+            enqueue_compression(user_state, frame);
+        }
+    }
+    user_state.thread_pool.wait();
+    user_state.thread_pool.stop();
+
+    auto iovs = std::vector<GvoxIoVec>{};
+    iovs.reserve(frame_n + 1);
+    auto seek_table = std::vector<uint8_t>{};
+    seek_table.reserve(8 + frame_n * 8 + 9);
+    put_u32(seek_table, ZSTD_SEEKABLE_SKIPPABLE_MAGIC);
+    put_u32(seek_table, static_cast<uint32_t>(frame_n * 8 + 9));
+    auto position = size_t{0};
+    for (auto &frame : user_state.frames) {
+        frame.state = ZstdFrameState::COMPRESSED;
+        if (frame.compress_failed) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to compress a frame of the zstd output stream");
+            user_state.frames.clear();
+            gvox_adapter_blit_end(blit_ctx, user_state.output_ctx);
+            return;
+        }
+        iovs.push_back({.position = position, .size = frame.compressed.size(), .data = frame.compressed.data()});
+        position += frame.compressed.size();
+        put_u32(seek_table, static_cast<uint32_t>(frame.compressed.size()));
+        put_u32(seek_table, static_cast<uint32_t>(frame.decompressed_size));
+    }
+    put_u32(seek_table, static_cast<uint32_t>(frame_n));
+    // Seek table descriptor, without checksums
+    seek_table.push_back(0);
+    put_u32(seek_table, ZSTD_SEEKABLE_MAGIC);
+    iovs.push_back({.position = position, .size = seek_table.size(), .data = seek_table.data()});
+    gvox_adapter_output_reserve(user_state.output_ctx, position + seek_table.size());
+    gvox_adapter_output_writev(user_state.output_ctx, iovs.data(), iovs.size());
+    user_state.frames.clear();
+    gvox_adapter_blit_end(blit_ctx, user_state.output_ctx);
+}
+
+// General
+extern "C" void gvox_output_adapter_zstd_write(GvoxAdapterContext *ctx, size_t position, size_t size, void const *data) {
+    auto &user_state = *static_cast<ZstdOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    if (user_state.output_ctx == nullptr || size == 0) {
+        return;
+    }
+    const auto *bytes = static_cast<uint8_t const *>(data);
+    auto const last_frame_index = (position + size - 1) / user_state.frame_size;
+    if (last_frame_index >= user_state.frames.size()) {
+        user_state.frames.resize(last_frame_index + 1);
+    }
+    user_state.size = std::max(user_state.size, position + size);
+    while (size > 0) {
+        auto &frame = user_state.frames[position / user_state.frame_size];
+        auto const frame_offset = position % user_state.frame_size;
+        auto const copy_size = std::min(size, user_state.frame_size - frame_offset);
+        if (!make_raw(user_state, frame)) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_OUTPUT_ADAPTER, "Failed to decompress a frame of the zstd output stream to patch it");
+            return;
+        }
+        if (frame.data.size() < frame_offset + copy_size) {
+            frame.data.resize(frame_offset + copy_size);
+        }
+        std::copy(bytes, bytes + copy_size, frame.data.data() + frame_offset);
+        // Once a frame is filled, it's most likely done with, so compress it right away
+        if (frame.data.size() == user_state.frame_size) {
+            enqueue_compression(user_state, frame);
+        }
+        position += copy_size;
+        bytes += copy_size;
+        size -= copy_size;
+    }
+}
+
+extern "C" void gvox_output_adapter_zstd_reserve(GvoxAdapterContext *ctx, size_t size) {
+    auto &user_state = *static_cast<ZstdOutputUserState *>(gvox_adapter_get_user_pointer(ctx));
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+    // The compressed size isn't known until blit end, so this isn't forwarded
+    user_state.reserved_size = std::max(user_state.reserved_size, size);
+}
+
+extern "C" void gvox_output_adapter_zstd_writev(GvoxAdapterContext *ctx, GvoxIoVec const *iovs, size_t iov_n) {
+    for (size_t i = 0; i < iov_n; ++i) {
+        gvox_output_adapter_zstd_write(ctx, iovs[i].position, iovs[i].size, iovs[i].data);
+    }
+}
+
+extern "C" auto gvox_output_adapter_zstd_map(GvoxAdapterContext * /*unused*/, size_t /*unused*/, size_t /*unused*/) -> void * {
+    // Frames get compressed as soon as they're filled, so there's nothing stable to point into
+    return nullptr;
+}
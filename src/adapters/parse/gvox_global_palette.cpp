@@ -7,23 +7,114 @@
 #include <bit>
 #include <array>
 #include <vector>
+#include <algorithm>
 #include <new>
 
-#include "../shared/math_helpers.hpp"
+#include "../shared/gvox_global_palette.hpp"
+#include "../shared/gvox_global_palette_decode.hpp"
+#include "../shared/thread_pool.hpp"
+
+using namespace gvox_detail::thread_pool;
+
+// Regions emitted in a parse-driven blit are slabs of whole z-slices, with
+// about this many voxels each
+static constexpr auto EMIT_SLAB_VOXEL_N = size_t{1} << 18;
 
 struct Volume {
     std::vector<uint32_t> palette{};
     std::vector<uint32_t> voxels{};
+    // The element offset of each brick, in bricked files
+    std::vector<uint32_t> brick_offsets{};
+    GlobalPaletteDecodeParams decode_params{};
 };
 
 struct GlobalPaletteParseUserState {
     GvoxRegionRange range{};
     uint32_t channel_flags{};
     uint32_t channel_n{};
+    // 0 for linear files
+    uint32_t brick_size{};
+    uint32_t brick_shift{};
+    GlobalPaletteBrickLayout brick_layout{};
+    // Indexed by channel id
+    std::array<uint32_t, 32> channel_indices{};
     size_t offset{};
     std::vector<Volume> channel_volumes{};
+    ThreadPool thread_pool{};
 };
 
+static auto is_in_range(GvoxRegionRange const &range, GvoxOffset3D const &offset) -> bool {
+    return offset.x >= range.offset.x && offset.y >= range.offset.y && offset.z >= range.offset.z &&
+           offset.x < range.offset.x + static_cast<int32_t>(range.extent.x) &&
+           offset.y < range.offset.y + static_cast<int32_t>(range.extent.y) &&
+           offset.z < range.offset.z + static_cast<int32_t>(range.extent.z);
+}
+
+// Decodes the voxels [x0, x1) of the row at (y, z), relative to the file's range
+static void decode_row(GlobalPaletteParseUserState const &user_state, Volume const &volume, int64_t x0, int64_t x1, int64_t y, int64_t z, uint32_t *dst) {
+    auto const &extent = user_state.range.extent;
+    if (user_state.brick_size == 0) {
+        auto const first_voxel = static_cast<uint32_t>(x0 + y * extent.x + z * int64_t{extent.x} * extent.y);
+        decode_global_palette_row(volume.decode_params, volume.voxels.data(), volume.palette.data(), dst, first_voxel, static_cast<uint32_t>(x1 - x0));
+        return;
+    }
+    // Each brick the row passes through is decoded on its own
+    auto const brick_size = int64_t{user_state.brick_size};
+    auto const byi = static_cast<uint32_t>(y >> user_state.brick_shift);
+    auto const bzi = static_cast<uint32_t>(z >> user_state.brick_shift);
+    auto const ly = static_cast<uint32_t>(y - byi * brick_size);
+    auto const lz = static_cast<uint32_t>(z - bzi * brick_size);
+    auto const &layout = user_state.brick_layout;
+    for (auto bxi = static_cast<uint32_t>(x0 >> user_state.brick_shift); bxi * brick_size < x1; ++bxi) {
+        auto const sx0 = std::max(x0, bxi * brick_size);
+        auto const sx1 = std::min(x1, (bxi + 1) * brick_size);
+        auto const brick_extent = layout.brick_extent(extent, bxi, byi, bzi);
+        auto const brick_index = bxi + byi * size_t{layout.brick_nx} + bzi * size_t{layout.brick_nx} * layout.brick_ny;
+        auto const first_voxel = static_cast<uint32_t>(sx0 - bxi * brick_size) + ly * brick_extent.x + lz * brick_extent.x * brick_extent.y;
+        auto const *packed = volume.voxels.data() + volume.brick_offsets[brick_index];
+        decode_global_palette_row(volume.decode_params, packed, volume.palette.data(), dst + (sx0 - x0), first_voxel, static_cast<uint32_t>(sx1 - sx0));
+    }
+}
+
+// Decodes `range` one row at a time, into one dense array per channel (in
+// channel id order). Voxels outside the file's range are left as 0.
+static auto load_dense_range(GlobalPaletteParseUserState const &user_state, GvoxRegionRange const &range, uint32_t channel_flags) -> uint32_t * {
+    auto const voxel_n = static_cast<size_t>(range.extent.x) * range.extent.y * range.extent.z;
+    auto *result = static_cast<uint32_t *>(calloc(voxel_n * static_cast<size_t>(std::popcount(channel_flags)), sizeof(uint32_t)));
+    if (result == nullptr) {
+        return nullptr;
+    }
+    // The part of the range within the file, relative to the file's range
+    auto const rel_x = int64_t{range.offset.x} - user_state.range.offset.x;
+    auto const rel_y = int64_t{range.offset.y} - user_state.range.offset.y;
+    auto const rel_z = int64_t{range.offset.z} - user_state.range.offset.z;
+    auto const x0 = std::max(rel_x, int64_t{0});
+    auto const y0 = std::max(rel_y, int64_t{0});
+    auto const z0 = std::max(rel_z, int64_t{0});
+    auto const x1 = std::min(rel_x + range.extent.x, int64_t{user_state.range.extent.x});
+    auto const y1 = std::min(rel_y + range.extent.y, int64_t{user_state.range.extent.y});
+    auto const z1 = std::min(rel_z + range.extent.z, int64_t{user_state.range.extent.z});
+    if (x0 >= x1) {
+        return result;
+    }
+    auto out_channel_i = size_t{0};
+    for (uint32_t channel_id = 0; channel_id < 32; ++channel_id) {
+        if ((channel_flags & (1u << channel_id)) == 0) {
+            continue;
+        }
+        auto const &volume = user_state.channel_volumes[user_state.channel_indices[channel_id]];
+        auto *out_voxels = result + voxel_n * out_channel_i;
+        ++out_channel_i;
+        for (auto z = z0; z < z1; ++z) {
+            for (auto y = y0; y < y1; ++y) {
+                auto *dst = out_voxels + static_cast<size_t>((x0 - rel_x) + (y - rel_y) * range.extent.x + (z - rel_z) * range.extent.x * range.extent.y);
+                decode_row(user_state, volume, x0, x1, y, z, dst);
+            }
+        }
+    }
+    return result;
+}
+
 // Base
 extern "C" void gvox_parse_adapter_gvox_global_palette_create(GvoxAdapterContext *ctx, void const * /*unused*/) {
     auto *user_state_ptr = malloc(sizeof(GlobalPaletteParseUserState));
@@ -44,7 +135,7 @@ extern "C" void gvox_parse_adapter_gvox_global_palette_blit_begin(GvoxBlitContex
     gvox_input_read(blit_ctx, user_state.offset, sizeof(magic), &magic);
     user_state.offset += sizeof(magic);
 
-    if (magic != std::bit_cast<uint64_t>(std::array<char, 8>{'g', 'v', 'g', 'l', 'b', 'p', 'a', 'l'})) {
+    if (magic != GLOBAL_PALETTE_MAGIC && magic != GLOBAL_PALETTE_BRICKED_MAGIC) {
         gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "parsing a global palette must begin with a valid magic number");
         return;
     }
@@ -55,8 +146,27 @@ extern "C" void gvox_parse_adapter_gvox_global_palette_blit_begin(GvoxBlitContex
     gvox_input_read(blit_ctx, user_state.offset, sizeof(uint32_t), &user_state.channel_flags);
     user_state.offset += sizeof(uint32_t);
 
+    user_state.brick_size = 0;
+    if (magic == GLOBAL_PALETTE_BRICKED_MAGIC) {
+        gvox_input_read(blit_ctx, user_state.offset, sizeof(uint32_t), &user_state.brick_size);
+        user_state.offset += sizeof(uint32_t);
+        if (!is_valid_global_palette_brick_size(user_state.brick_size)) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "global palette brick size must be a power of two, no larger than 32");
+            return;
+        }
+        user_state.brick_shift = static_cast<uint32_t>(std::countr_zero(user_state.brick_size));
+        user_state.brick_layout = make_global_palette_brick_layout(user_state.range.extent, user_state.brick_size);
+    }
+
     user_state.channel_n = static_cast<uint32_t>(std::popcount(user_state.channel_flags));
     user_state.channel_volumes.resize(user_state.channel_n);
+    uint32_t next_channel = 0;
+    for (uint32_t channel_id = 0; channel_id < 32; ++channel_id) {
+        if ((user_state.channel_flags & (1u << channel_id)) != 0) {
+            user_state.channel_indices[channel_id] = next_channel;
+            ++next_channel;
+        }
+    }
 
     auto voxel_n = user_state.range.extent.x * user_state.range.extent.y * user_state.range.extent.z;
     for (uint32_t ci = 0; ci < user_state.channel_n; ++ci) {
@@ -67,16 +177,38 @@ extern "C" void gvox_parse_adapter_gvox_global_palette_blit_begin(GvoxBlitContex
         palette.resize(palette_size);
     }
     for (uint32_t ci = 0; ci < user_state.channel_n; ++ci) {
-        auto &palette = user_state.channel_volumes[ci].palette;
-        auto &voxels = user_state.channel_volumes[ci].voxels;
-        auto palette_size = static_cast<uint32_t>(palette.size());
-        auto bits_per_voxel = ceil_log2(palette_size);
-        auto voxels_per_element = static_cast<uint32_t>(8 * sizeof(voxels[0]) / bits_per_voxel);
-        voxels.resize((voxel_n + voxels_per_element - 1) / voxels_per_element);
+        auto &volume = user_state.channel_volumes[ci];
+        auto &palette = volume.palette;
+        auto &voxels = volume.voxels;
+        auto &brick_offsets = volume.brick_offsets;
+        volume.decode_params = make_global_palette_decode_params(static_cast<uint32_t>(palette.size()));
+        if (user_state.brick_size != 0) {
+            brick_offsets.resize(user_state.brick_layout.brick_n());
+        }
+        if (volume.decode_params.bits_per_voxel != 0) {
+            auto const voxels_per_element = volume.decode_params.voxels_per_element;
+            if (user_state.brick_size != 0) {
+                voxels.resize(calc_global_palette_brick_offsets(user_state.brick_layout, user_state.range.extent, voxels_per_element, brick_offsets.data()));
+            } else {
+                voxels.resize((voxel_n + voxels_per_element - 1) / voxels_per_element);
+            }
+        }
 
         gvox_input_read(blit_ctx, user_state.offset, palette.size() * sizeof(palette[0]), palette.data());
         user_state.offset += palette.size() * sizeof(palette[0]);
 
+        if (user_state.brick_size != 0) {
+            // The offsets follow from the layout, and are what the packed
+            // data is indexed with, so they're only checked against it
+            auto file_brick_offsets = std::vector<uint32_t>(brick_offsets.size());
+            gvox_input_read(blit_ctx, user_state.offset, file_brick_offsets.size() * sizeof(file_brick_offsets[0]), file_brick_offsets.data());
+            user_state.offset += file_brick_offsets.size() * sizeof(file_brick_offsets[0]);
+            if (file_brick_offsets != brick_offsets) {
+                gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "global palette brick offsets don't match the brick layout");
+                return;
+            }
+        }
+
         gvox_input_read(blit_ctx, user_state.offset, voxels.size() * sizeof(voxels[0]), voxels.data());
         user_state.offset += voxels.size() * sizeof(voxels[0]);
     }
@@ -97,29 +229,47 @@ extern "C" auto gvox_parse_adapter_gvox_global_palette_query_parsable_range(Gvox
     return user_state.range;
 }
 
-extern "C" auto gvox_parse_adapter_gvox_global_palette_sample_region(GvoxBlitContext * /*blit_ctx*/, GvoxAdapterContext *ctx, GvoxRegion const * /*unused*/, GvoxOffset3D const *offset, uint32_t channel_id) -> GvoxSample {
+extern "C" auto gvox_parse_adapter_gvox_global_palette_sample_region(GvoxBlitContext * /*blit_ctx*/, GvoxAdapterContext *ctx, GvoxRegion const *region, GvoxOffset3D const *offset, uint32_t channel_id) -> GvoxSample {
     auto &user_state = *static_cast<GlobalPaletteParseUserState *>(gvox_adapter_get_user_pointer(ctx));
-    uint32_t voxel_data = 0;
-    uint32_t voxel_channel_index = 0;
-    for (uint32_t channel_index = 0; channel_index < channel_id; ++channel_index) {
-        if (((user_state.channel_flags >> channel_index) & 0x1) != 0) {
-            ++voxel_channel_index;
-        }
+    auto const is_present = is_in_range(user_state.range, *offset);
+    if (region != nullptr && (region->flags & GVOX_REGION_FLAG_DENSE) != 0 && (region->channels & (1u << channel_id)) != 0 && is_in_range(region->range, *offset)) {
+        auto const px = static_cast<size_t>(offset->x - region->range.offset.x);
+        auto const py = static_cast<size_t>(offset->y - region->range.offset.y);
+        auto const pz = static_cast<size_t>(offset->z - region->range.offset.z);
+        auto const voxel_n = static_cast<size_t>(region->range.extent.x) * region->range.extent.y * region->range.extent.z;
+        auto const channel_i = static_cast<size_t>(std::popcount(region->channels & ((1u << channel_id) - 1)));
+        auto const *voxels = static_cast<uint32_t const *>(region->data);
+        return {voxels[channel_i * voxel_n + px + py * region->range.extent.x + pz * region->range.extent.x * region->range.extent.y], static_cast<uint8_t>(is_present ? 1 : 0)};
+    }
+    if (!is_present) {
+        return {0u, 0u};
     }
 
-    auto &palette = user_state.channel_volumes[voxel_channel_index].palette;
-    auto &voxels = user_state.channel_volumes[voxel_channel_index].voxels;
+    auto const &volume = user_state.channel_volumes[user_state.channel_indices[channel_id]];
+    auto const &params = volume.decode_params;
+    if (params.bits_per_voxel == 0) {
+        return {volume.palette[0], 1u};
+    }
     auto xi = static_cast<uint32_t>(offset->x - user_state.range.offset.x);
     auto yi = static_cast<uint32_t>(offset->y - user_state.range.offset.y);
     auto zi = static_cast<uint32_t>(offset->z - user_state.range.offset.z);
-    auto bits_per_voxel = ceil_log2(static_cast<uint32_t>(palette.size()));
-    auto voxels_per_element = static_cast<uint32_t>(8 * sizeof(voxels[0]) / bits_per_voxel);
-
-    auto voxel_i = xi + yi * user_state.range.extent.x + zi * user_state.range.extent.x * user_state.range.extent.y;
-    auto voxel_mask = (1u << bits_per_voxel) - 1;
-    auto element_i = voxel_i / voxels_per_element;
-    auto element_offset = (voxel_i - element_i * voxels_per_element) * bits_per_voxel;
-    voxel_data = palette[(voxels[voxel_i / voxels_per_element] >> element_offset) & voxel_mask];
+    auto const *packed = volume.voxels.data();
+    auto voxel_i = uint32_t{};
+    if (user_state.brick_size == 0) {
+        voxel_i = xi + yi * user_state.range.extent.x + zi * user_state.range.extent.x * user_state.range.extent.y;
+    } else {
+        auto const &layout = user_state.brick_layout;
+        auto const bxi = xi >> user_state.brick_shift;
+        auto const byi = yi >> user_state.brick_shift;
+        auto const bzi = zi >> user_state.brick_shift;
+        auto const brick_extent = layout.brick_extent(user_state.range.extent, bxi, byi, bzi);
+        auto const local_mask = user_state.brick_size - 1;
+        packed += volume.brick_offsets[bxi + byi * size_t{layout.brick_nx} + bzi * size_t{layout.brick_nx} * layout.brick_ny];
+        voxel_i = (xi & local_mask) + (yi & local_mask) * brick_extent.x + (zi & local_mask) * brick_extent.x * brick_extent.y;
+    }
+    auto element_i = global_palette_element_index(params, voxel_i);
+    auto element_offset = (voxel_i - element_i * params.voxels_per_element) * params.bits_per_voxel;
+    auto voxel_data = volume.palette[(packed[element_i] >> element_offset) & params.mask];
 
     return {voxel_data, 1u};
 }
@@ -134,16 +284,27 @@ extern "C" auto gvox_parse_adapter_gvox_global_palette_load_region(GvoxBlitConte
     if ((channel_flags & ~user_state.channel_flags) != 0) {
         gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_REQUESTED_CHANNEL_NOT_PRESENT, "Tried loading a region with a channel that wasn't present in the original data");
     }
-    GvoxRegion const region = {
+    GvoxRegion region = {
         .range = *range,
         .channels = channel_flags & user_state.channel_flags,
         .flags = 0u,
         .data = nullptr,
     };
+    // Single voxel loads are better off just being sampled
+    if (static_cast<size_t>(range->extent.x) * range->extent.y * range->extent.z > 1 && region.channels != 0) {
+        region.data = load_dense_range(user_state, *range, region.channels);
+        if (region.data != nullptr) {
+            region.flags |= GVOX_REGION_FLAG_DENSE;
+        }
+    }
     return region;
 }
 
-extern "C" void gvox_parse_adapter_gvox_global_palette_unload_region(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegion * /*unused*/) {
+extern "C" void gvox_parse_adapter_gvox_global_palette_unload_region(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegion *region) {
+    if ((region->flags & GVOX_REGION_FLAG_DENSE) != 0) {
+        free(const_cast<void *>(region->data));
+        region->data = nullptr;
+    }
 }
 
 // Parse Driven
@@ -152,11 +313,34 @@ extern "C" void gvox_parse_adapter_gvox_global_palette_parse_region(GvoxBlitCont
     if ((channel_flags & ~user_state.channel_flags) != 0) {
         gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_REQUESTED_CHANNEL_NOT_PRESENT, "Tried loading a region with a channel that wasn't present in the original data");
     }
-    GvoxRegion const region = {
-        .range = *range,
-        .channels = channel_flags & user_state.channel_flags,
-        .flags = 0u,
-        .data = nullptr,
-    };
-    gvox_emit_region(blit_ctx, &region);
+    channel_flags &= user_state.channel_flags;
+    if (channel_flags == 0) {
+        return;
+    }
+    // Emit the range as slabs of z-slices, so that they can be decoded (and
+    // serialized) in parallel, without decoding the whole range at once
+    auto const slice_voxel_n = std::max(static_cast<size_t>(range->extent.x) * range->extent.y, size_t{1});
+    auto const slab_depth = static_cast<uint32_t>(std::max(EMIT_SLAB_VOXEL_N / slice_voxel_n, size_t{1}));
+    user_state.thread_pool.start();
+    for (uint32_t slab_z = 0; slab_z < range->extent.z; slab_z += slab_depth) {
+        user_state.thread_pool.enqueue([blit_ctx, &user_state, range, channel_flags, slab_z, slab_depth]() {
+            GvoxRegion region = {
+                .range = GvoxRegionRange{
+                    .offset = {range->offset.x, range->offset.y, range->offset.z + static_cast<int32_t>(slab_z)},
+                    .extent = {range->extent.x, range->extent.y, std::min(slab_depth, range->extent.z - slab_z)},
+                },
+                .channels = channel_flags,
+                .flags = 0u,
+                .data = nullptr,
+            };
+            region.data = load_dense_range(user_state, region.range, channel_flags);
+            if (region.data != nullptr) {
+                region.flags = GVOX_REGION_FLAG_DENSE;
+            }
+            gvox_emit_region(blit_ctx, &region);
+            free(const_cast<void *>(region.data));
+        });
+    }
+    user_state.thread_pool.wait();
+    user_state.thread_pool.stop();
 }
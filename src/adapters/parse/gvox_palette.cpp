@@ -2,36 +2,542 @@
 #include <gvox/adapters/parse/gvox_palette.h>
 
 #include "../shared/gvox_palette.hpp"
+#include "../shared/gvox_palette_decode.hpp"
+#include "../shared/thread_pool.hpp"
+using namespace gvox_detail::thread_pool;
 
 #include <cstdlib>
 #include <cstdint>
 
 #include <bit>
+#include <array>
 #include <vector>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <new>
 
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+#include <mutex>
+#endif
+
+static constexpr auto DEFAULT_REGION_CACHE_SIZE = size_t{4096};
+// Samples come in from many threads at once, so the cache is split up to keep them from contending on one lock
+static constexpr auto REGION_CACHE_SHARD_N = size_t{16};
+
+struct DecodedRegion {
+    std::vector<uint32_t> voxels;
+    std::list<size_t>::iterator lru_iter;
+};
+
+// An LRU of decoded regions, keyed by `RegionHeaderRef::key`
+struct RegionCacheShard {
+    std::unordered_map<size_t, DecodedRegion> regions{};
+    // Most recently used at the front
+    std::list<size_t> lru{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    std::mutex mtx{};
+#endif
+};
+
+// Level 0 of a uniformity pyramid holds one value per cell (a palette
+// region or a super-chunk) if it's uniform, and each level above merges
+// 2x2x2 nodes of the one below. A node is NON_UNIFORM_NODE unless every
+// cell under it holds one value.
+static constexpr auto NON_UNIFORM_NODE = ~uint64_t{0};
+
+struct UniformityLevel {
+    uint32_t nx{};
+    uint32_t ny{};
+    uint32_t nz{};
+    // Indexed by (x + y * nx + z * nx * ny) * channel_n + channel_index
+    std::vector<uint64_t> nodes{};
+};
+
+struct SuperChunk {
+    // Where the region blobs start within the input, and how big they are
+    size_t blob_position{};
+    size_t blob_size{};
+    // The part of the input to prefetch when the super-chunk is touched
+    size_t span_begin{};
+    size_t span_end{};
+    // How many regions it has along each axis
+    GvoxExtent3D region_extent{};
+    // v2 super-chunks without data are uniform, and have no headers to read
+    bool has_headers{};
+    size_t header_position{};
+    // One per channel of each region, and only filled in once loaded
+    std::vector<ChannelHeader> region_headers{};
+    std::vector<UniformityLevel> uniformity_levels{};
+};
+
+// Decodes a non-uniform region's blob into region_size^3 voxels
+using DecodeRegionFn = void (*)(ChannelHeader const &channel_header, uint8_t const *buffer_ptr, uint32_t *out_voxels);
+
 struct GvoxPaletteParseUserState {
     GvoxRegionRange range{};
-    uint32_t blob_size{};
     uint32_t channel_flags{};
     uint32_t channel_n{};
 
+    uint32_t region_size{};
+    size_t region_voxel_n{};
+    size_t max_compressed_variant_n{};
+    DecodeRegionFn decode_region{};
+
     size_t offset{};
     uint32_t r_nx{};
     uint32_t r_ny{};
     uint32_t r_nz{};
 
-    std::vector<ChannelHeader> region_headers{};
-    std::vector<uint8_t> buffer{};
+    uint32_t super_chunk_size{};
+    uint32_t sc_nx{};
+    uint32_t sc_ny{};
+    uint32_t sc_nz{};
+    std::vector<SuperChunk> super_chunks{};
+    std::unique_ptr<std::atomic_bool[]> super_chunks_loaded{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    std::mutex super_chunk_mutex{};
+#endif
+    // Level 0 holds the super-chunks' summaries
+    std::vector<UniformityLevel> uniformity_levels{};
+
+    size_t region_cache_shard_size{};
+    std::array<RegionCacheShard, REGION_CACHE_SHARD_N> region_cache{};
 
     std::array<uint32_t, 32> channel_indices{};
+
+    ThreadPool thread_pool{};
 };
 
+static auto region_blob_size(GvoxPaletteParseUserState const &user_state, ChannelHeader const &channel_header) -> size_t {
+    if (channel_header.variant_n > user_state.max_compressed_variant_n) {
+        return calc_region_allocation_size(user_state.region_size);
+    }
+    return calc_block_size(channel_header.variant_n, user_state.region_size);
+}
+
+// Instantiated for each region size, so that the voxel count and palette size are known at compile time
+template <uint32_t REGION_SIZE>
+static void decode_region(ChannelHeader const &channel_header, uint8_t const *buffer_ptr, uint32_t *out_voxels) {
+    static constexpr auto REGION_VOXEL_N = REGION_SIZE * REGION_SIZE * REGION_SIZE;
+    static constexpr auto MAX_COMPRESSED_VARIANT_N = calc_max_compressed_variant_n(REGION_SIZE);
+    if (channel_header.variant_n > MAX_COMPRESSED_VARIANT_N) {
+        std::copy(buffer_ptr, buffer_ptr + REGION_VOXEL_N * sizeof(uint32_t), reinterpret_cast<uint8_t *>(out_voxels));
+        return;
+    }
+    auto const bits_per_variant = ceil_log2(channel_header.variant_n);
+    // Has room for every index `bits_per_variant` can hold, and is zeroed
+    // past the palette, so that corrupt indices can't read out of bounds.
+    // Only that much is cleared, since it's large for big regions.
+    std::array<uint32_t, size_t{1} << ceil_log2(static_cast<uint32_t>(MAX_COMPRESSED_VARIANT_N))> palette;
+    std::copy(buffer_ptr, buffer_ptr + channel_header.variant_n * sizeof(uint32_t), reinterpret_cast<uint8_t *>(palette.data()));
+    std::fill(palette.begin() + channel_header.variant_n, palette.begin() + (ptrdiff_t{1} << bits_per_variant), 0u);
+    buffer_ptr += channel_header.variant_n * sizeof(uint32_t);
+    decode_palette_indices(buffer_ptr, bits_per_variant, palette.data(), out_voxels, REGION_VOXEL_N);
+}
+
+static auto get_decode_region_fn(uint32_t region_size) -> DecodeRegionFn {
+    switch (region_size) {
+    case 1: return decode_region<1>;
+    case 2: return decode_region<2>;
+    case 4: return decode_region<4>;
+    case 8: return decode_region<8>;
+    case 16: return decode_region<16>;
+    case 32: return decode_region<32>;
+    default: return nullptr;
+    }
+}
+
+static void build_uniformity_pyramid(std::vector<UniformityLevel> &levels, size_t channel_n) {
+    while (true) {
+        auto const &prev = levels.back();
+        if (prev.nx <= 1 && prev.ny <= 1 && prev.nz <= 1) {
+            break;
+        }
+        auto next = UniformityLevel{.nx = (prev.nx + 1) / 2, .ny = (prev.ny + 1) / 2, .nz = (prev.nz + 1) / 2};
+        next.nodes.resize(static_cast<size_t>(next.nx) * next.ny * next.nz * channel_n);
+        for (uint32_t zi = 0; zi < next.nz; ++zi) {
+            for (uint32_t yi = 0; yi < next.ny; ++yi) {
+                for (uint32_t xi = 0; xi < next.nx; ++xi) {
+                    for (size_t ci = 0; ci < channel_n; ++ci) {
+                        auto const first_child = prev.nodes[(xi * 2 + yi * 2 * prev.nx + zi * 2 * size_t{prev.nx} * prev.ny) * channel_n + ci];
+                        auto merged = first_child;
+                        for (uint32_t child_i = 1; child_i < 8 && merged != NON_UNIFORM_NODE; ++child_i) {
+                            auto const cx = xi * 2 + (child_i & 1);
+                            auto const cy = yi * 2 + ((child_i >> 1) & 1);
+                            auto const cz = zi * 2 + ((child_i >> 2) & 1);
+                            if (cx < prev.nx && cy < prev.ny && cz < prev.nz &&
+                                prev.nodes[(cx + cy * prev.nx + cz * size_t{prev.nx} * prev.ny) * channel_n + ci] != first_child) {
+                                merged = NON_UNIFORM_NODE;
+                            }
+                        }
+                        next.nodes[(xi + yi * next.nx + zi * size_t{next.nx} * next.ny) * channel_n + ci] = merged;
+                    }
+                }
+            }
+        }
+        levels.push_back(std::move(next));
+    }
+}
+
+static auto super_chunk_index(GvoxPaletteParseUserState const &user_state, uint32_t xi, uint32_t yi, uint32_t zi) -> size_t {
+    auto const sc_size = user_state.super_chunk_size;
+    return (xi / sc_size) + (yi / sc_size) * size_t{user_state.sc_nx} + (zi / sc_size) * size_t{user_state.sc_nx} * user_state.sc_ny;
+}
+
+static auto super_chunk_local_index(GvoxPaletteParseUserState const &user_state, SuperChunk const &super_chunk, uint32_t xi, uint32_t yi, uint32_t zi) -> size_t {
+    auto const sc_size = user_state.super_chunk_size;
+    return (xi % sc_size) + (yi % sc_size) * size_t{super_chunk.region_extent.x} + (zi % sc_size) * size_t{super_chunk.region_extent.x} * super_chunk.region_extent.y;
+}
+
+static void build_super_chunk_pyramid(GvoxPaletteParseUserState const &user_state, SuperChunk &super_chunk) {
+    super_chunk.uniformity_levels.clear();
+    auto &base_level = super_chunk.uniformity_levels.emplace_back(UniformityLevel{.nx = super_chunk.region_extent.x, .ny = super_chunk.region_extent.y, .nz = super_chunk.region_extent.z});
+    base_level.nodes.reserve(super_chunk.region_headers.size());
+    for (auto const &channel_header : super_chunk.region_headers) {
+        base_level.nodes.push_back(channel_header.variant_n <= 1 ? uint64_t{channel_header.blob_offset} : NON_UNIFORM_NODE);
+    }
+    build_uniformity_pyramid(super_chunk.uniformity_levels, user_state.channel_n);
+}
+
+// Reads the region headers of a super-chunk if they haven't been already
+static auto load_super_chunk(GvoxBlitContext *blit_ctx, GvoxPaletteParseUserState &user_state, size_t sc_index) -> SuperChunk const & {
+    auto &super_chunk = user_state.super_chunks[sc_index];
+    auto &is_loaded = user_state.super_chunks_loaded[sc_index];
+    if (is_loaded.load(std::memory_order_acquire)) {
+        return super_chunk;
+    }
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    auto lock = std::lock_guard{user_state.super_chunk_mutex};
+#endif
+    if (is_loaded.load(std::memory_order_relaxed)) {
+        return super_chunk;
+    }
+    super_chunk.region_headers.resize(static_cast<size_t>(super_chunk.region_extent.x) * super_chunk.region_extent.y * super_chunk.region_extent.z * user_state.channel_n);
+    if (super_chunk.has_headers) {
+        gvox_input_read(blit_ctx, super_chunk.header_position, super_chunk.region_headers.size() * sizeof(ChannelHeader), super_chunk.region_headers.data());
+    } else {
+        // Every channel is uniform, which the summary already says
+        auto const &summaries = user_state.uniformity_levels[0].nodes;
+        for (size_t i = 0; i < super_chunk.region_headers.size(); ++i) {
+            auto const summary = summaries[sc_index * user_state.channel_n + i % user_state.channel_n];
+            super_chunk.region_headers[i] = ChannelHeader{.variant_n = 1u, .blob_offset = static_cast<uint32_t>(summary)};
+        }
+    }
+    build_super_chunk_pyramid(user_state, super_chunk);
+    is_loaded.store(true, std::memory_order_release);
+    return super_chunk;
+}
+
+struct RegionHeaderRef {
+    SuperChunk const *super_chunk;
+    ChannelHeader header;
+    // Uniquely identifies the region's channel, for the cache
+    size_t key;
+};
+
+static auto get_region_header(GvoxBlitContext *blit_ctx, GvoxPaletteParseUserState &user_state, uint32_t xi, uint32_t yi, uint32_t zi, uint32_t channel_index) -> RegionHeaderRef {
+    auto const key = channel_index + (xi + yi * user_state.r_nx + zi * size_t{user_state.r_nx} * user_state.r_ny) * user_state.channel_n;
+    auto const sc_index = super_chunk_index(user_state, xi, yi, zi);
+    // Uniform super-chunks can be answered without reading their headers
+    auto const summary = user_state.uniformity_levels[0].nodes[sc_index * user_state.channel_n + channel_index];
+    if (summary != NON_UNIFORM_NODE) {
+        return {nullptr, ChannelHeader{.variant_n = 1u, .blob_offset = static_cast<uint32_t>(summary)}, key};
+    }
+    auto const &super_chunk = load_super_chunk(blit_ctx, user_state, sc_index);
+    auto const local_index = super_chunk_local_index(user_state, super_chunk, xi, yi, zi);
+    return {&super_chunk, super_chunk.region_headers[local_index * user_state.channel_n + channel_index], key};
+}
+
+// Returns the decoded voxels of a non-uniform region, reading it from the input if it isn't cached.
+// The shard's mutex must be held for as long as the result is used.
+static auto load_decoded_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxPaletteParseUserState &user_state, RegionCacheShard &shard, RegionHeaderRef const &region_header) -> uint32_t const * {
+    auto region_iter = shard.regions.find(region_header.key);
+    if (region_iter != shard.regions.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, region_iter->second.lru_iter);
+        return region_iter->second.voxels.data();
+    }
+    auto const &channel_header = region_header.header;
+    auto const size = region_blob_size(user_state, channel_header);
+    if (static_cast<size_t>(channel_header.blob_offset) + size > region_header.super_chunk->blob_size) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "gvox palette region data extends past the end of the blob");
+        return nullptr;
+    }
+    thread_local auto buffer = std::vector<uint8_t>();
+    buffer.resize(size);
+    gvox_input_read(blit_ctx, region_header.super_chunk->blob_position + channel_header.blob_offset, size, buffer.data());
+    // The evicted region's voxels are reused, rather than reallocated
+    auto voxels = std::vector<uint32_t>{};
+    if (shard.regions.size() >= user_state.region_cache_shard_size) {
+        auto evicted_iter = shard.regions.find(shard.lru.back());
+        voxels = std::move(evicted_iter->second.voxels);
+        shard.regions.erase(evicted_iter);
+        shard.lru.pop_back();
+    }
+    voxels.resize(user_state.region_voxel_n);
+    user_state.decode_region(channel_header, buffer.data(), voxels.data());
+    shard.lru.push_front(region_header.key);
+    auto &decoded = shard.regions[region_header.key];
+    decoded.voxels = std::move(voxels);
+    decoded.lru_iter = shard.lru.begin();
+    return decoded.voxels.data();
+}
+
+// The palette regions (in region coordinates) that overlap a range, clamped to the file's range
+struct RegionBounds {
+    uint32_t ax, ay, az;
+    uint32_t bx, by, bz;
+};
+
+static auto region_bounds(GvoxPaletteParseUserState const &user_state, GvoxRegionRange const &range) -> RegionBounds {
+    auto const to_region = [&user_state](int64_t rel, uint32_t extent, uint32_t round_up) -> uint32_t {
+        auto const clamped = static_cast<uint32_t>(std::clamp<int64_t>(rel, 0, extent));
+        return (clamped + round_up) / user_state.region_size;
+    };
+    auto const region_round_up = user_state.region_size - 1;
+    return {
+        .ax = to_region(int64_t{range.offset.x} - user_state.range.offset.x, user_state.range.extent.x, 0),
+        .ay = to_region(int64_t{range.offset.y} - user_state.range.offset.y, user_state.range.extent.y, 0),
+        .az = to_region(int64_t{range.offset.z} - user_state.range.offset.z, user_state.range.extent.z, 0),
+        .bx = to_region(int64_t{range.offset.x} + range.extent.x - user_state.range.offset.x, user_state.range.extent.x, region_round_up),
+        .by = to_region(int64_t{range.offset.y} + range.extent.y - user_state.range.offset.y, user_state.range.extent.y, region_round_up),
+        .bz = to_region(int64_t{range.offset.z} + range.extent.z - user_state.range.offset.z, user_state.range.extent.z, region_round_up),
+    };
+}
+
+static void prefetch_range(GvoxBlitContext *blit_ctx, GvoxPaletteParseUserState const &user_state, GvoxRegionRange const &range) {
+    auto const bounds = region_bounds(user_state, range);
+    if (bounds.ax >= bounds.bx || bounds.ay >= bounds.by || bounds.az >= bounds.bz) {
+        return;
+    }
+    auto const sc_size = user_state.super_chunk_size;
+    auto span_begin = ~size_t{0};
+    auto span_end = size_t{0};
+    for (uint32_t szi = bounds.az / sc_size; szi <= (bounds.bz - 1) / sc_size; ++szi) {
+        for (uint32_t syi = bounds.ay / sc_size; syi <= (bounds.by - 1) / sc_size; ++syi) {
+            for (uint32_t sxi = bounds.ax / sc_size; sxi <= (bounds.bx - 1) / sc_size; ++sxi) {
+                auto const &super_chunk = user_state.super_chunks[sxi + syi * size_t{user_state.sc_nx} + szi * size_t{user_state.sc_nx} * user_state.sc_ny];
+                if (super_chunk.span_begin < super_chunk.span_end) {
+                    span_begin = std::min(span_begin, super_chunk.span_begin);
+                    span_end = std::max(span_end, super_chunk.span_end);
+                }
+            }
+        }
+    }
+    if (span_begin < span_end) {
+        gvox_input_prefetch(blit_ctx, span_begin, span_end - span_begin);
+    }
+}
+
+// Decodes every requested channel of a range into a dense array (see
+// GVOX_REGION_FLAG_DENSE). Voxels outside the file's range are 0.
+static auto load_dense_range(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxPaletteParseUserState &user_state, GvoxRegionRange const &range, uint32_t channel_flags) -> uint32_t * {
+    auto const voxel_n = static_cast<size_t>(range.extent.x) * range.extent.y * range.extent.z;
+    auto *result = static_cast<uint32_t *>(calloc(voxel_n * static_cast<size_t>(std::popcount(channel_flags)), sizeof(uint32_t)));
+    if (result == nullptr) {
+        return nullptr;
+    }
+    // The range's offset relative to the file's range
+    auto const rel_x = int64_t{range.offset.x} - user_state.range.offset.x;
+    auto const rel_y = int64_t{range.offset.y} - user_state.range.offset.y;
+    auto const rel_z = int64_t{range.offset.z} - user_state.range.offset.z;
+    auto const region_size = int64_t{user_state.region_size};
+    auto const bounds = region_bounds(user_state, range);
+    for (uint32_t zi = bounds.az; zi < bounds.bz; ++zi) {
+        for (uint32_t yi = bounds.ay; yi < bounds.by; ++yi) {
+            for (uint32_t xi = bounds.ax; xi < bounds.bx; ++xi) {
+                // The part of this palette region within the range, relative to the file's range
+                auto const x0 = std::max(int64_t{xi} * region_size, rel_x);
+                auto const y0 = std::max(int64_t{yi} * region_size, rel_y);
+                auto const z0 = std::max(int64_t{zi} * region_size, rel_z);
+                auto const x1 = std::min({int64_t{xi + 1} * region_size, rel_x + range.extent.x, int64_t{user_state.range.extent.x}});
+                auto const y1 = std::min({int64_t{yi + 1} * region_size, rel_y + range.extent.y, int64_t{user_state.range.extent.y}});
+                auto const z1 = std::min({int64_t{zi + 1} * region_size, rel_z + range.extent.z, int64_t{user_state.range.extent.z}});
+                auto out_channel_i = size_t{0};
+                for (uint32_t channel_id = 0; channel_id < 32; ++channel_id) {
+                    if ((channel_flags & (1u << channel_id)) == 0) {
+                        continue;
+                    }
+                    auto *out_voxels = result + voxel_n * out_channel_i;
+                    ++out_channel_i;
+                    auto const region_header = get_region_header(blit_ctx, user_state, xi, yi, zi, user_state.channel_indices[channel_id]);
+                    auto const &channel_header = region_header.header;
+                    auto const copy_rows = [&](uint32_t const *region_voxels) {
+                        for (auto z = z0; z < z1; ++z) {
+                            for (auto y = y0; y < y1; ++y) {
+                                auto *dst = out_voxels + static_cast<size_t>((x0 - rel_x) + (y - rel_y) * range.extent.x + (z - rel_z) * range.extent.x * range.extent.y);
+                                if (region_voxels == nullptr) {
+                                    std::fill(dst, dst + (x1 - x0), channel_header.blob_offset);
+                                } else {
+                                    auto const *src = region_voxels + static_cast<size_t>((x0 - xi * region_size) + (y - yi * region_size) * region_size + (z - zi * region_size) * region_size * region_size);
+                                    std::copy(src, src + (x1 - x0), dst);
+                                }
+                            }
+                        }
+                    };
+                    if (channel_header.variant_n <= 1) {
+                        copy_rows(nullptr);
+                        continue;
+                    }
+                    auto &shard = user_state.region_cache[region_header.key % REGION_CACHE_SHARD_N];
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+                    auto lock = std::lock_guard{shard.mtx};
+#endif
+                    auto const *region_voxels = load_decoded_region(blit_ctx, ctx, user_state, shard, region_header);
+                    if (region_voxels == nullptr) {
+                        free(result);
+                        return nullptr;
+                    }
+                    copy_rows(region_voxels);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// Whether every cell of a pyramid's level 0 within `bounds` holds the same
+// value for the given channel. `value` is set by the first uniform node
+// that's visited. Non-uniform cells that are only partly within the bounds
+// are handed to `on_partial_cell`.
+// Cells are `cell_size` regions wide, and `region_extent` is how many
+// regions the pyramid actually covers.
+static auto is_uniform_within(std::vector<UniformityLevel> const &levels, uint32_t channel_n, uint32_t channel_index, uint32_t cell_size, GvoxExtent3D const &region_extent, RegionBounds const &bounds, uint32_t level_i, uint32_t xi, uint32_t yi, uint32_t zi, uint64_t &value, auto const &on_partial_cell) -> bool {
+    auto const ax = (xi << level_i) * cell_size;
+    auto const ay = (yi << level_i) * cell_size;
+    auto const az = (zi << level_i) * cell_size;
+    auto const bx = std::min(((xi + 1) << level_i) * cell_size, region_extent.x);
+    auto const by = std::min(((yi + 1) << level_i) * cell_size, region_extent.y);
+    auto const bz = std::min(((zi + 1) << level_i) * cell_size, region_extent.z);
+    if (bx <= bounds.ax || by <= bounds.ay || bz <= bounds.az || ax >= bounds.bx || ay >= bounds.by || az >= bounds.bz) {
+        return true;
+    }
+    auto const &level = levels[level_i];
+    auto const node = level.nodes[(xi + yi * level.nx + zi * size_t{level.nx} * level.ny) * channel_n + channel_index];
+    if (node != NON_UNIFORM_NODE) {
+        if (value == NON_UNIFORM_NODE) {
+            value = node;
+        }
+        return node == value;
+    }
+    // A non-uniform node that's entirely within the bounds means the bounds aren't uniform either
+    if (ax >= bounds.ax && ay >= bounds.ay && az >= bounds.az && bx <= bounds.bx && by <= bounds.by && bz <= bounds.bz) {
+        return false;
+    }
+    if (level_i == 0) {
+        return on_partial_cell(xi, yi, zi, value);
+    }
+    auto const &child_level = levels[level_i - 1];
+    for (uint32_t child_i = 0; child_i < 8; ++child_i) {
+        auto const cx = xi * 2 + (child_i & 1);
+        auto const cy = yi * 2 + ((child_i >> 1) & 1);
+        auto const cz = zi * 2 + ((child_i >> 2) & 1);
+        if (cx < child_level.nx && cy < child_level.ny && cz < child_level.nz &&
+            !is_uniform_within(levels, channel_n, channel_index, cell_size, region_extent, bounds, level_i - 1, cx, cy, cz, value, on_partial_cell)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void read_v1_layout(GvoxBlitContext *blit_ctx, GvoxPaletteParseUserState &user_state, uint32_t blob_size) {
+    auto const channel_n = size_t{user_state.channel_n};
+
+    // All of the headers are read up front, and then split into super-chunks
+    // so that the rest of the parser only has one layout to deal with
+    auto region_headers = std::vector<ChannelHeader>(static_cast<size_t>(user_state.r_nx) * user_state.r_ny * user_state.r_nz * channel_n);
+    gvox_input_read(blit_ctx, user_state.offset, region_headers.size() * sizeof(ChannelHeader), region_headers.data());
+    user_state.offset += region_headers.size() * sizeof(ChannelHeader);
+    auto const blob_position = user_state.offset;
+
+    for (auto &super_chunk : user_state.super_chunks) {
+        super_chunk.blob_position = blob_position;
+        super_chunk.blob_size = blob_size;
+        super_chunk.span_begin = blob_position + blob_size;
+        super_chunk.span_end = blob_position;
+        super_chunk.region_headers.resize(static_cast<size_t>(super_chunk.region_extent.x) * super_chunk.region_extent.y * super_chunk.region_extent.z * channel_n);
+    }
+    for (uint32_t zi = 0; zi < user_state.r_nz; ++zi) {
+        for (uint32_t yi = 0; yi < user_state.r_ny; ++yi) {
+            for (uint32_t xi = 0; xi < user_state.r_nx; ++xi) {
+                auto &super_chunk = user_state.super_chunks[super_chunk_index(user_state, xi, yi, zi)];
+                auto const local_index = super_chunk_local_index(user_state, super_chunk, xi, yi, zi);
+                for (size_t ci = 0; ci < channel_n; ++ci) {
+                    auto const &channel_header = region_headers[(xi + yi * user_state.r_nx + zi * size_t{user_state.r_nx} * user_state.r_ny) * channel_n + ci];
+                    super_chunk.region_headers[local_index * channel_n + ci] = channel_header;
+                    if (channel_header.variant_n > 1) {
+                        super_chunk.span_begin = std::min(super_chunk.span_begin, blob_position + channel_header.blob_offset);
+                        super_chunk.span_end = std::max(super_chunk.span_end, std::min(blob_position + channel_header.blob_offset + region_blob_size(user_state, channel_header), blob_position + blob_size));
+                    }
+                }
+            }
+        }
+    }
+
+    auto &summaries = user_state.uniformity_levels[0].nodes;
+    for (size_t sc_index = 0; sc_index < user_state.super_chunks.size(); ++sc_index) {
+        auto &super_chunk = user_state.super_chunks[sc_index];
+        build_super_chunk_pyramid(user_state, super_chunk);
+        auto const &top_level = super_chunk.uniformity_levels.back();
+        std::copy(top_level.nodes.begin(), top_level.nodes.end(), summaries.begin() + static_cast<ptrdiff_t>(sc_index * channel_n));
+        user_state.super_chunks_loaded[sc_index].store(true, std::memory_order_relaxed);
+    }
+}
+
+static auto read_v2_layout(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxPaletteParseUserState &user_state) -> bool {
+    auto const channel_n = size_t{user_state.channel_n};
+
+    auto index = std::vector<SuperChunkIndexEntry>(user_state.super_chunks.size());
+    gvox_input_read(blit_ctx, user_state.offset, index.size() * sizeof(SuperChunkIndexEntry), index.data());
+    user_state.offset += index.size() * sizeof(SuperChunkIndexEntry);
+    auto summaries = std::vector<ChannelHeader>(user_state.super_chunks.size() * channel_n);
+    gvox_input_read(blit_ctx, user_state.offset, summaries.size() * sizeof(ChannelHeader), summaries.data());
+    user_state.offset += summaries.size() * sizeof(ChannelHeader);
+
+    auto &summary_nodes = user_state.uniformity_levels[0].nodes;
+    for (size_t sc_index = 0; sc_index < user_state.super_chunks.size(); ++sc_index) {
+        auto const &entry = index[sc_index];
+        auto &super_chunk = user_state.super_chunks[sc_index];
+        auto const headers_size = static_cast<size_t>(super_chunk.region_extent.x) * super_chunk.region_extent.y * super_chunk.region_extent.z * channel_n * sizeof(ChannelHeader);
+        auto is_uniform = true;
+        for (size_t ci = 0; ci < channel_n; ++ci) {
+            auto const &summary = summaries[sc_index * channel_n + ci];
+            summary_nodes[sc_index * channel_n + ci] = summary.variant_n == 1 ? uint64_t{summary.blob_offset} : NON_UNIFORM_NODE;
+            is_uniform = is_uniform && summary.variant_n == 1;
+        }
+        if (entry.size == 0) {
+            if (!is_uniform) {
+                gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "gvox palette super-chunk has no data, but isn't uniform");
+                return false;
+            }
+            continue;
+        }
+        if (entry.size < headers_size) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "gvox palette super-chunk is too small to hold its region headers");
+            return false;
+        }
+        super_chunk.has_headers = true;
+        super_chunk.header_position = static_cast<size_t>(entry.offset);
+        super_chunk.blob_position = static_cast<size_t>(entry.offset) + headers_size;
+        super_chunk.blob_size = static_cast<size_t>(entry.size) - headers_size;
+        super_chunk.span_begin = static_cast<size_t>(entry.offset);
+        super_chunk.span_end = static_cast<size_t>(entry.offset + entry.size);
+    }
+    return true;
+}
+
 // Base
-extern "C" void gvox_parse_adapter_gvox_palette_create(GvoxAdapterContext *ctx, void const * /*unused*/) {
+extern "C" void gvox_parse_adapter_gvox_palette_create(GvoxAdapterContext *ctx, void const *config) {
     auto *user_state_ptr = malloc(sizeof(GvoxPaletteParseUserState));
-    new (user_state_ptr) GvoxPaletteParseUserState();
+    auto &user_state = *(new (user_state_ptr) GvoxPaletteParseUserState());
     gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    auto region_cache_size = DEFAULT_REGION_CACHE_SIZE;
+    if (config != nullptr && static_cast<GvoxPaletteParseAdapterConfig const *>(config)->region_cache_size != 0) {
+        region_cache_size = static_cast<GvoxPaletteParseAdapterConfig const *>(config)->region_cache_size;
+    }
+    user_state.region_cache_shard_size = std::max((region_cache_size + REGION_CACHE_SHARD_N - 1) / REGION_CACHE_SHARD_N, size_t{1});
 }
 
 extern "C" void gvox_parse_adapter_gvox_palette_destroy(GvoxAdapterContext *ctx) {
@@ -40,14 +546,15 @@ extern "C" void gvox_parse_adapter_gvox_palette_destroy(GvoxAdapterContext *ctx)
     free(&user_state);
 }
 
-extern "C" void gvox_parse_adapter_gvox_palette_blit_begin(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {
+extern "C" void gvox_parse_adapter_gvox_palette_blit_begin(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t /*unused*/) {
     auto &user_state = *static_cast<GvoxPaletteParseUserState *>(gvox_adapter_get_user_pointer(ctx));
+    user_state.offset = 0;
 
     uint32_t magic = 0;
     gvox_input_read(blit_ctx, user_state.offset, sizeof(uint32_t), &magic);
     user_state.offset += sizeof(uint32_t);
 
-    if (magic != std::bit_cast<uint32_t>(std::array<char, 4>{'g', 'v', 'p', '\0'})) {
+    if (magic != PALETTE_MAGIC_V1 && magic != PALETTE_MAGIC_V2) {
         gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "parsing a gvox palette format must begin with a valid magic number");
         return;
     }
@@ -55,8 +562,11 @@ extern "C" void gvox_parse_adapter_gvox_palette_blit_begin(GvoxBlitContext *blit
     gvox_input_read(blit_ctx, user_state.offset, sizeof(GvoxRegionRange), &user_state.range);
     user_state.offset += sizeof(GvoxRegionRange);
 
-    gvox_input_read(blit_ctx, user_state.offset, sizeof(uint32_t), &user_state.blob_size);
-    user_state.offset += sizeof(uint32_t);
+    uint32_t v1_blob_size = 0;
+    if (magic == PALETTE_MAGIC_V1) {
+        gvox_input_read(blit_ctx, user_state.offset, sizeof(uint32_t), &v1_blob_size);
+        user_state.offset += sizeof(uint32_t);
+    }
 
     gvox_input_read(blit_ctx, user_state.offset, sizeof(uint32_t), &user_state.channel_flags);
     user_state.offset += sizeof(uint32_t);
@@ -64,6 +574,36 @@ extern "C" void gvox_parse_adapter_gvox_palette_blit_begin(GvoxBlitContext *blit
     gvox_input_read(blit_ctx, user_state.offset, sizeof(uint32_t), &user_state.channel_n);
     user_state.offset += sizeof(uint32_t);
 
+    if (user_state.channel_n != static_cast<uint32_t>(std::popcount(user_state.channel_flags))) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "gvox palette channel count doesn't match its channel flags");
+        return;
+    }
+
+    if (magic == PALETTE_MAGIC_V2) {
+        gvox_input_read(blit_ctx, user_state.offset, sizeof(uint32_t), &user_state.region_size);
+        user_state.offset += sizeof(uint32_t);
+        if (!is_valid_region_size(user_state.region_size)) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "gvox palette region size must be a power of two, no larger than 32");
+            return;
+        }
+        gvox_input_read(blit_ctx, user_state.offset, sizeof(uint32_t), &user_state.super_chunk_size);
+        user_state.offset += sizeof(uint32_t);
+        if (user_state.super_chunk_size == 0 || user_state.super_chunk_size > MAX_SUPER_CHUNK_EXTENT / user_state.region_size) {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "gvox palette super-chunk size is out of range");
+            return;
+        }
+    } else {
+        user_state.region_size = DEFAULT_REGION_SIZE;
+        user_state.super_chunk_size = calc_super_chunk_size(DEFAULT_REGION_SIZE);
+    }
+    user_state.region_voxel_n = size_t{user_state.region_size} * user_state.region_size * user_state.region_size;
+    user_state.max_compressed_variant_n = calc_max_compressed_variant_n(user_state.region_size);
+    user_state.decode_region = get_decode_region_fn(user_state.region_size);
+
+    user_state.r_nx = (user_state.range.extent.x + user_state.region_size - 1) / user_state.region_size;
+    user_state.r_ny = (user_state.range.extent.y + user_state.region_size - 1) / user_state.region_size;
+    user_state.r_nz = (user_state.range.extent.z + user_state.region_size - 1) / user_state.region_size;
+
     uint32_t next_channel = 0;
     for (uint8_t channel_i = 0; channel_i < 32; ++channel_i) {
         if ((user_state.channel_flags & (1u << channel_i)) != 0) {
@@ -72,21 +612,58 @@ extern "C" void gvox_parse_adapter_gvox_palette_blit_begin(GvoxBlitContext *blit
         }
     }
 
-    user_state.r_nx = (user_state.range.extent.x + REGION_SIZE - 1) / REGION_SIZE;
-    user_state.r_ny = (user_state.range.extent.y + REGION_SIZE - 1) / REGION_SIZE;
-    user_state.r_nz = (user_state.range.extent.z + REGION_SIZE - 1) / REGION_SIZE;
+    user_state.sc_nx = (user_state.r_nx + user_state.super_chunk_size - 1) / user_state.super_chunk_size;
+    user_state.sc_ny = (user_state.r_ny + user_state.super_chunk_size - 1) / user_state.super_chunk_size;
+    user_state.sc_nz = (user_state.r_nz + user_state.super_chunk_size - 1) / user_state.super_chunk_size;
+    auto const super_chunk_n = static_cast<size_t>(user_state.sc_nx) * user_state.sc_ny * user_state.sc_nz;
+    user_state.super_chunks.clear();
+    user_state.super_chunks.resize(super_chunk_n);
+    for (size_t sc_index = 0; sc_index < super_chunk_n; ++sc_index) {
+        auto const sxi = static_cast<uint32_t>(sc_index % user_state.sc_nx);
+        auto const syi = static_cast<uint32_t>((sc_index / user_state.sc_nx) % user_state.sc_ny);
+        auto const szi = static_cast<uint32_t>(sc_index / (size_t{user_state.sc_nx} * user_state.sc_ny));
+        user_state.super_chunks[sc_index].region_extent = GvoxExtent3D{
+            std::min(user_state.super_chunk_size, user_state.r_nx - sxi * user_state.super_chunk_size),
+            std::min(user_state.super_chunk_size, user_state.r_ny - syi * user_state.super_chunk_size),
+            std::min(user_state.super_chunk_size, user_state.r_nz - szi * user_state.super_chunk_size),
+        };
+    }
+    user_state.super_chunks_loaded = std::make_unique<std::atomic_bool[]>(super_chunk_n);
+    user_state.uniformity_levels.clear();
+    user_state.uniformity_levels.push_back(UniformityLevel{
+        .nx = user_state.sc_nx,
+        .ny = user_state.sc_ny,
+        .nz = user_state.sc_nz,
+        .nodes = std::vector<uint64_t>(super_chunk_n * user_state.channel_n),
+    });
+
+    if (magic == PALETTE_MAGIC_V1) {
+        read_v1_layout(blit_ctx, user_state, v1_blob_size);
+    } else if (!read_v2_layout(blit_ctx, ctx, user_state)) {
+        user_state.super_chunks.clear();
+        user_state.uniformity_levels.clear();
+        return;
+    }
+    build_uniformity_pyramid(user_state.uniformity_levels, user_state.channel_n);
 
-    user_state.region_headers.resize(static_cast<size_t>(user_state.r_nx) * user_state.r_ny * user_state.r_nz * user_state.channel_n);
-    for (auto &region_header : user_state.region_headers) {
-        gvox_input_read(blit_ctx, user_state.offset, sizeof(ChannelHeader), &region_header);
-        user_state.offset += sizeof(ChannelHeader);
+    for (auto &shard : user_state.region_cache) {
+        shard.regions.clear();
+        shard.lru.clear();
     }
 
-    user_state.buffer.resize(user_state.blob_size);
-    gvox_input_read(blit_ctx, user_state.offset, user_state.blob_size, user_state.buffer.data());
+    // Blobs are only read once they're sampled, but let the input start
+    // fetching the part of the blob that the requested range covers
+    if (range != nullptr) {
+        prefetch_range(blit_ctx, user_state, *range);
+    }
 }
 
-extern "C" void gvox_parse_adapter_gvox_palette_blit_end(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/) {
+extern "C" void gvox_parse_adapter_gvox_palette_blit_end(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx) {
+    auto &user_state = *static_cast<GvoxPaletteParseUserState *>(gvox_adapter_get_user_pointer(ctx));
+    for (auto &shard : user_state.region_cache) {
+        shard.regions.clear();
+        shard.lru.clear();
+    }
 }
 
 // General
@@ -101,8 +678,25 @@ extern "C" auto gvox_parse_adapter_gvox_palette_query_parsable_range(GvoxBlitCon
     return user_state.range;
 }
 
-extern "C" auto gvox_parse_adapter_gvox_palette_sample_region(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegion const * /*unused*/, GvoxOffset3D const *offset, uint32_t channel_id) -> GvoxSample {
+extern "C" auto gvox_parse_adapter_gvox_palette_sample_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegion const *region, GvoxOffset3D const *offset, uint32_t channel_id) -> GvoxSample {
     auto &user_state = *static_cast<GvoxPaletteParseUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (region != nullptr && (region->flags & GVOX_REGION_FLAG_DENSE) != 0 && (region->channels & (1u << channel_id)) != 0 &&
+        offset->x >= region->range.offset.x && offset->y >= region->range.offset.y && offset->z >= region->range.offset.z &&
+        offset->x < region->range.offset.x + static_cast<int32_t>(region->range.extent.x) &&
+        offset->y < region->range.offset.y + static_cast<int32_t>(region->range.extent.y) &&
+        offset->z < region->range.offset.z + static_cast<int32_t>(region->range.extent.z)) {
+        auto const px = static_cast<size_t>(offset->x - region->range.offset.x);
+        auto const py = static_cast<size_t>(offset->y - region->range.offset.y);
+        auto const pz = static_cast<size_t>(offset->z - region->range.offset.z);
+        auto const voxel_n = static_cast<size_t>(region->range.extent.x) * region->range.extent.y * region->range.extent.z;
+        auto const channel_i = static_cast<size_t>(std::popcount(region->channels & ((1u << channel_id) - 1)));
+        auto const is_present = offset->x >= user_state.range.offset.x && offset->y >= user_state.range.offset.y && offset->z >= user_state.range.offset.z &&
+                                offset->x < user_state.range.offset.x + static_cast<int32_t>(user_state.range.extent.x) &&
+                                offset->y < user_state.range.offset.y + static_cast<int32_t>(user_state.range.extent.y) &&
+                                offset->z < user_state.range.offset.z + static_cast<int32_t>(user_state.range.extent.z);
+        auto const *voxels = static_cast<uint32_t const *>(region->data);
+        return {voxels[channel_i * voxel_n + px + py * region->range.extent.x + pz * region->range.extent.x * region->range.extent.y], static_cast<uint8_t>(is_present ? 1 : 0)};
+    }
     if (offset->x < user_state.range.offset.x ||
         offset->y < user_state.range.offset.y ||
         offset->z < user_state.range.offset.z ||
@@ -111,48 +705,31 @@ extern "C" auto gvox_parse_adapter_gvox_palette_sample_region(GvoxBlitContext *
         offset->z >= user_state.range.offset.z + static_cast<int32_t>(user_state.range.extent.z)) {
         return {0u, 0u};
     }
-    auto const xi = static_cast<uint32_t>(offset->x - user_state.range.offset.x) / REGION_SIZE;
-    auto const yi = static_cast<uint32_t>(offset->y - user_state.range.offset.y) / REGION_SIZE;
-    auto const zi = static_cast<uint32_t>(offset->z - user_state.range.offset.z) / REGION_SIZE;
-    auto const px = static_cast<uint32_t>(offset->x - user_state.range.offset.x) - xi * REGION_SIZE;
-    auto const py = static_cast<uint32_t>(offset->y - user_state.range.offset.y) - yi * REGION_SIZE;
-    auto const pz = static_cast<uint32_t>(offset->z - user_state.range.offset.z) - zi * REGION_SIZE;
-    auto r_nx = user_state.r_nx;
-    auto r_ny = user_state.r_ny;
-    auto &channel_header = user_state.region_headers[user_state.channel_indices[channel_id] + (xi + yi * r_nx + zi * r_nx * r_ny) * user_state.channel_n];
-    if (channel_header.variant_n <= 1) {
-        return {channel_header.blob_offset, 1u};
-    } else {
-        uint8_t *buffer_ptr = user_state.buffer.data() + channel_header.blob_offset;
-        if (channel_header.variant_n > MAX_REGION_COMPRESSED_VARIANT_N) {
-            auto const index = px + py * REGION_SIZE + pz * REGION_SIZE * REGION_SIZE;
-            // return 0;
-            return {*reinterpret_cast<uint32_t *>(buffer_ptr + index * sizeof(uint32_t)), 1u};
-        } else {
-            auto *palette_begin = reinterpret_cast<uint32_t *>(buffer_ptr);
-            auto const bits_per_variant = ceil_log2(channel_header.variant_n);
-            buffer_ptr += channel_header.variant_n * sizeof(uint32_t);
-            auto const index = px + py * REGION_SIZE + pz * REGION_SIZE * REGION_SIZE;
-            auto const bit_index = static_cast<uint32_t>(index) * bits_per_variant;
-            auto const byte_index = bit_index / 8;
-            auto const bit_offset = static_cast<uint32_t>(bit_index - byte_index * 8);
-            auto const mask = get_mask(bits_per_variant);
-#if 0
-            // Note: This is technically UB, since I think it breaks the strict aliasing rules of C++.
-            auto input = *reinterpret_cast<uint32_t *>(buffer_ptr + byte_index);
-            // The "correct" solution is below.
-#else
-            auto input = std::bit_cast<uint32_t>(*reinterpret_cast<std::array<uint8_t, 4> *>(buffer_ptr + byte_index));
+    auto const region_size = user_state.region_size;
+    auto const xi = static_cast<uint32_t>(offset->x - user_state.range.offset.x) / region_size;
+    auto const yi = static_cast<uint32_t>(offset->y - user_state.range.offset.y) / region_size;
+    auto const zi = static_cast<uint32_t>(offset->z - user_state.range.offset.z) / region_size;
+    auto const px = static_cast<uint32_t>(offset->x - user_state.range.offset.x) - xi * region_size;
+    auto const py = static_cast<uint32_t>(offset->y - user_state.range.offset.y) - yi * region_size;
+    auto const pz = static_cast<uint32_t>(offset->z - user_state.range.offset.z) - zi * region_size;
+    auto const region_header = get_region_header(blit_ctx, user_state, xi, yi, zi, user_state.channel_indices[channel_id]);
+    if (region_header.header.variant_n <= 1) {
+        return {region_header.header.blob_offset, 1u};
+    }
+    auto &shard = user_state.region_cache[region_header.key % REGION_CACHE_SHARD_N];
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    auto lock = std::lock_guard{shard.mtx};
 #endif
-            auto const palette_id = (input >> bit_offset) & mask;
-            // return palette_id;
-            return {palette_begin[palette_id], 1u};
-        }
+    auto const *voxels = load_decoded_region(blit_ctx, ctx, user_state, shard, region_header);
+    if (voxels == nullptr) {
+        return {0u, 0u};
     }
+    auto const index = px + py * region_size + pz * region_size * region_size;
+    return {voxels[index], 1u};
 }
 
 // Serialize Driven
-extern "C" auto gvox_parse_adapter_gvox_palette_query_region_flags(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) -> uint32_t {
+extern "C" auto gvox_parse_adapter_gvox_palette_query_region_flags(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) -> uint32_t {
     auto &user_state = *static_cast<GvoxPaletteParseUserState *>(gvox_adapter_get_user_pointer(ctx));
 
     if ((channel_flags & ~user_state.channel_flags) != 0) {
@@ -160,54 +737,79 @@ extern "C" auto gvox_parse_adapter_gvox_palette_query_region_flags(GvoxBlitConte
         return 0;
     }
 
-    auto ax = static_cast<uint32_t>(range->offset.x - user_state.range.offset.x) / static_cast<uint32_t>(REGION_SIZE);
-    auto ay = static_cast<uint32_t>(range->offset.y - user_state.range.offset.y) / static_cast<uint32_t>(REGION_SIZE);
-    auto az = static_cast<uint32_t>(range->offset.z - user_state.range.offset.z) / static_cast<uint32_t>(REGION_SIZE);
-    auto bx = (static_cast<uint32_t>(range->offset.x - user_state.range.offset.x) + range->extent.x + static_cast<uint32_t>(REGION_SIZE - 1)) / static_cast<uint32_t>(REGION_SIZE);
-    auto by = (static_cast<uint32_t>(range->offset.y - user_state.range.offset.y) + range->extent.y + static_cast<uint32_t>(REGION_SIZE - 1)) / static_cast<uint32_t>(REGION_SIZE);
-    auto bz = (static_cast<uint32_t>(range->offset.z - user_state.range.offset.z) + range->extent.z + static_cast<uint32_t>(REGION_SIZE - 1)) / static_cast<uint32_t>(REGION_SIZE);
-
-    uint32_t flags = 0;
+    // Voxels outside of the parsable range aren't present, so only ranges
+    // fully within it can be uniform
+    if (channel_flags == 0 || user_state.uniformity_levels.empty() ||
+        range->extent.x == 0 || range->extent.y == 0 || range->extent.z == 0 ||
+        range->offset.x < user_state.range.offset.x ||
+        range->offset.y < user_state.range.offset.y ||
+        range->offset.z < user_state.range.offset.z ||
+        int64_t{range->offset.x} + range->extent.x > int64_t{user_state.range.offset.x} + user_state.range.extent.x ||
+        int64_t{range->offset.y} + range->extent.y > int64_t{user_state.range.offset.y} + user_state.range.extent.y ||
+        int64_t{range->offset.z} + range->extent.z > int64_t{user_state.range.offset.z} + user_state.range.extent.z) {
+        return 0;
+    }
 
+    auto const bounds = region_bounds(user_state, *range);
+    auto const sc_size = user_state.super_chunk_size;
+    auto const top_level_i = static_cast<uint32_t>(user_state.uniformity_levels.size() - 1);
     for (uint32_t channel_id = 0; channel_id < 32; ++channel_id) {
         if (((1u << channel_id) & channel_flags) != 0) {
-            auto channel_index = user_state.channel_indices[channel_id];
-            auto &a_channel_header = user_state.region_headers[channel_index + (ax + ay * user_state.r_nx + az * user_state.r_nx * user_state.r_ny) * user_state.channel_n];
-            if (a_channel_header.variant_n == 1) {
-                flags |= GVOX_REGION_FLAG_UNIFORM;
-                for (uint32_t zi = az; zi < bz; ++zi) {
-                    for (uint32_t yi = ay; yi < by; ++yi) {
-                        for (uint32_t xi = ax; xi < bx; ++xi) {
-                            auto &b_channel_header = user_state.region_headers[channel_index + (xi + yi * user_state.r_nx + zi * user_state.r_nx * user_state.r_ny) + user_state.channel_n];
-                            if (b_channel_header.variant_n != 1 || b_channel_header.blob_offset != a_channel_header.blob_offset) {
-                                flags = 0;
-                                break;
-                            }
-                        }
-                    }
-                }
+            auto const channel_index = user_state.channel_indices[channel_id];
+            // Super-chunks that are only partly within the range are looked at region by region
+            auto const on_partial_super_chunk = [&](uint32_t sxi, uint32_t syi, uint32_t szi, uint64_t &value) -> bool {
+                auto const &super_chunk = load_super_chunk(blit_ctx, user_state, sxi + syi * size_t{user_state.sc_nx} + szi * size_t{user_state.sc_nx} * user_state.sc_ny);
+                auto const local_bounds = RegionBounds{
+                    .ax = std::max(bounds.ax, sxi * sc_size) - sxi * sc_size,
+                    .ay = std::max(bounds.ay, syi * sc_size) - syi * sc_size,
+                    .az = std::max(bounds.az, szi * sc_size) - szi * sc_size,
+                    .bx = std::min(bounds.bx, (sxi + 1) * sc_size) - sxi * sc_size,
+                    .by = std::min(bounds.by, (syi + 1) * sc_size) - syi * sc_size,
+                    .bz = std::min(bounds.bz, (szi + 1) * sc_size) - szi * sc_size,
+                };
+                auto const &levels = super_chunk.uniformity_levels;
+                auto const local_extent = GvoxExtent3D{levels[0].nx, levels[0].ny, levels[0].nz};
+                return is_uniform_within(
+                    levels, user_state.channel_n, channel_index, 1, local_extent, local_bounds, static_cast<uint32_t>(levels.size() - 1), 0, 0, 0, value,
+                    [](uint32_t, uint32_t, uint32_t, uint64_t &) { return false; });
+            };
+            auto value = NON_UNIFORM_NODE;
+            if (!is_uniform_within(user_state.uniformity_levels, user_state.channel_n, channel_index, sc_size, GvoxExtent3D{user_state.r_nx, user_state.r_ny, user_state.r_nz}, bounds, top_level_i, 0, 0, 0, value, on_partial_super_chunk)) {
+                return 0;
             }
         }
     }
 
-    return flags;
+    return GVOX_REGION_FLAG_UNIFORM;
 }
 
-extern "C" auto gvox_parse_adapter_gvox_palette_load_region(GvoxBlitContext * /*unused*/, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) -> GvoxRegion {
+extern "C" auto gvox_parse_adapter_gvox_palette_load_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) -> GvoxRegion {
     auto &user_state = *static_cast<GvoxPaletteParseUserState *>(gvox_adapter_get_user_pointer(ctx));
     if ((channel_flags & ~user_state.channel_flags) != 0) {
         gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_REQUESTED_CHANNEL_NOT_PRESENT, "Tried loading a region with a channel that wasn't present in the original data");
     }
-    GvoxRegion const region = {
+    GvoxRegion region = {
         .range = *range,
         .channels = channel_flags & user_state.channel_flags,
         .flags = 0u,
         .data = nullptr,
     };
+    // Single voxel loads are better off just sampling the cache
+    if (static_cast<size_t>(range->extent.x) * range->extent.y * range->extent.z > 1 && region.channels != 0) {
+        prefetch_range(blit_ctx, user_state, *range);
+        region.data = load_dense_range(blit_ctx, ctx, user_state, *range, region.channels);
+        if (region.data != nullptr) {
+            region.flags |= GVOX_REGION_FLAG_DENSE;
+        }
+    }
     return region;
 }
 
-extern "C" void gvox_parse_adapter_gvox_palette_unload_region(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegion * /*unused*/) {
+extern "C" void gvox_parse_adapter_gvox_palette_unload_region(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegion *region) {
+    if ((region->flags & GVOX_REGION_FLAG_DENSE) != 0) {
+        free(const_cast<void *>(region->data));
+        region->data = nullptr;
+    }
 }
 
 // Parse Driven
@@ -216,11 +818,57 @@ extern "C" void gvox_parse_adapter_gvox_palette_parse_region(GvoxBlitContext *bl
     if ((channel_flags & ~user_state.channel_flags) != 0) {
         gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_REQUESTED_CHANNEL_NOT_PRESENT, "Tried loading a region with a channel that wasn't present in the original data");
     }
-    GvoxRegion const region = {
-        .range = *range,
-        .channels = channel_flags & user_state.channel_flags,
-        .flags = 0u,
-        .data = nullptr,
-    };
-    gvox_emit_region(blit_ctx, &region);
+    channel_flags &= user_state.channel_flags;
+    if (channel_flags == 0) {
+        return;
+    }
+    prefetch_range(blit_ctx, user_state, *range);
+    // Emit each palette region on its own, so that they can be decoded (and
+    // serialized) in parallel, and so that uniform ones stay uniform
+    auto const bounds = region_bounds(user_state, *range);
+    user_state.thread_pool.start();
+    for (uint32_t zi = bounds.az; zi < bounds.bz; ++zi) {
+        for (uint32_t yi = bounds.ay; yi < bounds.by; ++yi) {
+            for (uint32_t xi = bounds.ax; xi < bounds.bx; ++xi) {
+                user_state.thread_pool.enqueue([blit_ctx, ctx, &user_state, range, channel_flags, xi, yi, zi]() {
+                    // This palette region's part of the requested range
+                    auto const region_size = int64_t{user_state.region_size};
+                    auto const x0 = std::max(int64_t{user_state.range.offset.x} + xi * region_size, int64_t{range->offset.x});
+                    auto const y0 = std::max(int64_t{user_state.range.offset.y} + yi * region_size, int64_t{range->offset.y});
+                    auto const z0 = std::max(int64_t{user_state.range.offset.z} + zi * region_size, int64_t{range->offset.z});
+                    auto const x1 = std::min({int64_t{user_state.range.offset.x} + (xi + 1) * region_size, int64_t{range->offset.x} + range->extent.x, int64_t{user_state.range.offset.x} + user_state.range.extent.x});
+                    auto const y1 = std::min({int64_t{user_state.range.offset.y} + (yi + 1) * region_size, int64_t{range->offset.y} + range->extent.y, int64_t{user_state.range.offset.y} + user_state.range.extent.y});
+                    auto const z1 = std::min({int64_t{user_state.range.offset.z} + (zi + 1) * region_size, int64_t{range->offset.z} + range->extent.z, int64_t{user_state.range.offset.z} + user_state.range.extent.z});
+                    GvoxRegion region = {
+                        .range = GvoxRegionRange{
+                            .offset = {static_cast<int32_t>(x0), static_cast<int32_t>(y0), static_cast<int32_t>(z0)},
+                            .extent = {static_cast<uint32_t>(x1 - x0), static_cast<uint32_t>(y1 - y0), static_cast<uint32_t>(z1 - z0)},
+                        },
+                        .channels = channel_flags,
+                        .flags = 0u,
+                        .data = nullptr,
+                    };
+                    auto is_uniform = true;
+                    for (uint32_t channel_id = 0; channel_id < 32; ++channel_id) {
+                        if ((channel_flags & (1u << channel_id)) != 0) {
+                            is_uniform = is_uniform && get_region_header(blit_ctx, user_state, xi, yi, zi, user_state.channel_indices[channel_id]).header.variant_n <= 1;
+                        }
+                    }
+                    if (is_uniform) {
+                        // Sampling these is just a header lookup
+                        region.flags = GVOX_REGION_FLAG_UNIFORM;
+                    } else {
+                        region.data = load_dense_range(blit_ctx, ctx, user_state, region.range, channel_flags);
+                        if (region.data != nullptr) {
+                            region.flags = GVOX_REGION_FLAG_DENSE;
+                        }
+                    }
+                    gvox_emit_region(blit_ctx, &region);
+                    free(const_cast<void *>(region.data));
+                });
+            }
+        }
+    }
+    user_state.thread_pool.wait();
+    user_state.thread_pool.stop();
 }
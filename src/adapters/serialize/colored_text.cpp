@@ -126,9 +126,11 @@ namespace {
                             out_pos.z >= user_state.range.offset.z + static_cast<int32_t>(user_state.range.extent.z)) {
                             continue;
                         }
+                        // The image is flipped in y and z, relative to the whole blit range
+                        // rather than to this region, since regions may arrive in any order
                         auto output_rel_x = static_cast<size_t>(out_pos.x - user_state.range.offset.x);
-                        auto output_rel_y = static_cast<size_t>(out_pos.y - user_state.range.offset.y);
-                        auto output_rel_z = static_cast<size_t>(out_pos.z - user_state.range.offset.z);
+                        auto output_rel_y = static_cast<size_t>(user_state.range.offset.y + static_cast<int32_t>(user_state.range.extent.y) - out_pos.y - 1);
+                        auto output_rel_z = static_cast<size_t>(user_state.range.offset.z + static_cast<int32_t>(user_state.range.extent.z) - out_pos.z - 1);
                         if (user_state.config.vertical != 0u) {
                             std::swap(output_rel_y, output_rel_z);
                         }
@@ -154,8 +156,8 @@ namespace {
                                     for (uint32_t sub_xi = 0; sub_xi < sub_n && (xi + sub_xi < range->extent.x); ++sub_xi) {
                                         auto const pos = GvoxOffset3D{
                                             static_cast<int32_t>(xi + sub_xi) + range->offset.x,
-                                            static_cast<int32_t>(range->extent.y) + range->offset.y - static_cast<int32_t>(yi + sub_yi) - 1,
-                                            static_cast<int32_t>(range->extent.z) + range->offset.z - static_cast<int32_t>(zi + sub_zi) - 1,
+                                            static_cast<int32_t>(yi + sub_yi) + range->offset.y,
+                                            static_cast<int32_t>(zi + sub_zi) + range->offset.z,
                                         };
                                         auto sample = user_func(channel_id, pos);
                                         auto voxel = sample.data;
@@ -180,12 +182,7 @@ namespace {
                             g = static_cast<uint8_t>(avg_g / sample_n * 255.0f);
                             b = static_cast<uint8_t>(avg_b / sample_n * 255.0f);
                         } else {
-                            auto const pos = GvoxOffset3D{
-                                static_cast<int32_t>(xi) + range->offset.x,
-                                static_cast<int32_t>(range->extent.y) + range->offset.y - static_cast<int32_t>(yi) - 1,
-                                static_cast<int32_t>(range->extent.z) + range->offset.z - static_cast<int32_t>(zi) - 1,
-                            };
-                            auto sample = user_func(channel_id, pos);
+                            auto sample = user_func(channel_id, out_pos);
                             auto voxel = sample.data;
                             if (is_3channel) {
                                 r = (voxel >> 0x00) & 0xff;
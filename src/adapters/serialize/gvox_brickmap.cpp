@@ -2,32 +2,125 @@
 // #include <gvox/adapters/serialize/gvox_brickmap.h>
 
 #include <cstdlib>
+#include <cstdint>
 
 #include <bit>
+#include <array>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <new>
 
 #include "../shared/gvox_brickmap.hpp"
 #include "../shared/thread_pool.hpp"
 
-struct TempBrickInfo {
-    uint32_t first_voxel{};
-    uint32_t state = 0;
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS
-    std::mutex access_mtx;
-#endif
+using namespace gvox_detail::thread_pool;
+
+static constexpr auto BRICK_SIZE = uint32_t{8};
+static constexpr auto BRICK_VOXEL_N = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+// Received regions can share bricks, so each brick is locked while it's
+// filled in. Bricks share this many locks between them.
+static constexpr auto BRICK_LOCK_N = size_t{64};
+// How many jobs each worker gets, on average
+static constexpr auto JOBS_PER_WORKER = size_t{4};
+// A uniform brick's value is stored in its header's 24-bit lod_color
+static constexpr auto MAX_LOD_COLOR = uint32_t{0xffffff};
+
+// A brick that's still being filled in, or one that has been finalized and
+// isn't uniform. Voxels that are never present stay 0.
+struct PartialBrick {
+    Brick brick{};
+    // Which voxels have been sampled as present
+    std::array<uint32_t, BRICK_VOXEL_N / 32> presence{};
+    uint32_t accounted_for{};
+};
+
+// Each brick only has storage while it's being filled in, and afterwards
+// only if it isn't uniform, so memory follows the brick heap
+struct BrickSlot {
+    std::unique_ptr<PartialBrick> partial{};
+    BrickmapHeader header{};
+    bool is_finalized{};
 };
 
 struct BrickmapUserState {
     GvoxRegionRange range{};
-    std::vector<uint32_t> voxels;
     std::vector<uint8_t> channels;
     size_t offset{};
     GvoxExtent3D bricks_extent{};
-    std::unique_ptr<std::vector<TempBrickInfo>> temp_brick_infos{};
-    uint32_t brick_heap_size{};
+    // Indexed by brick_index * channel_n + channel_index
+    std::vector<BrickSlot> brick_slots{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    std::array<std::mutex, BRICK_LOCK_N> brick_locks{};
+    std::mutex free_bricks_mutex{};
+#endif
+    // Storage of bricks that turned out to be uniform, ready to be reused
+    std::vector<std::unique_ptr<PartialBrick>> free_bricks{};
+
+    ThreadPool thread_pool{};
 };
 
+static auto allocate_brick(BrickmapUserState &user_state) -> std::unique_ptr<PartialBrick> {
+    {
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+        auto lock = std::lock_guard{user_state.free_bricks_mutex};
+#endif
+        if (!user_state.free_bricks.empty()) {
+            auto result = std::move(user_state.free_bricks.back());
+            user_state.free_bricks.pop_back();
+            *result = PartialBrick{};
+            return result;
+        }
+    }
+    return std::make_unique<PartialBrick>();
+}
+
+static void free_brick(BrickmapUserState &user_state, std::unique_ptr<PartialBrick> brick) {
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    auto lock = std::lock_guard{user_state.free_bricks_mutex};
+#endif
+    user_state.free_bricks.push_back(std::move(brick));
+}
+
+// Bricks at the far edges of the range are only partly within it
+static auto brick_extent(BrickmapUserState const &user_state, uint32_t bxi, uint32_t byi, uint32_t bzi) -> GvoxExtent3D {
+    return {
+        std::min(BRICK_SIZE, user_state.range.extent.x - bxi * BRICK_SIZE),
+        std::min(BRICK_SIZE, user_state.range.extent.y - byi * BRICK_SIZE),
+        std::min(BRICK_SIZE, user_state.range.extent.z - bzi * BRICK_SIZE),
+    };
+}
+
+// Once a brick is complete (or at blit_end), it's either stored in its header
+// if it's uniform, or kept to go in the heap
+static void finalize_brick(BrickmapUserState &user_state, BrickSlot &slot, GvoxExtent3D const &extent) {
+    slot.is_finalized = true;
+    if (slot.partial == nullptr) {
+        // Nothing in it was ever present, so it's all 0
+        slot.header.unloaded.lod_color = 0;
+        slot.header.unloaded.is_loaded = 0;
+        return;
+    }
+    auto const &voxels = slot.partial->brick.voxels;
+    auto const first_voxel = voxels[0];
+    auto is_uniform = first_voxel <= MAX_LOD_COLOR;
+    for (uint32_t zi = 0; zi < extent.z && is_uniform; ++zi) {
+        for (uint32_t yi = 0; yi < extent.y && is_uniform; ++yi) {
+            auto const *row = voxels.data() + yi * BRICK_SIZE + zi * BRICK_SIZE * BRICK_SIZE;
+            is_uniform = std::all_of(row, row + extent.x, [first_voxel](uint32_t voxel) { return voxel == first_voxel; });
+        }
+    }
+    if (is_uniform) {
+        slot.header.unloaded.lod_color = first_voxel & MAX_LOD_COLOR;
+        slot.header.unloaded.is_loaded = 0;
+        free_brick(user_state, std::move(slot.partial));
+    } else {
+        // The heap index is given out at blit_end, so that the output doesn't
+        // depend on the order bricks were completed in
+        slot.header.loaded.is_loaded = 1;
+    }
+}
+
 // Base
 extern "C" void gvox_serialize_adapter_gvox_brickmap_create(GvoxAdapterContext *ctx, void const * /*unused*/) {
     auto *user_state_ptr = malloc(sizeof(BrickmapUserState));
@@ -60,98 +153,145 @@ extern "C" void gvox_serialize_adapter_gvox_brickmap_blit_begin(GvoxBlitContext
             ++next_channel;
         }
     }
-    user_state.voxels.resize(user_state.channels.size() * range->extent.x * range->extent.y * range->extent.z);
-    user_state.bricks_extent.x = (range->extent.x + 7) / 8;
-    user_state.bricks_extent.y = (range->extent.y + 7) / 8;
-    user_state.bricks_extent.z = (range->extent.z + 7) / 8;
-    user_state.temp_brick_infos = std::make_unique<std::vector<TempBrickInfo>>(user_state.channels.size() * user_state.bricks_extent.x * user_state.bricks_extent.y * user_state.bricks_extent.z);
+    user_state.bricks_extent.x = (range->extent.x + BRICK_SIZE - 1) / BRICK_SIZE;
+    user_state.bricks_extent.y = (range->extent.y + BRICK_SIZE - 1) / BRICK_SIZE;
+    user_state.bricks_extent.z = (range->extent.z + BRICK_SIZE - 1) / BRICK_SIZE;
+    user_state.brick_slots.clear();
+    user_state.brick_slots.resize(user_state.channels.size() * user_state.bricks_extent.x * user_state.bricks_extent.y * user_state.bricks_extent.z);
 }
 
 extern "C" void gvox_serialize_adapter_gvox_brickmap_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<BrickmapUserState *>(gvox_adapter_get_user_pointer(ctx));
-    std::vector<Brick> bricks_heap{};
-    std::vector<BrickmapHeader> brick_headers{};
-    brick_headers.resize(static_cast<size_t>(user_state.bricks_extent.x) * user_state.bricks_extent.y * user_state.bricks_extent.z * user_state.channels.size());
-    bricks_heap.reserve(user_state.brick_heap_size);
-    for (uint32_t ci = 0; ci < user_state.channels.size(); ++ci) {
-        for (uint32_t bzi = 0; bzi < user_state.bricks_extent.z; ++bzi) {
-            for (uint32_t byi = 0; byi < user_state.bricks_extent.y; ++byi) {
-                for (uint32_t bxi = 0; bxi < user_state.bricks_extent.x; ++bxi) {
-                    auto brick_index = bxi + byi * user_state.bricks_extent.x + bzi * user_state.bricks_extent.x * user_state.bricks_extent.y;
-                    auto &brick_header = brick_headers[brick_index + ci * user_state.bricks_extent.x * user_state.bricks_extent.y * user_state.bricks_extent.z];
-                    auto brick_result = Brick{};
-                    auto first_voxel = uint32_t{};
-                    for (uint32_t zi = 0; zi < 8; ++zi) {
-                        for (uint32_t yi = 0; yi < 8; ++yi) {
-                            for (uint32_t xi = 0; xi < 8; ++xi) {
-                                auto out_index = xi + yi * 8 + zi * 64;
-                                auto &out_voxel = brick_result.voxels[out_index];
-                                auto gxi = xi + bxi * 8;
-                                auto gyi = yi + byi * 8;
-                                auto gzi = zi + bzi * 8;
-                                auto in_index = gxi + gyi * user_state.range.extent.x + gzi * user_state.range.extent.x * user_state.range.extent.y;
-                                if (gxi < user_state.range.extent.x &&
-                                    gyi < user_state.range.extent.y &&
-                                    gzi < user_state.range.extent.z) {
-                                    out_voxel = user_state.voxels[in_index * user_state.channels.size() + ci];
-                                } else {
-                                    out_voxel = 0u;
-                                }
-                                if (in_index == 0) {
-                                    first_voxel = out_voxel;
-                                }
-                                if (!brick_header.loaded.is_loaded && out_voxel != first_voxel) {
-                                    brick_header.loaded.is_loaded = true;
-                                }
-                            }
-                        }
-                    }
-                    if (brick_header.loaded.is_loaded) {
-                        brick_header.loaded.heap_index = static_cast<uint32_t>(bricks_heap.size());
-                        bricks_heap.push_back(brick_result);
-                    } else {
-                        auto &temp_brick = (*user_state.temp_brick_infos)[brick_index * user_state.channels.size() + ci];
-                        brick_header.unloaded.lod_color = temp_brick.first_voxel;
+    auto const channel_n = user_state.channels.size();
+    auto const brick_n = static_cast<size_t>(user_state.bricks_extent.x) * user_state.bricks_extent.y * user_state.bricks_extent.z;
+
+    // Bricks that never got all of their voxels (such as ones with empty
+    // space in them) are finalized now, in parallel
+    user_state.thread_pool.start();
+    auto const job_n = size_t{user_state.thread_pool.thread_count()} * JOBS_PER_WORKER;
+    auto const job_brick_n = std::max((brick_n + job_n - 1) / job_n, size_t{1});
+    for (size_t first_brick = 0; first_brick < brick_n; first_brick += job_brick_n) {
+        auto const last_brick = std::min(first_brick + job_brick_n, brick_n);
+        user_state.thread_pool.enqueue([&user_state, channel_n, first_brick, last_brick]() {
+            for (size_t brick_index = first_brick; brick_index < last_brick; ++brick_index) {
+                auto const bxi = static_cast<uint32_t>(brick_index % user_state.bricks_extent.x);
+                auto const byi = static_cast<uint32_t>((brick_index / user_state.bricks_extent.x) % user_state.bricks_extent.y);
+                auto const bzi = static_cast<uint32_t>(brick_index / (size_t{user_state.bricks_extent.x} * user_state.bricks_extent.y));
+                for (size_t ci = 0; ci < channel_n; ++ci) {
+                    auto &slot = user_state.brick_slots[brick_index * channel_n + ci];
+                    if (!slot.is_finalized) {
+                        finalize_brick(user_state, slot, brick_extent(user_state, bxi, byi, bzi));
                     }
                 }
             }
-        }
+        });
     }
+    user_state.thread_pool.wait();
+    user_state.thread_pool.stop();
 
-    user_state.brick_heap_size = static_cast<uint32_t>(bricks_heap.size());
+    auto brick_headers = std::vector<BrickmapHeader>{};
+    brick_headers.reserve(user_state.brick_slots.size());
+    auto brick_heap_size = uint32_t{0};
+    for (auto &slot : user_state.brick_slots) {
+        if (slot.header.loaded.is_loaded) {
+            slot.header.loaded.heap_index = brick_heap_size & 0x7fffffffu;
+            ++brick_heap_size;
+        }
+        brick_headers.push_back(slot.header);
+    }
 
-    gvox_output_write(blit_ctx, user_state.offset, sizeof(user_state.brick_heap_size), &user_state.brick_heap_size);
-    user_state.offset += sizeof(user_state.brick_heap_size);
+    gvox_output_write(blit_ctx, user_state.offset, sizeof(brick_heap_size), &brick_heap_size);
+    user_state.offset += sizeof(brick_heap_size);
 
     gvox_output_write(blit_ctx, user_state.offset, brick_headers.size() * sizeof(brick_headers[0]), brick_headers.data());
     user_state.offset += brick_headers.size() * sizeof(brick_headers[0]);
-    gvox_output_write(blit_ctx, user_state.offset, bricks_heap.size() * sizeof(bricks_heap[0]), bricks_heap.data());
-    user_state.offset += bricks_heap.size() * sizeof(bricks_heap[0]);
+
+    // The heap is written straight from each brick's storage
+    auto iovs = std::vector<GvoxIoVec>{};
+    iovs.reserve(brick_heap_size);
+    for (auto const &slot : user_state.brick_slots) {
+        if (slot.header.loaded.is_loaded) {
+            iovs.push_back({.position = user_state.offset, .size = sizeof(Brick), .data = &slot.partial->brick});
+            user_state.offset += sizeof(Brick);
+        }
+    }
+    gvox_output_writev(blit_ctx, iovs.data(), iovs.size());
+
+    user_state.brick_slots.clear();
+    user_state.free_bricks.clear();
 }
 
-static void handle_region(BrickmapUserState &user_state, GvoxRegionRange const *range, auto user_func) {
-    for (uint32_t zi = 0; zi < range->extent.z; ++zi) {
-        for (uint32_t yi = 0; yi < range->extent.y; ++yi) {
-            for (uint32_t xi = 0; xi < range->extent.x; ++xi) {
-                auto const pos = GvoxOffset3D{
-                    static_cast<int32_t>(xi) + range->offset.x,
-                    static_cast<int32_t>(yi) + range->offset.y,
-                    static_cast<int32_t>(zi) + range->offset.z,
-                };
-                if (pos.x < user_state.range.offset.x ||
-                    pos.y < user_state.range.offset.y ||
-                    pos.z < user_state.range.offset.z ||
-                    pos.x >= user_state.range.offset.x + static_cast<int32_t>(user_state.range.extent.x) ||
-                    pos.y >= user_state.range.offset.y + static_cast<int32_t>(user_state.range.extent.y) ||
-                    pos.z >= user_state.range.offset.z + static_cast<int32_t>(user_state.range.extent.z)) {
-                    continue;
+// Fills in every brick that `range` touches, sampling them with `sample`.
+// Serialize-driven blits account for every voxel, whether or not it's present.
+static void handle_bricks(BrickmapUserState &user_state, GvoxRegionRange const &range, bool is_locked, auto sample) {
+    // The part of the range within ours, relative to ours
+    auto const x0 = std::max(int64_t{range.offset.x} - user_state.range.offset.x, int64_t{0});
+    auto const y0 = std::max(int64_t{range.offset.y} - user_state.range.offset.y, int64_t{0});
+    auto const z0 = std::max(int64_t{range.offset.z} - user_state.range.offset.z, int64_t{0});
+    auto const x1 = std::min(int64_t{range.offset.x} + range.extent.x - user_state.range.offset.x, int64_t{user_state.range.extent.x});
+    auto const y1 = std::min(int64_t{range.offset.y} + range.extent.y - user_state.range.offset.y, int64_t{user_state.range.extent.y});
+    auto const z1 = std::min(int64_t{range.offset.z} + range.extent.z - user_state.range.offset.z, int64_t{user_state.range.extent.z});
+    if (x0 >= x1 || y0 >= y1 || z0 >= z1) {
+        return;
+    }
+    auto const channel_n = user_state.channels.size();
+    auto const brick_size = int64_t{BRICK_SIZE};
+    for (auto bzi = static_cast<uint32_t>(z0 / brick_size); bzi * brick_size < z1; ++bzi) {
+        for (auto byi = static_cast<uint32_t>(y0 / brick_size); byi * brick_size < y1; ++byi) {
+            for (auto bxi = static_cast<uint32_t>(x0 / brick_size); bxi * brick_size < x1; ++bxi) {
+                auto const brick_index = bxi + byi * size_t{user_state.bricks_extent.x} + bzi * size_t{user_state.bricks_extent.x} * user_state.bricks_extent.y;
+                auto const extent = brick_extent(user_state, bxi, byi, bzi);
+                auto const brick_voxel_n = extent.x * extent.y * extent.z;
+                // This brick's part of the range, relative to the brick
+                auto const lx0 = static_cast<uint32_t>(std::max(x0 - bxi * brick_size, int64_t{0}));
+                auto const ly0 = static_cast<uint32_t>(std::max(y0 - byi * brick_size, int64_t{0}));
+                auto const lz0 = static_cast<uint32_t>(std::max(z0 - bzi * brick_size, int64_t{0}));
+                auto const lx1 = static_cast<uint32_t>(std::min(x1 - bxi * brick_size, int64_t{extent.x}));
+                auto const ly1 = static_cast<uint32_t>(std::min(y1 - byi * brick_size, int64_t{extent.y}));
+                auto const lz1 = static_cast<uint32_t>(std::min(z1 - bzi * brick_size, int64_t{extent.z}));
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+                auto lock = std::unique_lock<std::mutex>{};
+                if (is_locked) {
+                    lock = std::unique_lock{user_state.brick_locks[brick_index % BRICK_LOCK_N]};
                 }
-                auto output_rel_x = static_cast<size_t>(pos.x - user_state.range.offset.x);
-                auto output_rel_y = static_cast<size_t>(pos.y - user_state.range.offset.y);
-                auto output_rel_z = static_cast<size_t>(pos.z - user_state.range.offset.z);
-                for (uint32_t channel_i = 0; channel_i < user_state.channels.size(); ++channel_i) {
-                    auto output_index = static_cast<size_t>(output_rel_x + output_rel_y * user_state.range.extent.x + output_rel_z * user_state.range.extent.x * user_state.range.extent.y) * user_state.channels.size() + channel_i;
-                    user_func(channel_i, output_index, pos);
+#else
+                (void)is_locked;
+#endif
+                for (uint32_t ci = 0; ci < channel_n; ++ci) {
+                    auto &slot = user_state.brick_slots[brick_index * channel_n + ci];
+                    if (slot.is_finalized) {
+                        continue;
+                    }
+                    for (uint32_t zi = lz0; zi < lz1; ++zi) {
+                        for (uint32_t yi = ly0; yi < ly1; ++yi) {
+                            for (uint32_t xi = lx0; xi < lx1; ++xi) {
+                                auto const pos = GvoxOffset3D{
+                                    user_state.range.offset.x + static_cast<int32_t>(bxi * BRICK_SIZE + xi),
+                                    user_state.range.offset.y + static_cast<int32_t>(byi * BRICK_SIZE + yi),
+                                    user_state.range.offset.z + static_cast<int32_t>(bzi * BRICK_SIZE + zi),
+                                };
+                                auto const voxel_sample = sample(pos, user_state.channels[ci]);
+                                if (voxel_sample.is_present == 0u) {
+                                    continue;
+                                }
+                                if (slot.partial == nullptr) {
+                                    slot.partial = allocate_brick(user_state);
+                                }
+                                auto &partial = *slot.partial;
+                                auto const voxel_index = xi + yi * BRICK_SIZE + zi * BRICK_SIZE * BRICK_SIZE;
+                                partial.brick.voxels[voxel_index] = voxel_sample.data;
+                                auto &presence_word = partial.presence[voxel_index / 32];
+                                auto const presence_bit = 1u << (voxel_index % 32);
+                                if ((presence_word & presence_bit) == 0) {
+                                    presence_word |= presence_bit;
+                                    ++partial.accounted_for;
+                                }
+                            }
+                        }
+                    }
+                    if (slot.partial != nullptr && slot.partial->accounted_for == brick_voxel_n) {
+                        finalize_brick(user_state, slot, extent);
+                    }
                 }
             }
         }
@@ -161,32 +301,44 @@ static void handle_region(BrickmapUserState &user_state, GvoxRegionRange const *
 // Serialize Driven
 extern "C" void gvox_serialize_adapter_gvox_brickmap_serialize_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t /* channel_flags */) {
     auto &user_state = *static_cast<BrickmapUserState *>(gvox_adapter_get_user_pointer(ctx));
-    handle_region(
-        user_state, range,
-        [blit_ctx, &user_state](uint32_t channel_i, size_t output_index, GvoxOffset3D const &pos) {
-            auto const sample_range = GvoxRegionRange{
-                .offset = pos,
-                .extent = GvoxExtent3D{1, 1, 1},
-            };
-            auto region = gvox_load_region_range(blit_ctx, &sample_range, 1u << user_state.channels[channel_i]);
-            auto sample = gvox_sample_region(blit_ctx, &region, &pos, user_state.channels[channel_i]);
-            if (sample.is_present == 0u) {
-                sample.data = 0u;
-            }
-            user_state.voxels[output_index] = sample.data;
-            gvox_unload_region_range(blit_ctx, &region, &sample_range);
+    auto channel_flags = uint32_t{0};
+    for (auto channel_id : user_state.channels) {
+        channel_flags |= 1u << channel_id;
+    }
+    // Each job fills in a whole z-slice of bricks, so that no two jobs ever
+    // touch the same brick
+    auto const z0 = std::max(range->offset.z, user_state.range.offset.z);
+    auto const z1 = std::min(range->offset.z + static_cast<int32_t>(range->extent.z), user_state.range.offset.z + static_cast<int32_t>(user_state.range.extent.z));
+    auto const brick_size = static_cast<int32_t>(BRICK_SIZE);
+    user_state.thread_pool.start();
+    for (auto slice_z = z0; slice_z < z1;) {
+        auto const next_slice_z = std::min(user_state.range.offset.z + ((slice_z - user_state.range.offset.z) / brick_size + 1) * brick_size, z1);
+        auto const slice_range = GvoxRegionRange{
+            .offset = {range->offset.x, range->offset.y, slice_z},
+            .extent = {range->extent.x, range->extent.y, static_cast<uint32_t>(next_slice_z - slice_z)},
+        };
+        user_state.thread_pool.enqueue([blit_ctx, &user_state, slice_range, channel_flags]() {
+            auto region = gvox_load_region_range(blit_ctx, &slice_range, channel_flags);
+            handle_bricks(user_state, slice_range, false, [blit_ctx, &region](GvoxOffset3D const &pos, uint32_t channel_id) {
+                auto voxel_sample = gvox_sample_region(blit_ctx, &region, &pos, channel_id);
+                if (voxel_sample.is_present == 0u) {
+                    voxel_sample.data = 0u;
+                }
+                voxel_sample.is_present = 1u;
+                return voxel_sample;
+            });
+            gvox_unload_region_range(blit_ctx, &region, &slice_range);
         });
+        slice_z = next_slice_z;
+    }
+    user_state.thread_pool.wait();
+    user_state.thread_pool.stop();
 }
 
 // Parse Driven
 extern "C" void gvox_serialize_adapter_gvox_brickmap_receive_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegion const *region) {
     auto &user_state = *static_cast<BrickmapUserState *>(gvox_adapter_get_user_pointer(ctx));
-    handle_region(
-        user_state, &region->range,
-        [blit_ctx, region, &user_state](uint32_t channel_i, size_t output_index, GvoxOffset3D const &pos) {
-            auto sample = gvox_sample_region(blit_ctx, region, &pos, user_state.channels[channel_i]);
-            if (sample.is_present != 0u) {
-                user_state.voxels[output_index] = sample.data;
-            }
-        });
+    handle_bricks(user_state, region->range, true, [blit_ctx, region](GvoxOffset3D const &pos, uint32_t channel_id) {
+        return gvox_sample_region(blit_ctx, region, &pos, channel_id);
+    });
 }
@@ -1,33 +1,150 @@
 #include <gvox/gvox.h>
-// #include <gvox/adapters/serialize/gvox_global_palette.h>
+#include <gvox/adapters/serialize/global_palette.h>
 
 #include <cstdlib>
+#include <cstdint>
 
 #include <bit>
 #include <array>
 #include <vector>
-#include <set>
+#include <unordered_set>
+#include <unordered_map>
 #include <algorithm>
+#include <new>
 
 #include "../shared/math_helpers.hpp"
+#include "../shared/gvox_global_palette.hpp"
 #include "../shared/thread_pool.hpp"
+#include "../shared/per_thread.hpp"
+#include "../shared/staging_buffer.hpp"
+
+using namespace gvox_detail::thread_pool;
+using namespace gvox_detail::per_thread;
+using namespace gvox_detail::staging_buffer;
+
+// How many packing jobs each worker gets, on average
+static constexpr auto JOBS_PER_WORKER = size_t{4};
+static constexpr auto MIN_JOB_ELEMENT_N = size_t{4096};
+static constexpr auto MIN_JOB_BRICK_N = size_t{64};
+
+// The unique values one thread has seen in each channel. Every thread gets
+// its own, so that collecting them never takes a lock, and they're merged
+// at blit_end.
+struct UniqueValueShard {
+    std::vector<std::unordered_set<uint32_t>> channel_values{};
+    // The last value inserted into each channel, since neighbouring voxels
+    // are usually the same
+    std::vector<uint32_t> last_values{};
+};
 
 struct GlobalPaletteUserState {
+    // 0 for the linear layout
+    uint32_t brick_size{};
+    GlobalPaletteBrickLayout brick_layout{};
+
     GvoxRegionRange range{};
-    std::vector<uint32_t> voxels;
+    StagingArray<uint32_t> voxels;
     std::vector<uint8_t> channels;
     size_t offset{};
-    std::vector<std::set<uint32_t>> unique_values;
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-    std::mutex palette_mutex;
-#endif
+
+    PerThread<UniqueValueShard> shards{};
+
+    ThreadPool thread_pool{};
 };
 
+static auto get_thread_shard(GlobalPaletteUserState &user_state) -> UniqueValueShard & {
+    return user_state.shards.get([&user_state](UniqueValueShard &shard) {
+        shard.channel_values.resize(user_state.channels.size());
+        // 0 is always in the palette, so it never needs inserting
+        shard.last_values.assign(user_state.channels.size(), 0u);
+    });
+}
+
+static void insert_unique_value(UniqueValueShard &shard, uint32_t channel_i, uint32_t value) {
+    if (value != shard.last_values[channel_i]) {
+        shard.channel_values[channel_i].insert(value);
+        shard.last_values[channel_i] = value;
+    }
+}
+
+// Writes the palette indices of voxels [first_element * voxels_per_element, ...)
+// into bits [first_element, last_element)
+static void pack_elements(
+    GlobalPaletteUserState const &user_state, std::unordered_map<uint32_t, uint32_t> const &palette_indices,
+    size_t channel_i, uint32_t bits_per_voxel, std::vector<uint32_t> &bits, size_t first_element, size_t last_element) {
+    auto const voxel_n = static_cast<size_t>(user_state.range.extent.x) * user_state.range.extent.y * user_state.range.extent.z;
+    auto const voxels_per_element = 8 * sizeof(bits[0]) / bits_per_voxel;
+    auto const channel_n = user_state.channels.size();
+    auto last_value = user_state.voxels[first_element * voxels_per_element * channel_n + channel_i];
+    auto last_index = palette_indices.at(last_value);
+    for (size_t element_i = first_element; element_i < last_element; ++element_i) {
+        auto const voxel_begin = element_i * voxels_per_element;
+        auto const voxel_end = std::min(voxel_begin + voxels_per_element, voxel_n);
+        auto element = uint32_t{0};
+        for (size_t voxel_i = voxel_begin; voxel_i < voxel_end; ++voxel_i) {
+            auto const my_voxel = user_state.voxels[voxel_i * channel_n + channel_i];
+            if (my_voxel != last_value) {
+                last_value = my_voxel;
+                last_index = palette_indices.at(my_voxel);
+            }
+            element |= last_index << static_cast<uint32_t>((voxel_i - voxel_begin) * bits_per_voxel);
+        }
+        bits[element_i] = element;
+    }
+}
+
+// Writes the palette indices of bricks [first_brick, last_brick) into bits,
+// starting at each one's offset
+static void pack_bricks(
+    GlobalPaletteUserState const &user_state, std::unordered_map<uint32_t, uint32_t> const &palette_indices,
+    size_t channel_i, uint32_t bits_per_voxel, std::vector<uint32_t> &bits, std::vector<uint32_t> const &brick_offsets,
+    size_t first_brick, size_t last_brick) {
+    auto const &layout = user_state.brick_layout;
+    auto const &extent = user_state.range.extent;
+    auto const voxels_per_element = 8 * sizeof(bits[0]) / bits_per_voxel;
+    auto const channel_n = user_state.channels.size();
+    auto last_value = uint32_t{0};
+    auto last_index = palette_indices.at(0u);
+    for (size_t brick_i = first_brick; brick_i < last_brick; ++brick_i) {
+        auto const bxi = static_cast<uint32_t>(brick_i % layout.brick_nx);
+        auto const byi = static_cast<uint32_t>((brick_i / layout.brick_nx) % layout.brick_ny);
+        auto const bzi = static_cast<uint32_t>(brick_i / (size_t{layout.brick_nx} * layout.brick_ny));
+        auto const brick_extent = layout.brick_extent(extent, bxi, byi, bzi);
+        auto *element = bits.data() + brick_offsets[brick_i];
+        auto element_voxel_n = size_t{0};
+        for (uint32_t zi = 0; zi < brick_extent.z; ++zi) {
+            for (uint32_t yi = 0; yi < brick_extent.y; ++yi) {
+                auto const row_voxel_i = bxi * size_t{layout.brick_size} + (byi * size_t{layout.brick_size} + yi) * extent.x + (bzi * size_t{layout.brick_size} + zi) * extent.x * extent.y;
+                for (uint32_t xi = 0; xi < brick_extent.x; ++xi) {
+                    auto const my_voxel = user_state.voxels[(row_voxel_i + xi) * channel_n + channel_i];
+                    if (my_voxel != last_value) {
+                        last_value = my_voxel;
+                        last_index = palette_indices.at(my_voxel);
+                    }
+                    *element |= last_index << static_cast<uint32_t>(element_voxel_n * bits_per_voxel);
+                    if (++element_voxel_n == voxels_per_element) {
+                        element_voxel_n = 0;
+                        ++element;
+                    }
+                }
+            }
+        }
+    }
+}
+
 // Base
-extern "C" void gvox_serialize_adapter_gvox_global_palette_create(GvoxAdapterContext *ctx, void const * /*unused*/) {
+extern "C" void gvox_serialize_adapter_gvox_global_palette_create(GvoxAdapterContext *ctx, void const *config) {
     auto *user_state_ptr = malloc(sizeof(GlobalPaletteUserState));
-    new (user_state_ptr) GlobalPaletteUserState();
+    auto &user_state = *(new (user_state_ptr) GlobalPaletteUserState());
     gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    if (config != nullptr && static_cast<GvoxGlobalPaletteSerializeAdapterConfig const *>(config)->brick_size != 0) {
+        auto const brick_size = static_cast<GvoxGlobalPaletteSerializeAdapterConfig const *>(config)->brick_size;
+        if (is_valid_global_palette_brick_size(brick_size)) {
+            user_state.brick_size = brick_size;
+        } else {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INVALID_PARAMETER, "gvox global palette brick size must be a power of two, no larger than 32");
+        }
+    }
 }
 
 extern "C" void gvox_serialize_adapter_gvox_global_palette_destroy(GvoxAdapterContext *ctx) {
@@ -40,13 +157,18 @@ extern "C" void gvox_serialize_adapter_gvox_global_palette_blit_begin(GvoxBlitCo
     auto &user_state = *static_cast<GlobalPaletteUserState *>(gvox_adapter_get_user_pointer(ctx));
     user_state.offset = 0;
     user_state.range = *range;
-    auto magic = std::bit_cast<uint64_t>(std::array<char, 8>{'g', 'v', 'g', 'l', 'b', 'p', 'a', 'l'});
+    auto magic = user_state.brick_size != 0 ? GLOBAL_PALETTE_BRICKED_MAGIC : GLOBAL_PALETTE_MAGIC;
     gvox_output_write(blit_ctx, user_state.offset, sizeof(magic), &magic);
     user_state.offset += sizeof(magic);
     gvox_output_write(blit_ctx, user_state.offset, sizeof(*range), range);
     user_state.offset += sizeof(*range);
     gvox_output_write(blit_ctx, user_state.offset, sizeof(channel_flags), &channel_flags);
     user_state.offset += sizeof(channel_flags);
+    if (user_state.brick_size != 0) {
+        gvox_output_write(blit_ctx, user_state.offset, sizeof(user_state.brick_size), &user_state.brick_size);
+        user_state.offset += sizeof(user_state.brick_size);
+        user_state.brick_layout = make_global_palette_brick_layout(range->extent, user_state.brick_size);
+    }
     user_state.channels.resize(static_cast<size_t>(std::popcount(channel_flags)));
     uint32_t next_channel = 0;
     for (uint8_t channel_i = 0; channel_i < 32; ++channel_i) {
@@ -55,63 +177,98 @@ extern "C" void gvox_serialize_adapter_gvox_global_palette_blit_begin(GvoxBlitCo
             ++next_channel;
         }
     }
-    user_state.unique_values.resize(user_state.channels.size());
-    for (auto &unique_values : user_state.unique_values) {
-        unique_values.insert(0u);
-    }
-    user_state.voxels.resize(user_state.channels.size() * range->extent.x * range->extent.y * range->extent.z);
+    user_state.shards.begin_blit();
+    user_state.voxels.allocate(ctx, user_state.channels.size() * range->extent.x * range->extent.y * range->extent.z);
 }
 
 extern "C" void gvox_serialize_adapter_gvox_global_palette_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<GlobalPaletteUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (user_state.voxels.data() == nullptr) {
+        return;
+    }
 
+    auto const channel_n = user_state.channels.size();
     auto sorted_unique_values_lists = std::vector<std::vector<uint32_t>>{};
-    sorted_unique_values_lists.resize(user_state.channels.size());
-
-    for (size_t i = 0; i < user_state.channels.size(); ++i) {
-        auto set_size = static_cast<uint32_t>(user_state.unique_values[i].size());
-        sorted_unique_values_lists[i].reserve(set_size);
+    sorted_unique_values_lists.resize(channel_n);
+    for (size_t ci = 0; ci < channel_n; ++ci) {
+        auto &sorted_unique_values = sorted_unique_values_lists[ci];
+        sorted_unique_values.push_back(0u);
+        for (auto const &shard : user_state.shards) {
+            sorted_unique_values.insert(sorted_unique_values.end(), shard->channel_values[ci].begin(), shard->channel_values[ci].end());
+        }
+        std::sort(sorted_unique_values.begin(), sorted_unique_values.end());
+        sorted_unique_values.erase(std::unique(sorted_unique_values.begin(), sorted_unique_values.end()), sorted_unique_values.end());
+        auto set_size = static_cast<uint32_t>(sorted_unique_values.size());
         gvox_output_write(blit_ctx, user_state.offset, sizeof(set_size), &set_size);
         user_state.offset += sizeof(set_size);
-        for (auto const &val : user_state.unique_values[i]) {
-            sorted_unique_values_lists[i].push_back(val);
-        }
     }
+    user_state.shards.clear();
 
-    auto voxel_n = user_state.range.extent.x * user_state.range.extent.y * user_state.range.extent.z;
+    auto voxel_n = static_cast<size_t>(user_state.range.extent.x) * user_state.range.extent.y * user_state.range.extent.z;
 
-    for (size_t ci = 0; ci < user_state.channels.size(); ++ci) {
+    user_state.thread_pool.start();
+    for (size_t ci = 0; ci < channel_n; ++ci) {
         auto &sorted_unique_values = sorted_unique_values_lists[ci];
-        std::sort(sorted_unique_values.begin(), sorted_unique_values.end());
 
         std::vector<uint32_t> bits{};
+        std::vector<uint32_t> brick_offsets{};
+        // A channel with only one value doesn't need any bits at all
         auto bits_per_voxel = ceil_log2(static_cast<uint32_t>(sorted_unique_values.size()));
-        auto voxels_per_element = 8 * sizeof(bits[0]) / bits_per_voxel;
-        bits.resize((voxel_n + voxels_per_element - 1) / voxels_per_element);
-        auto voxel_mask = (1u << bits_per_voxel) - 1;
-
-        for (uint32_t zi = 0; zi < user_state.range.extent.z; ++zi) {
-            for (uint32_t yi = 0; yi < user_state.range.extent.y; ++yi) {
-                for (uint32_t xi = 0; xi < user_state.range.extent.x; ++xi) {
-                    auto voxel_i = xi + yi * user_state.range.extent.x + zi * user_state.range.extent.x * user_state.range.extent.y;
-                    auto element_i = voxel_i / voxels_per_element;
-                    auto element_offset = (voxel_i - element_i * voxels_per_element) * bits_per_voxel;
-                    auto my_voxel = user_state.voxels[voxel_i * user_state.channels.size() + ci];
-                    auto palette_index = static_cast<uint32_t>(std::lower_bound(sorted_unique_values.begin(), sorted_unique_values.end(), my_voxel) - sorted_unique_values.begin());
-                    bits[element_i] |= (palette_index & voxel_mask) << element_offset;
-                }
+        if (user_state.brick_size != 0) {
+            brick_offsets.resize(user_state.brick_layout.brick_n());
+        }
+        auto palette_indices = std::unordered_map<uint32_t, uint32_t>{};
+        if (bits_per_voxel != 0) {
+            palette_indices.reserve(sorted_unique_values.size());
+            for (uint32_t palette_index = 0; palette_index < sorted_unique_values.size(); ++palette_index) {
+                palette_indices.emplace(sorted_unique_values[palette_index], palette_index);
             }
         }
+        if (bits_per_voxel != 0 && user_state.brick_size != 0) {
+            auto const voxels_per_element = static_cast<uint32_t>(8 * sizeof(bits[0]) / bits_per_voxel);
+            bits.resize(calc_global_palette_brick_offsets(user_state.brick_layout, user_state.range.extent, voxels_per_element, brick_offsets.data()));
+            // Each job packs whole bricks, and no two bricks share an element
+            auto const job_n = size_t{user_state.thread_pool.thread_count()} * JOBS_PER_WORKER;
+            auto const job_brick_n = std::max((brick_offsets.size() + job_n - 1) / job_n, MIN_JOB_BRICK_N);
+            for (size_t first_brick = 0; first_brick < brick_offsets.size(); first_brick += job_brick_n) {
+                auto const last_brick = std::min(first_brick + job_brick_n, brick_offsets.size());
+                user_state.thread_pool.enqueue([&, ci, bits_per_voxel, first_brick, last_brick]() {
+                    pack_bricks(user_state, palette_indices, ci, bits_per_voxel, bits, brick_offsets, first_brick, last_brick);
+                });
+            }
+            user_state.thread_pool.wait();
+        } else if (bits_per_voxel != 0) {
+            auto voxels_per_element = 8 * sizeof(bits[0]) / bits_per_voxel;
+            bits.resize((voxel_n + voxels_per_element - 1) / voxels_per_element);
+            // Each job packs whole elements, so that none of them share one
+            auto const job_n = size_t{user_state.thread_pool.thread_count()} * JOBS_PER_WORKER;
+            auto const job_element_n = std::max((bits.size() + job_n - 1) / job_n, MIN_JOB_ELEMENT_N);
+            for (size_t first_element = 0; first_element < bits.size(); first_element += job_element_n) {
+                auto const last_element = std::min(first_element + job_element_n, bits.size());
+                user_state.thread_pool.enqueue([&, ci, bits_per_voxel, first_element, last_element]() {
+                    pack_elements(user_state, palette_indices, ci, bits_per_voxel, bits, first_element, last_element);
+                });
+            }
+            user_state.thread_pool.wait();
+        }
 
         gvox_output_write(blit_ctx, user_state.offset, sorted_unique_values.size() * sizeof(sorted_unique_values[0]), sorted_unique_values.data());
         user_state.offset += sorted_unique_values.size() * sizeof(sorted_unique_values[0]);
 
+        gvox_output_write(blit_ctx, user_state.offset, brick_offsets.size() * sizeof(brick_offsets[0]), brick_offsets.data());
+        user_state.offset += brick_offsets.size() * sizeof(brick_offsets[0]);
+
         gvox_output_write(blit_ctx, user_state.offset, bits.size() * sizeof(bits[0]), bits.data());
         user_state.offset += bits.size() * sizeof(bits[0]);
     }
+    user_state.thread_pool.stop();
+    user_state.voxels.release();
 }
 
 static void handle_region(GlobalPaletteUserState &user_state, GvoxRegionRange const *range, auto user_func) {
+    if (user_state.voxels.data() == nullptr) {
+        return;
+    }
     for (uint32_t zi = 0; zi < range->extent.z; ++zi) {
         for (uint32_t yi = 0; yi < range->extent.y; ++yi) {
             for (uint32_t xi = 0; xi < range->extent.x; ++xi) {
@@ -145,7 +302,7 @@ extern "C" void gvox_serialize_adapter_gvox_global_palette_serialize_region(Gvox
     auto &user_state = *static_cast<GlobalPaletteUserState *>(gvox_adapter_get_user_pointer(ctx));
     handle_region(
         user_state, range,
-        [blit_ctx, &user_state](uint32_t channel_i, size_t output_index, GvoxOffset3D const &pos) {
+        [blit_ctx, &user_state, &shard = get_thread_shard(user_state)](uint32_t channel_i, size_t output_index, GvoxOffset3D const &pos) {
             auto const sample_range = GvoxRegionRange{
                 .offset = pos,
                 .extent = GvoxExtent3D{1, 1, 1},
@@ -156,7 +313,7 @@ extern "C" void gvox_serialize_adapter_gvox_global_palette_serialize_region(Gvox
                 sample.data = 0u;
             }
             user_state.voxels[output_index] = sample.data;
-            user_state.unique_values[channel_i].insert(sample.data);
+            insert_unique_value(shard, channel_i, sample.data);
             gvox_unload_region_range(blit_ctx, &region, &sample_range);
         });
 }
@@ -166,14 +323,11 @@ extern "C" void gvox_serialize_adapter_gvox_global_palette_receive_region(GvoxBl
     auto &user_state = *static_cast<GlobalPaletteUserState *>(gvox_adapter_get_user_pointer(ctx));
     handle_region(
         user_state, &region->range,
-        [blit_ctx, region, &user_state](uint32_t channel_i, size_t output_index, GvoxOffset3D const &pos) {
+        [blit_ctx, region, &user_state, &shard = get_thread_shard(user_state)](uint32_t channel_i, size_t output_index, GvoxOffset3D const &pos) {
             auto sample = gvox_sample_region(blit_ctx, region, &pos, user_state.channels[channel_i]);
             if (sample.is_present != 0u) {
                 user_state.voxels[output_index] = sample.data;
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-                auto lock = std::lock_guard{user_state.palette_mutex};
-#endif
-                user_state.unique_values[channel_i].insert(sample.data);
+                insert_unique_value(shard, channel_i, sample.data);
             }
         });
 }
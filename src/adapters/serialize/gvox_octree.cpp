@@ -1,13 +1,16 @@
 #include <gvox/gvox.h>
 // #include <gvox/adapters/serialize/gvox_octree.h>
 #include "../shared/gvox_octree.hpp"
+#include "../shared/staging_buffer.hpp"
 
 #include <bit>
 #include <variant>
 
+using namespace gvox_detail::staging_buffer;
+
 struct OctreeUserState {
     GvoxRegionRange range{};
-    std::vector<uint32_t> voxels;
+    StagingArray<uint32_t> voxels;
     size_t offset{};
     uint32_t max_depth{};
 };
@@ -44,7 +47,7 @@ extern "C" void gvox_serialize_adapter_gvox_octree_blit_begin(GvoxBlitContext *b
 
     user_state.max_depth = ceil_log2(std::max({range->extent.x, range->extent.y, range->extent.z}));
 
-    user_state.voxels.resize(range->extent.x * range->extent.y * range->extent.z);
+    user_state.voxels.allocate(ctx, static_cast<size_t>(range->extent.x) * range->extent.y * range->extent.z);
 }
 
 void do_output(OctreeUserState &user_state, uint32_t my_output_index, std::vector<OctreeNode> &output, std::vector<std::vector<OctreeTempNode>> const &levels, uint32_t depth, uint32_t max_depth, uint32_t x, uint32_t y, uint32_t z) {
@@ -90,6 +93,9 @@ void do_output(OctreeUserState &user_state, uint32_t my_output_index, std::vecto
 
 extern "C" void gvox_serialize_adapter_gvox_octree_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<OctreeUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (user_state.voxels.data() == nullptr) {
+        return;
+    }
 
     auto levels = std::vector<std::vector<OctreeTempNode>>{};
     levels.resize(user_state.max_depth);
@@ -173,14 +179,20 @@ extern "C" void gvox_serialize_adapter_gvox_octree_blit_end(GvoxBlitContext *bli
     do_output(user_state, 0, output, levels, 0, user_state.max_depth, 0, 0, 0);
 
     auto node_count = static_cast<uint32_t>(output.size());
-    gvox_output_write(blit_ctx, user_state.offset, sizeof(node_count), &node_count);
-    user_state.offset += sizeof(node_count);
-
-    gvox_output_write(blit_ctx, user_state.offset, output.size() * sizeof(output[0]), output.data());
+    auto const iovs = std::array<GvoxIoVec, 2>{
+        GvoxIoVec{.position = user_state.offset, .size = sizeof(node_count), .data = &node_count},
+        GvoxIoVec{.position = user_state.offset + sizeof(node_count), .size = output.size() * sizeof(output[0]), .data = output.data()},
+    };
+    gvox_output_writev(blit_ctx, iovs.data(), iovs.size());
+    user_state.offset += sizeof(node_count) + output.size() * sizeof(output[0]);
+    user_state.voxels.release();
 }
 
 namespace {
     void handle_region(OctreeUserState &user_state, GvoxRegionRange const *range, auto user_func) {
+        if (user_state.voxels.data() == nullptr) {
+            return;
+        }
         for (uint32_t zi = 0; zi < range->extent.z; ++zi) {
             for (uint32_t yi = 0; yi < range->extent.y; ++yi) {
                 for (uint32_t xi = 0; xi < range->extent.x; ++xi) {
@@ -3,6 +3,7 @@
 
 #include "../shared/gvox_palette.hpp"
 #include "../shared/thread_pool.hpp"
+#include "../shared/per_thread.hpp"
 
 #include <cstdlib>
 #include <cstdint>
@@ -11,56 +12,119 @@
 #include <array>
 #include <vector>
 #include <new>
-#include <unordered_set>
 #include <algorithm>
 #include <memory>
 #include <mutex>
-#include <chrono>
 
 using namespace gvox_detail::thread_pool;
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-using namespace std::chrono_literals;
-#endif
+using namespace gvox_detail::per_thread;
 
+// A region's storage is region_voxel_n values, followed by a bitmask of
+// which of them have been sampled as present. It's only allocated once
+// something in the region is present, and voxels that never are stay 0.
+// As soon as every voxel in the region is present, it's encoded and its
+// storage is reused, so `voxels` then points to its blob (if it has one).
 struct PaletteRegion {
-    std::unordered_set<uint32_t> palette{};
-    std::unique_ptr<std::array<std::pair<uint32_t, bool>, REGION_SIZE * REGION_SIZE * REGION_SIZE>> data{};
+    uint32_t *voxels{};
     uint32_t accounted_for{};
+    bool is_encoded{};
+    ChannelHeader encoded_header{};
 };
 
-using PaletteRegionChannels = std::vector<PaletteRegion>;
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-using PaletteRegionChannelsMutexes = std::vector<std::mutex>;
-#endif
+// Regions received from a parse-driven blit can come in from many threads
+// at once and overlap, so they're locked by hashing onto one of these
+static constexpr auto REGION_LOCK_N = size_t{64};
+// How many tiles each worker gets in a serialize-driven blit, on average, so
+// that workers that finish early can pick up the slack
+static constexpr auto TILES_PER_WORKER = uint32_t{4};
+
+static constexpr auto ARENA_BLOCK_WORD_N = size_t{1} << 18;
+
+// Hands out zeroed memory that lives until the end of the blit. Each thread
+// that samples regions gets its own, so that allocating never takes a lock.
+struct RegionArena {
+    std::vector<std::unique_ptr<uint32_t[]>> blocks{};
+    size_t block_word_n{};
+    size_t used_word_n{};
+    // Storage of regions that have been encoded, ready to be handed out again
+    std::vector<uint32_t *> free_regions{};
+
+    auto allocate(size_t word_n) -> uint32_t * {
+        if (blocks.empty() || used_word_n + word_n > block_word_n) {
+            block_word_n = std::max(ARENA_BLOCK_WORD_N, word_n);
+            blocks.push_back(std::make_unique<uint32_t[]>(block_word_n));
+            used_word_n = 0;
+        }
+        auto *result = blocks.back().get() + used_word_n;
+        used_word_n += word_n;
+        return result;
+    }
+
+    auto allocate_region(size_t word_n) -> uint32_t * {
+        if (free_regions.empty()) {
+            return allocate(word_n);
+        }
+        auto *result = free_regions.back();
+        free_regions.pop_back();
+        std::fill(result, result + word_n, 0u);
+        return result;
+    }
+};
 
 struct GvoxPaletteSerializeUserState {
+    uint32_t region_size = DEFAULT_REGION_SIZE;
+    size_t region_voxel_n{};
+    size_t max_compressed_variant_n{};
+    uint32_t super_chunk_size{};
+    // The open-addressing palette has 2^palette_table_bits slots, which is
+    // at least twice as many as a region has voxels
+    uint32_t palette_table_bits{};
+
     GvoxRegionRange range{};
     size_t offset{};
-    size_t blobs_begin{};
-    size_t blob_size_offset{};
-    std::vector<uint8_t> data{};
     std::vector<uint8_t> channels{};
     uint32_t region_nx{};
     uint32_t region_ny{};
     uint32_t region_nz{};
-    std::vector<PaletteRegionChannels> palette_region_channels{};
+    uint32_t super_chunk_nx{};
+    uint32_t super_chunk_ny{};
+    uint32_t super_chunk_nz{};
+    // Indexed by region_index * channel_n + channel_index
+    std::vector<PaletteRegion> palette_regions{};
 #if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-    std::unique_ptr<PaletteRegionChannelsMutexes> palette_region_channels_mutexes{};
+    std::array<std::mutex, REGION_LOCK_N> region_locks{};
 #endif
+
+    PerThread<RegionArena> arenas{};
+
     ThreadPool thread_pool{};
 };
 
-template <typename T>
-static void write_data(uint8_t *&buffer_ptr, T const &data) {
-    *reinterpret_cast<T *>(buffer_ptr) = data;
-    buffer_ptr += sizeof(T);
+static auto presence_words(GvoxPaletteSerializeUserState const &user_state, PaletteRegion const &palette_region) -> uint32_t * {
+    return palette_region.voxels + user_state.region_voxel_n;
+}
+
+static auto region_storage_word_n(GvoxPaletteSerializeUserState const &user_state) -> size_t {
+    return user_state.region_voxel_n + (user_state.region_voxel_n + 31) / 32;
 }
 
 // Base
-extern "C" void gvox_serialize_adapter_gvox_palette_create(GvoxAdapterContext *ctx, void const * /*unused*/) {
+extern "C" void gvox_serialize_adapter_gvox_palette_create(GvoxAdapterContext *ctx, void const *config) {
     auto *user_state_ptr = malloc(sizeof(GvoxPaletteSerializeUserState));
-    new (user_state_ptr) GvoxPaletteSerializeUserState();
+    auto &user_state = *(new (user_state_ptr) GvoxPaletteSerializeUserState());
     gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    if (config != nullptr && static_cast<GvoxPaletteSerializeAdapterConfig const *>(config)->region_size != 0) {
+        auto const region_size = static_cast<GvoxPaletteSerializeAdapterConfig const *>(config)->region_size;
+        if (is_valid_region_size(region_size)) {
+            user_state.region_size = region_size;
+        } else {
+            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_INVALID_PARAMETER, "gvox palette region size must be a power of two, no larger than 32");
+        }
+    }
+    user_state.region_voxel_n = size_t{user_state.region_size} * user_state.region_size * user_state.region_size;
+    user_state.max_compressed_variant_n = calc_max_compressed_variant_n(user_state.region_size);
+    user_state.super_chunk_size = calc_super_chunk_size(user_state.region_size);
+    user_state.palette_table_bits = static_cast<uint32_t>(std::bit_width(user_state.region_voxel_n));
 }
 
 extern "C" void gvox_serialize_adapter_gvox_palette_destroy(GvoxAdapterContext *ctx) {
@@ -71,18 +135,21 @@ extern "C" void gvox_serialize_adapter_gvox_palette_destroy(GvoxAdapterContext *
 
 extern "C" void gvox_serialize_adapter_gvox_palette_blit_begin(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t channel_flags) {
     auto &user_state = *static_cast<GvoxPaletteSerializeUserState *>(gvox_adapter_get_user_pointer(ctx));
-    auto magic = std::bit_cast<uint32_t>(std::array<char, 4>{'g', 'v', 'p', '\0'});
+    auto magic = PALETTE_MAGIC_V2;
     auto channel_n = static_cast<uint32_t>(std::popcount(channel_flags));
+    user_state.offset = 0;
     gvox_output_write(blit_ctx, user_state.offset, sizeof(uint32_t), &magic);
     user_state.offset += sizeof(magic);
     gvox_output_write(blit_ctx, user_state.offset, sizeof(*range), range);
     user_state.offset += sizeof(*range);
-    user_state.blob_size_offset = user_state.offset;
-    user_state.offset += sizeof(uint32_t);
     gvox_output_write(blit_ctx, user_state.offset, sizeof(channel_flags), &channel_flags);
     user_state.offset += sizeof(channel_flags);
     gvox_output_write(blit_ctx, user_state.offset, sizeof(channel_n), &channel_n);
     user_state.offset += sizeof(channel_n);
+    gvox_output_write(blit_ctx, user_state.offset, sizeof(user_state.region_size), &user_state.region_size);
+    user_state.offset += sizeof(user_state.region_size);
+    gvox_output_write(blit_ctx, user_state.offset, sizeof(user_state.super_chunk_size), &user_state.super_chunk_size);
+    user_state.offset += sizeof(user_state.super_chunk_size);
     user_state.channels.resize(static_cast<size_t>(channel_n));
     uint32_t next_channel = 0;
     for (uint8_t channel_i = 0; channel_i < 32; ++channel_i) {
@@ -92,163 +159,319 @@ extern "C" void gvox_serialize_adapter_gvox_palette_blit_begin(GvoxBlitContext *
         }
     }
     user_state.range = *range;
-    user_state.region_nx = (range->extent.x + REGION_SIZE - 1) / REGION_SIZE;
-    user_state.region_ny = (range->extent.y + REGION_SIZE - 1) / REGION_SIZE;
-    user_state.region_nz = (range->extent.z + REGION_SIZE - 1) / REGION_SIZE;
-    auto size = (sizeof(ChannelHeader) * user_state.channels.size()) * user_state.region_nx * user_state.region_ny * user_state.region_nz;
-    user_state.blobs_begin = size;
-    user_state.palette_region_channels.resize(user_state.region_nx * user_state.region_ny * user_state.region_nz);
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-    user_state.palette_region_channels_mutexes = std::make_unique<PaletteRegionChannelsMutexes>(user_state.region_nx * user_state.region_ny * user_state.region_nz * user_state.channels.size());
-#endif
-    user_state.data.resize(size);
+    user_state.region_nx = (range->extent.x + user_state.region_size - 1) / user_state.region_size;
+    user_state.region_ny = (range->extent.y + user_state.region_size - 1) / user_state.region_size;
+    user_state.region_nz = (range->extent.z + user_state.region_size - 1) / user_state.region_size;
+    user_state.super_chunk_nx = (user_state.region_nx + user_state.super_chunk_size - 1) / user_state.super_chunk_size;
+    user_state.super_chunk_ny = (user_state.region_ny + user_state.super_chunk_size - 1) / user_state.super_chunk_size;
+    user_state.super_chunk_nz = (user_state.region_nz + user_state.super_chunk_size - 1) / user_state.super_chunk_size;
+    auto const region_n = static_cast<size_t>(user_state.region_nx) * user_state.region_ny * user_state.region_nz;
+    user_state.palette_regions.assign(region_n * channel_n, PaletteRegion{});
+    user_state.arenas.begin_blit();
+}
+
+// Scratch space for encoding regions, which each thread reuses from one region to the next
+struct EncodeScratch {
+    // The open-addressing palette. A slot is only in use if its stamp is the
+    // current one, so that it never has to be cleared.
+    std::vector<uint32_t> slot_values{};
+    std::vector<uint32_t> slot_stamps{};
+    // Maps each used slot to its value's index in the sorted palette
+    std::vector<uint32_t> slot_palette_ids{};
+    uint32_t stamp{};
+    // The slot of each voxel's value
+    std::vector<uint32_t> voxel_slots{};
+    std::vector<uint32_t> palette{};
+};
+
+static auto find_palette_slot(EncodeScratch const &scratch, uint32_t table_bits, uint32_t value) -> uint32_t {
+    auto const slot_mask = (1u << table_bits) - 1u;
+    auto slot = (value * 0x9e3779b1u) >> (32 - table_bits);
+    while (scratch.slot_stamps[slot] == scratch.stamp && scratch.slot_values[slot] != value) {
+        slot = (slot + 1) & slot_mask;
+    }
+    return slot;
+}
+
+// Collects the distinct values of a region into the thread's scratch palette, in the order they're found
+static auto gather_palette(GvoxPaletteSerializeUserState const &user_state, PaletteRegion const &palette_region) -> EncodeScratch & {
+    thread_local auto scratch = EncodeScratch{};
+    auto const voxel_n = user_state.region_voxel_n;
+    auto const table_size = size_t{1} << user_state.palette_table_bits;
+    if (scratch.slot_values.size() < table_size) {
+        scratch.slot_values.resize(table_size);
+        scratch.slot_stamps.assign(table_size, 0u);
+        scratch.slot_palette_ids.resize(table_size);
+        scratch.stamp = 0;
+    }
+    scratch.voxel_slots.resize(voxel_n);
+    if (++scratch.stamp == 0) {
+        std::fill(scratch.slot_stamps.begin(), scratch.slot_stamps.end(), 0u);
+        scratch.stamp = 1;
+    }
+    // Voxels that weren't present are already 0, so they end up in the palette as 0
+    scratch.palette.clear();
+    for (size_t voxel_i = 0; voxel_i < voxel_n; ++voxel_i) {
+        auto const value = palette_region.voxels[voxel_i];
+        auto const slot = find_palette_slot(scratch, user_state.palette_table_bits, value);
+        if (scratch.slot_stamps[slot] != scratch.stamp) {
+            scratch.slot_stamps[slot] = scratch.stamp;
+            scratch.slot_values[slot] = value;
+            scratch.palette.push_back(value);
+        }
+        scratch.voxel_slots[voxel_i] = slot;
+    }
+    return scratch;
+}
+
+static auto region_blob_size(GvoxPaletteSerializeUserState const &user_state, ChannelHeader const &region_header) -> size_t {
+    if (region_header.variant_n <= 1) {
+        return 0;
+    }
+    if (region_header.variant_n > user_state.max_compressed_variant_n) {
+        return calc_region_allocation_size(user_state.region_size);
+    }
+    return sizeof(uint32_t) * region_header.variant_n + calc_palette_region_size(ceil_log2(region_header.variant_n), user_state.region_size);
+}
+
+// Works out a region's header, giving it the next `blob_size` bytes of the blob if it isn't uniform
+static auto measure_region(GvoxPaletteSerializeUserState const &user_state, PaletteRegion const &palette_region, size_t &blob_size) -> ChannelHeader {
+    if (palette_region.is_encoded) {
+        auto region_header = palette_region.encoded_header;
+        if (region_header.variant_n > 1) {
+            region_header.blob_offset = static_cast<uint32_t>(blob_size);
+            blob_size += region_blob_size(user_state, region_header);
+        }
+        return region_header;
+    }
+    if (palette_region.voxels == nullptr) {
+        return ChannelHeader{.variant_n = 1u, .blob_offset = 0u};
+    }
+    auto const &scratch = gather_palette(user_state, palette_region);
+    auto region_header = ChannelHeader{.variant_n = static_cast<uint32_t>(scratch.palette.size()), .blob_offset = scratch.palette[0]};
+    if (region_header.variant_n > 1) {
+        region_header.blob_offset = static_cast<uint32_t>(blob_size);
+        blob_size += region_blob_size(user_state, region_header);
+    }
+    return region_header;
+}
+
+// Encodes a non-uniform region into the `region_blob_size` bytes at `output_buffer`
+static void write_region(GvoxPaletteSerializeUserState const &user_state, PaletteRegion const &palette_region, ChannelHeader const &region_header, uint8_t *output_buffer) {
+    if (palette_region.is_encoded) {
+        auto const *blob_bytes = reinterpret_cast<uint8_t const *>(palette_region.voxels);
+        std::copy(blob_bytes, blob_bytes + region_blob_size(user_state, region_header), output_buffer);
+        return;
+    }
+    if (region_header.variant_n > user_state.max_compressed_variant_n) {
+        auto const *voxel_bytes = reinterpret_cast<uint8_t const *>(palette_region.voxels);
+        std::copy(voxel_bytes, voxel_bytes + calc_region_allocation_size(user_state.region_size), output_buffer);
+        return;
+    }
+    auto &scratch = gather_palette(user_state, palette_region);
+    auto const bits_per_variant = ceil_log2(region_header.variant_n);
+    // The palette is stored sorted, so that the output doesn't depend on the order voxels were sampled in
+    std::sort(scratch.palette.begin(), scratch.palette.end());
+    for (uint32_t palette_id = 0; palette_id < region_header.variant_n; ++palette_id) {
+        scratch.slot_palette_ids[find_palette_slot(scratch, user_state.palette_table_bits, scratch.palette[palette_id])] = palette_id;
+    }
+    std::copy(scratch.palette.begin(), scratch.palette.end(), reinterpret_cast<uint32_t *>(output_buffer));
+    output_buffer += sizeof(uint32_t) * region_header.variant_n;
+    auto *const output_end = output_buffer + calc_palette_region_size(bits_per_variant, user_state.region_size);
+    // Indices are packed LSB first, bits_per_variant each
+    auto bits = uint64_t{0};
+    auto bit_n = uint32_t{0};
+    for (size_t voxel_i = 0; voxel_i < user_state.region_voxel_n; ++voxel_i) {
+        bits |= uint64_t{scratch.slot_palette_ids[scratch.voxel_slots[voxel_i]]} << bit_n;
+        bit_n += bits_per_variant;
+        while (bit_n >= 8) {
+            *output_buffer++ = static_cast<uint8_t>(bits);
+            bits >>= 8;
+            bit_n -= 8;
+        }
+    }
+    if (bit_n > 0) {
+        *output_buffer++ = static_cast<uint8_t>(bits);
+    }
+    std::fill(output_buffer, output_end, uint8_t{0});
+}
+
+// Encodes a region whose voxels are all accounted for, so that its storage
+// can be reused rather than held on to until blit_end
+static void encode_complete_region(GvoxPaletteSerializeUserState &user_state, PaletteRegion &palette_region) {
+    auto &arena = user_state.arenas.get();
+    auto blob_size = size_t{0};
+    auto const region_header = measure_region(user_state, palette_region, blob_size);
+    uint32_t *blob = nullptr;
+    if (blob_size != 0) {
+        // Blob sizes are always a whole number of words
+        blob = arena.allocate(blob_size / sizeof(uint32_t));
+        write_region(user_state, palette_region, region_header, reinterpret_cast<uint8_t *>(blob));
+    }
+    // Regions with nothing present never got any storage
+    if (palette_region.voxels != nullptr) {
+        arena.free_regions.push_back(palette_region.voxels);
+    }
+    palette_region.voxels = blob;
+    palette_region.encoded_header = region_header;
+    palette_region.is_encoded = true;
+}
+
+// Where everything in a super-chunk goes, which is worked out before any of it is written
+struct SuperChunkLayout {
+    GvoxExtent3D region_extent{};
+    std::vector<ChannelHeader> region_headers{};
+    size_t blob_size{};
+    // Where the super-chunk starts within the output, or 0 if it's uniform and has no data
+    size_t offset{};
+};
+
+static void for_each_super_chunk_region(GvoxPaletteSerializeUserState const &user_state, uint32_t sxi, uint32_t syi, uint32_t szi, SuperChunkLayout const &layout, auto const &func) {
+    auto const super_chunk_size = user_state.super_chunk_size;
+    for (uint32_t lzi = 0; lzi < layout.region_extent.z; ++lzi) {
+        for (uint32_t lyi = 0; lyi < layout.region_extent.y; ++lyi) {
+            for (uint32_t lxi = 0; lxi < layout.region_extent.x; ++lxi) {
+                auto const rxi = sxi * super_chunk_size + lxi;
+                auto const ryi = syi * super_chunk_size + lyi;
+                auto const rzi = szi * super_chunk_size + lzi;
+                auto const region_index = rxi + ryi * size_t{user_state.region_nx} + rzi * size_t{user_state.region_nx} * user_state.region_ny;
+                auto const local_region_index = lxi + lyi * size_t{layout.region_extent.x} + lzi * size_t{layout.region_extent.x} * layout.region_extent.y;
+                func(region_index, local_region_index);
+            }
+        }
+    }
+}
+
+// Fills out a super-chunk's region headers and blob size. `summaries` gets
+// one ChannelHeader per channel (see SuperChunkIndexEntry), and the blob
+// size is left at 0 if every channel turns out to be uniform.
+static void measure_super_chunk(GvoxPaletteSerializeUserState const &user_state, uint32_t sxi, uint32_t syi, uint32_t szi, SuperChunkLayout &layout, ChannelHeader *summaries) {
+    auto const channel_n = user_state.channels.size();
+    auto const super_chunk_size = user_state.super_chunk_size;
+    layout.region_extent = GvoxExtent3D{
+        std::min(super_chunk_size, user_state.region_nx - sxi * super_chunk_size),
+        std::min(super_chunk_size, user_state.region_ny - syi * super_chunk_size),
+        std::min(super_chunk_size, user_state.region_nz - szi * super_chunk_size),
+    };
+    layout.region_headers.resize(static_cast<size_t>(layout.region_extent.x) * layout.region_extent.y * layout.region_extent.z * channel_n);
+    layout.blob_size = 0;
+    for (size_t ci = 0; ci < channel_n; ++ci) {
+        summaries[ci] = ChannelHeader{.variant_n = 1u, .blob_offset = 0u};
+    }
+    for_each_super_chunk_region(user_state, sxi, syi, szi, layout, [&](size_t region_index, size_t local_region_index) {
+        for (size_t ci = 0; ci < channel_n; ++ci) {
+            auto const region_header = measure_region(user_state, user_state.palette_regions[region_index * channel_n + ci], layout.blob_size);
+            layout.region_headers[local_region_index * channel_n + ci] = region_header;
+            auto &summary = summaries[ci];
+            if (region_header.variant_n != 1) {
+                summary.variant_n = 0;
+            } else if (local_region_index == 0) {
+                summary.blob_offset = region_header.blob_offset;
+            } else if (summary.blob_offset != region_header.blob_offset) {
+                summary.variant_n = 0;
+            }
+        }
+    });
+    if (std::all_of(summaries, summaries + channel_n, [](ChannelHeader const &summary) { return summary.variant_n == 1; })) {
+        layout.region_headers.clear();
+    }
+}
+
+// Writes a non-uniform super-chunk's region headers and blobs to `output_buffer`
+static void write_super_chunk(GvoxPaletteSerializeUserState const &user_state, uint32_t sxi, uint32_t syi, uint32_t szi, SuperChunkLayout const &layout, uint8_t *output_buffer) {
+    auto const channel_n = user_state.channels.size();
+    auto const headers_size = layout.region_headers.size() * sizeof(ChannelHeader);
+    std::copy(reinterpret_cast<uint8_t const *>(layout.region_headers.data()), reinterpret_cast<uint8_t const *>(layout.region_headers.data()) + headers_size, output_buffer);
+    auto *blob = output_buffer + headers_size;
+    for_each_super_chunk_region(user_state, sxi, syi, szi, layout, [&](size_t region_index, size_t local_region_index) {
+        for (size_t ci = 0; ci < channel_n; ++ci) {
+            auto const &region_header = layout.region_headers[local_region_index * channel_n + ci];
+            if (region_header.variant_n > 1) {
+                write_region(user_state, user_state.palette_regions[region_index * channel_n + ci], region_header, blob + region_header.blob_offset);
+            }
+        }
+    });
 }
 
 extern "C" void gvox_serialize_adapter_gvox_palette_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<GvoxPaletteSerializeUserState *>(gvox_adapter_get_user_pointer(ctx));
-    auto const two_percent_raw_size = static_cast<size_t>(user_state.range.extent.x * user_state.range.extent.y * user_state.range.extent.z) * sizeof(uint32_t) * user_state.channels.size() / 50;
-    user_state.data.reserve(user_state.offset + two_percent_raw_size);
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-    std::mutex data_mutex;
-#endif
-    user_state.thread_pool.start();
-    for (uint32_t rzi = 0; rzi < user_state.region_nz; ++rzi) {
-        for (uint32_t ryi = 0; ryi < user_state.region_ny; ++ryi) {
-            for (uint32_t rxi = 0; rxi < user_state.region_nx; ++rxi) {
-                auto &palette_region_channel = user_state.palette_region_channels[rxi + ryi * user_state.region_nx + rzi * user_state.region_nx * user_state.region_ny];
-                for (uint32_t ci = 0; ci < user_state.channels.size(); ++ci) {
-                    auto region_header = ChannelHeader{.variant_n = 1u, .blob_offset = 0u};
-                    auto size = size_t{0};
-                    auto local_data = std::vector<uint8_t>{};
-                    auto alloc_region = [&]() {
-                        {
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-                            auto lock = std::lock_guard{data_mutex};
-#endif
-                            auto const old_size = user_state.data.size();
-                            region_header.blob_offset = static_cast<uint32_t>(old_size - user_state.blobs_begin);
-                            user_state.data.resize(old_size + size);
-                        }
-                        local_data.resize(size);
-                    };
-                    if (palette_region_channel.size() == user_state.channels.size()) {
-                        auto &palette_region = palette_region_channel.at(ci);
-                        if (palette_region.accounted_for != 0 && palette_region.accounted_for != REGION_SIZE * REGION_SIZE * REGION_SIZE) {
-                            palette_region.palette.insert(0u);
-                            for (uint32_t zi = 0; zi < REGION_SIZE; ++zi) {
-                                for (uint32_t yi = 0; yi < REGION_SIZE; ++yi) {
-                                    for (uint32_t xi = 0; xi < REGION_SIZE; ++xi) {
-                                        auto &[u32_voxel, is_present] = (*palette_region.data)[xi + yi * REGION_SIZE + zi * REGION_SIZE * REGION_SIZE];
-                                        if (!is_present) {
-                                            u32_voxel = 0u;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                        region_header.variant_n = static_cast<uint32_t>(palette_region.palette.size());
-                        auto bits_per_variant = ceil_log2(region_header.variant_n);
-                        if (region_header.variant_n > MAX_REGION_COMPRESSED_VARIANT_N) {
-                            size = MAX_REGION_ALLOCATION_SIZE;
-                            alloc_region();
-                            uint8_t *output_buffer = local_data.data();
-                            for (uint32_t zi = 0; zi < REGION_SIZE; ++zi) {
-                                for (uint32_t yi = 0; yi < REGION_SIZE; ++yi) {
-                                    for (uint32_t xi = 0; xi < REGION_SIZE; ++xi) {
-                                        auto [u32_voxel, is_present] = (*palette_region.data)[xi + yi * REGION_SIZE + zi * REGION_SIZE * REGION_SIZE];
-                                        write_data<uint32_t>(output_buffer, u32_voxel);
-                                    }
-                                }
-                            }
-                        } else if (region_header.variant_n > 1) {
-                            // insert palette
-                            size += sizeof(uint32_t) * region_header.variant_n;
-                            // insert palette region
-                            size += calc_palette_region_size(bits_per_variant);
-                            alloc_region();
-                            uint8_t *output_buffer = local_data.data();
-                            auto *palette_begin = reinterpret_cast<uint32_t *>(output_buffer);
-                            auto *palette_end = palette_begin + region_header.variant_n;
-                            for (auto u32_voxel : palette_region.palette) {
-                                write_data<uint32_t>(output_buffer, u32_voxel);
-                            }
-                            std::sort(palette_begin, palette_end);
-                            for (uint32_t zi = 0; zi < REGION_SIZE; ++zi) {
-                                for (uint32_t yi = 0; yi < REGION_SIZE; ++yi) {
-                                    for (uint32_t xi = 0; xi < REGION_SIZE; ++xi) {
-                                        auto const in_region_index = xi + yi * REGION_SIZE + zi * REGION_SIZE * REGION_SIZE;
-                                        auto const [u32_voxel, is_present] = (*palette_region.data)[in_region_index];
-                                        auto *iter = std::lower_bound(palette_begin, palette_end, u32_voxel);
-                                        auto palette_id = static_cast<uint32_t>(iter - palette_begin);
-                                        auto const bit_index = static_cast<size_t>(in_region_index) * bits_per_variant;
-                                        auto const byte_index = bit_index / 8;
-                                        auto const bit_offset = static_cast<uint32_t>(bit_index - byte_index * 8);
-                                        auto const mask = get_mask(bits_per_variant);
-                                        if (output_buffer + byte_index + 3 >= local_data.data() + local_data.size()) {
-                                            gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_PARSE_ADAPTER_INVALID_INPUT, "Trying to write past end of buffer, how did this happen?");
-                                            return;
-                                        }
-#if 0
-                                        // Note: This is technically UB, since I think it breaks the strict aliasing rules of C++.
-                                        auto &output = *reinterpret_cast<uint32_t *>(output_buffer + byte_index);
-                                        output = output & ~(mask << bit_offset);
-                                        output = output | static_cast<uint32_t>(palette_id << bit_offset);
-                                        // The "correct" solution is below.
-#else
-                                        auto prev_val = std::bit_cast<uint32_t>(*reinterpret_cast<std::array<uint8_t, 4> *>(output_buffer + byte_index));
-                                        auto output = prev_val & ~(mask << bit_offset);
-                                        output = output | static_cast<uint32_t>(palette_id << bit_offset);
-                                        auto output_bytes = std::bit_cast<std::array<uint8_t, 4>>(output);
-                                        std::copy(output_bytes.begin(), output_bytes.end(), output_buffer + byte_index);
-#endif
-                                    }
-                                }
-                            }
-                        } else if (region_header.variant_n == 1) {
-                            region_header.blob_offset = *palette_region.palette.begin();
-                        } else {
-                            region_header.blob_offset = 0;
-                        }
-                    } else {
-                        region_header.blob_offset = 0;
-                    }
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-                    auto lock = std::lock_guard{data_mutex};
-#endif
-                    auto *channel_header_ptr =
-                        user_state.data.data() +
-                        (rxi + ryi * user_state.region_nx + rzi * user_state.region_nx * user_state.region_ny) *
-                            (sizeof(ChannelHeader) * user_state.channels.size()) +
-                        (sizeof(ChannelHeader) * ci);
-                    write_data<ChannelHeader>(channel_header_ptr, region_header);
-                    if (region_header.variant_n > 1) {
-                        std::copy(local_data.begin(), local_data.end(), user_state.data.data() + user_state.blobs_begin + region_header.blob_offset);
-                    }
+    auto const channel_n = user_state.channels.size();
+    auto const super_chunk_n = static_cast<size_t>(user_state.super_chunk_nx) * user_state.super_chunk_ny * user_state.super_chunk_nz;
+    auto layouts = std::vector<SuperChunkLayout>(super_chunk_n);
+    auto summaries = std::vector<ChannelHeader>(super_chunk_n * channel_n);
+    auto const for_each_super_chunk = [&](auto const &func) {
+        for (uint32_t szi = 0; szi < user_state.super_chunk_nz; ++szi) {
+            for (uint32_t syi = 0; syi < user_state.super_chunk_ny; ++syi) {
+                for (uint32_t sxi = 0; sxi < user_state.super_chunk_nx; ++sxi) {
+                    func(sxi, syi, szi, sxi + syi * size_t{user_state.super_chunk_nx} + szi * size_t{user_state.super_chunk_nx} * user_state.super_chunk_ny);
                 }
             }
         }
+    };
+
+    // Everything is sized first, so that every super-chunk knows where it
+    // goes, and can then be encoded straight into place without any locking
+    user_state.thread_pool.start();
+    for_each_super_chunk([&](uint32_t sxi, uint32_t syi, uint32_t szi, size_t super_chunk_index) {
+        user_state.thread_pool.enqueue([&, sxi, syi, szi, super_chunk_index]() {
+            measure_super_chunk(user_state, sxi, syi, szi, layouts[super_chunk_index], summaries.data() + super_chunk_index * channel_n);
+        });
+    });
+    user_state.thread_pool.wait();
+
+    // The index and summaries go right after the header, and the super-chunks after them
+    auto const index_size = super_chunk_n * sizeof(SuperChunkIndexEntry);
+    auto const summaries_size = summaries.size() * sizeof(ChannelHeader);
+    auto size = index_size + summaries_size;
+    for (auto &layout : layouts) {
+        if (!layout.region_headers.empty()) {
+            layout.offset = size;
+            size += layout.region_headers.size() * sizeof(ChannelHeader) + layout.blob_size;
+        }
     }
-    while (user_state.thread_pool.busy()) {
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-        std::this_thread::sleep_for(10ms);
-#endif
+    gvox_output_reserve(blit_ctx, user_state.offset + size);
+    auto staging = std::vector<uint8_t>{};
+    auto *output_buffer = static_cast<uint8_t *>(gvox_output_map(blit_ctx, user_state.offset, size));
+    if (output_buffer == nullptr) {
+        staging.resize(size);
+        output_buffer = staging.data();
     }
+
+    auto *index = reinterpret_cast<SuperChunkIndexEntry *>(output_buffer);
+    for (size_t i = 0; i < super_chunk_n; ++i) {
+        auto const &layout = layouts[i];
+        auto const entry = layout.region_headers.empty()
+                               ? SuperChunkIndexEntry{.offset = 0, .size = 0}
+                               : SuperChunkIndexEntry{.offset = user_state.offset + layout.offset, .size = layout.region_headers.size() * sizeof(ChannelHeader) + layout.blob_size};
+        std::copy(reinterpret_cast<uint8_t const *>(&entry), reinterpret_cast<uint8_t const *>(&entry) + sizeof(entry), reinterpret_cast<uint8_t *>(index + i));
+    }
+    std::copy(reinterpret_cast<uint8_t const *>(summaries.data()), reinterpret_cast<uint8_t const *>(summaries.data()) + summaries_size, output_buffer + index_size);
+    for_each_super_chunk([&](uint32_t sxi, uint32_t syi, uint32_t szi, size_t super_chunk_index) {
+        if (!layouts[super_chunk_index].region_headers.empty()) {
+            user_state.thread_pool.enqueue([&, sxi, syi, szi, super_chunk_index]() {
+                auto const &layout = layouts[super_chunk_index];
+                write_super_chunk(user_state, sxi, syi, szi, layout, output_buffer + layout.offset);
+            });
+        }
+    });
+    user_state.thread_pool.wait();
     user_state.thread_pool.stop();
-    auto blob_size = static_cast<uint32_t>(user_state.data.size() - user_state.blobs_begin);
-    gvox_output_write(blit_ctx, user_state.blob_size_offset, sizeof(blob_size), &blob_size);
-    gvox_output_write(blit_ctx, user_state.offset, user_state.data.size(), user_state.data.data());
+
+    if (!staging.empty()) {
+        gvox_output_write(blit_ctx, user_state.offset, staging.size(), staging.data());
+    }
+    user_state.palette_regions.clear();
+    user_state.arenas.clear();
 }
 
 static void handle_single_palette(
     GvoxBlitContext *blit_ctx, GvoxPaletteSerializeUserState &user_state, PaletteRegion &palette_region,
-    GvoxRegion *region_ptr, uint32_t channel_id, uint32_t ox, uint32_t oy, uint32_t oz) {
-    if (!palette_region.data) {
-        palette_region.data = std::make_unique<decltype(PaletteRegion::data)::element_type>(decltype(PaletteRegion::data)::element_type{});
-    }
-    for (uint32_t zi = 0; zi < REGION_SIZE; ++zi) {
-        for (uint32_t yi = 0; yi < REGION_SIZE; ++yi) {
-            for (uint32_t xi = 0; xi < REGION_SIZE; ++xi) {
-                auto palette_region_index = xi + yi * REGION_SIZE + zi * REGION_SIZE * REGION_SIZE;
+    GvoxRegion *region_ptr, uint32_t channel_id, uint32_t ox, uint32_t oy, uint32_t oz, bool absent_is_final) {
+    auto const region_size = user_state.region_size;
+    for (uint32_t zi = 0; zi < region_size; ++zi) {
+        for (uint32_t yi = 0; yi < region_size; ++yi) {
+            for (uint32_t xi = 0; xi < region_size; ++xi) {
+                auto palette_region_index = xi + yi * region_size + zi * region_size * region_size;
                 auto const px = ox + xi;
                 auto const py = oy + yi;
                 auto const pz = oz + zi;
@@ -257,60 +480,87 @@ static void handle_single_palette(
                     .y = static_cast<int32_t>(py) + user_state.range.offset.y,
                     .z = static_cast<int32_t>(pz) + user_state.range.offset.z,
                 };
-                if (px < user_state.range.extent.x && py < user_state.range.extent.y && pz < user_state.range.extent.z) {
-                    auto sample = gvox_sample_region(blit_ctx, region_ptr, &pos, channel_id);
-                    if (sample.is_present != 0u) {
-                        palette_region.palette.insert(sample.data);
-                        auto const [prev_u32_voxel, prev_present] = (*palette_region.data)[palette_region_index];
-                        if (!prev_present) {
-                            (*palette_region.data)[palette_region_index] = {sample.data, sample.is_present};
-                            ++palette_region.accounted_for;
-                        }
+                if (px >= user_state.range.extent.x || py >= user_state.range.extent.y || pz >= user_state.range.extent.z) {
+                    continue;
+                }
+                auto sample = gvox_sample_region(blit_ctx, region_ptr, &pos, channel_id);
+                if (sample.is_present == 0u) {
+                    if (!absent_is_final) {
+                        continue;
                     }
+                    // It stays 0, which a region without storage already is
+                    sample.data = 0u;
+                    if (palette_region.voxels == nullptr) {
+                        ++palette_region.accounted_for;
+                        continue;
+                    }
+                }
+                if (palette_region.voxels == nullptr) {
+                    palette_region.voxels = user_state.arenas.get().allocate_region(region_storage_word_n(user_state));
+                }
+                auto &presence_word = presence_words(user_state, palette_region)[palette_region_index / 32];
+                auto const presence_bit = 1u << (palette_region_index % 32);
+                if ((presence_word & presence_bit) == 0) {
+                    presence_word |= presence_bit;
+                    palette_region.voxels[palette_region_index] = sample.data;
+                    ++palette_region.accounted_for;
                 }
             }
         }
     }
-    if (palette_region.accounted_for == 0) {
-        palette_region.data.reset();
-    }
 }
 
-static void handle_region(GvoxBlitContext *blit_ctx, GvoxPaletteSerializeUserState &user_state, GvoxRegionRange const *range, GvoxRegion *region_ptr) {
+// The regions (in region coordinates) that overlap a range, clamped to the blit's range
+struct RegionBounds {
+    uint32_t ax, ay, az;
+    uint32_t bx, by, bz;
+};
+
+static auto region_bounds(GvoxPaletteSerializeUserState const &user_state, GvoxRegionRange const &range) -> RegionBounds {
+    auto const to_region = [&user_state](int64_t rel, uint32_t extent, uint32_t round_up) -> uint32_t {
+        auto const clamped = static_cast<uint32_t>(std::clamp<int64_t>(rel, 0, extent));
+        return (clamped + round_up) / user_state.region_size;
+    };
+    auto const region_round_up = user_state.region_size - 1;
+    return {
+        .ax = to_region(int64_t{range.offset.x} - user_state.range.offset.x, user_state.range.extent.x, 0),
+        .ay = to_region(int64_t{range.offset.y} - user_state.range.offset.y, user_state.range.extent.y, 0),
+        .az = to_region(int64_t{range.offset.z} - user_state.range.offset.z, user_state.range.extent.z, 0),
+        .bx = to_region(int64_t{range.offset.x} + range.extent.x - user_state.range.offset.x, user_state.range.extent.x, region_round_up),
+        .by = to_region(int64_t{range.offset.y} + range.extent.y - user_state.range.offset.y, user_state.range.extent.y, region_round_up),
+        .bz = to_region(int64_t{range.offset.z} + range.extent.z - user_state.range.offset.z, user_state.range.extent.z, region_round_up),
+    };
+}
+
+// Samples every region within `bounds`, either from `region_ptr` or by loading each one
+static void handle_regions(GvoxBlitContext *blit_ctx, GvoxPaletteSerializeUserState &user_state, RegionBounds const &bounds, GvoxRegion *region_ptr) {
     auto temp_region = GvoxRegion{};
     if (region_ptr != nullptr) {
         temp_region = *region_ptr;
     }
-    auto range_min = GvoxOffset3D{
-        std::max(range->offset.x, user_state.range.offset.x),
-        std::max(range->offset.y, user_state.range.offset.y),
-        std::max(range->offset.z, user_state.range.offset.z),
-    };
-    auto range_max = GvoxOffset3D{
-        std::min(std::max(range->offset.x + static_cast<int32_t>(range->extent.x), user_state.range.offset.x), user_state.range.offset.x + static_cast<int32_t>(user_state.range.extent.x)),
-        std::min(std::max(range->offset.y + static_cast<int32_t>(range->extent.y), user_state.range.offset.y), user_state.range.offset.y + static_cast<int32_t>(user_state.range.extent.y)),
-        std::min(std::max(range->offset.z + static_cast<int32_t>(range->extent.z), user_state.range.offset.z), user_state.range.offset.z + static_cast<int32_t>(user_state.range.extent.z)),
-    };
-    auto rx_min = static_cast<uint32_t>(range_min.x - user_state.range.offset.x) / static_cast<uint32_t>(REGION_SIZE);
-    auto ry_min = static_cast<uint32_t>(range_min.y - user_state.range.offset.y) / static_cast<uint32_t>(REGION_SIZE);
-    auto rz_min = static_cast<uint32_t>(range_min.z - user_state.range.offset.z) / static_cast<uint32_t>(REGION_SIZE);
-    auto rx_max = static_cast<uint32_t>(range_max.x - user_state.range.offset.x + static_cast<int32_t>(REGION_SIZE) - 1) / static_cast<uint32_t>(REGION_SIZE);
-    auto ry_max = static_cast<uint32_t>(range_max.y - user_state.range.offset.y + static_cast<int32_t>(REGION_SIZE) - 1) / static_cast<uint32_t>(REGION_SIZE);
-    auto rz_max = static_cast<uint32_t>(range_max.z - user_state.range.offset.z + static_cast<int32_t>(REGION_SIZE) - 1) / static_cast<uint32_t>(REGION_SIZE);
-    for (uint32_t rzi = rz_min; rzi < rz_max; ++rzi) {
-        for (uint32_t ryi = ry_min; ryi < ry_max; ++ryi) {
-            for (uint32_t rxi = rx_min; rxi < rx_max; ++rxi) {
+    auto const region_size = user_state.region_size;
+    for (uint32_t rzi = bounds.az; rzi < bounds.bz; ++rzi) {
+        for (uint32_t ryi = bounds.ay; ryi < bounds.by; ++ryi) {
+            for (uint32_t rxi = bounds.ax; rxi < bounds.bx; ++rxi) {
+                auto const region_index = rxi + ryi * size_t{user_state.region_nx} + rzi * size_t{user_state.region_nx} * user_state.region_ny;
+                auto const channel_n = user_state.channels.size();
+                auto *const region_channels = user_state.palette_regions.data() + region_index * channel_n;
 #if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-                auto &mutex = (*user_state.palette_region_channels_mutexes)[rxi + ryi * user_state.region_nx + rzi * user_state.region_nx * user_state.region_ny];
-                auto lock = std::lock_guard{mutex};
+                // Serialize-driven tiles never share a region, but received regions can
+                auto lock = std::unique_lock<std::mutex>{};
+                if (region_ptr != nullptr) {
+                    lock = std::unique_lock{user_state.region_locks[region_index % REGION_LOCK_N]};
+                }
 #endif
-                auto &palette_region_channel = user_state.palette_region_channels[rxi + ryi * user_state.region_nx + rzi * user_state.region_nx * user_state.region_ny];
-                palette_region_channel.resize(user_state.channels.size());
-                for (uint32_t ci = 0; ci < palette_region_channel.size(); ++ci) {
-                    auto &palette_region = palette_region_channel.at(ci);
-                    auto const ox = rxi * static_cast<uint32_t>(REGION_SIZE);
-                    auto const oy = ryi * static_cast<uint32_t>(REGION_SIZE);
-                    auto const oz = rzi * static_cast<uint32_t>(REGION_SIZE);
+                // Every voxel of an encoded region is already present, so there's nothing left to sample
+                if (channel_n != 0 && region_channels[0].is_encoded) {
+                    continue;
+                }
+                for (uint32_t ci = 0; ci < channel_n; ++ci) {
+                    auto &palette_region = region_channels[ci];
+                    auto const ox = rxi * region_size;
+                    auto const oy = ryi * region_size;
+                    auto const oz = rzi * region_size;
                     auto channel_id = user_state.channels[ci];
                     auto const sample_range = GvoxRegionRange{
                         .offset = GvoxOffset3D{
@@ -318,18 +568,31 @@ static void handle_region(GvoxBlitContext *blit_ctx, GvoxPaletteSerializeUserSta
                             .y = static_cast<int32_t>(oy) + user_state.range.offset.y,
                             .z = static_cast<int32_t>(oz) + user_state.range.offset.z,
                         },
-                        .extent = GvoxExtent3D{REGION_SIZE, REGION_SIZE, REGION_SIZE},
+                        .extent = GvoxExtent3D{region_size, region_size, region_size},
                     };
                     if (region_ptr == nullptr) {
                         temp_region = gvox_load_region_range(blit_ctx, &sample_range, 1u << channel_id);
                     }
+                    // Loaded regions are sampled once, with nothing else to fill in
+                    // the voxels that aren't present, so those count as complete too.
+                    // Received regions could still be followed by one that has them.
                     handle_single_palette(
                         blit_ctx, user_state, palette_region,
-                        &temp_region, channel_id, ox, oy, oz);
+                        &temp_region, channel_id, ox, oy, oz, region_ptr == nullptr);
                     if (region_ptr == nullptr) {
                         gvox_unload_region_range(blit_ctx, &temp_region, &sample_range);
                     }
                 }
+                // Regions at the far edges of the range are only partly within it
+                auto const in_range_voxel_n =
+                    std::min(region_size, user_state.range.extent.x - rxi * region_size) *
+                    std::min(region_size, user_state.range.extent.y - ryi * region_size) *
+                    std::min(region_size, user_state.range.extent.z - rzi * region_size);
+                if (std::all_of(region_channels, region_channels + channel_n, [in_range_voxel_n](PaletteRegion const &palette_region) { return palette_region.accounted_for == in_range_voxel_n; })) {
+                    for (size_t ci = 0; ci < channel_n; ++ci) {
+                        encode_complete_region(user_state, region_channels[ci]);
+                    }
+                }
             }
         }
     }
@@ -338,38 +601,47 @@ static void handle_region(GvoxBlitContext *blit_ctx, GvoxPaletteSerializeUserSta
 // Serialize Driven
 extern "C" void gvox_serialize_adapter_gvox_palette_serialize_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t /*channel_flags*/) {
     auto &user_state = *static_cast<GvoxPaletteSerializeUserState *>(gvox_adapter_get_user_pointer(ctx));
+    auto const bounds = region_bounds(user_state, *range);
+    if (bounds.ax >= bounds.bx || bounds.ay >= bounds.by || bounds.az >= bounds.bz) {
+        return;
+    }
     user_state.thread_pool.start();
-#define IMPL(axis)                                                                                                                                   \
-    auto per_thread_size = range->extent.axis / 32;                                                                                                  \
-    if (per_thread_size > 0) {                                                                                                                       \
-        for (uint32_t i = 0; i < 32; ++i) {                                                                                                          \
-            user_state.thread_pool.enqueue([blit_ctx, &user_state, range, per_thread_size, i]() {                                                    \
-                auto temp_range = *range;                                                                                                            \
-                temp_range.extent.axis = per_thread_size;                                                                                            \
-                temp_range.offset.axis = range->offset.axis + static_cast<int32_t>(per_thread_size * i);                                             \
-                handle_region(blit_ctx, user_state, &temp_range, nullptr);                                                                           \
-            });                                                                                                                                      \
-        }                                                                                                                                            \
-    }                                                                                                                                                \
-    auto temp_range = *range;                                                                                                                        \
-    temp_range.extent.axis = range->extent.axis % 32;                                                                                                \
-    temp_range.offset.axis = range->offset.axis + static_cast<int32_t>(user_state.range.extent.axis) - static_cast<int32_t>(temp_range.extent.axis); \
-    if (range->extent.axis > 0) {                                                                                                                    \
-        handle_region(blit_ctx, user_state, &temp_range, nullptr);                                                                                   \
-    }
-    auto max_axis = std::max({range->extent.x, range->extent.y, range->extent.z});
-    if (max_axis == range->extent.x) {
-        IMPL(x)
-    } else if (max_axis == range->extent.y) {
-        IMPL(y)
-    } else {
-        IMPL(z)
-    }
-    while (user_state.thread_pool.busy()) {
-#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
-        std::this_thread::sleep_for(10ms);
-#endif
+    // The range is split into tiles of whole regions, so that no two workers
+    // ever touch the same region. The longest side of the tiles is halved
+    // until there are enough of them to go around.
+    auto tile_nx = bounds.bx - bounds.ax;
+    auto tile_ny = bounds.by - bounds.ay;
+    auto tile_nz = bounds.bz - bounds.az;
+    auto const tile_count = [&]() {
+        return static_cast<size_t>((bounds.bx - bounds.ax + tile_nx - 1) / tile_nx) *
+               ((bounds.by - bounds.ay + tile_ny - 1) / tile_ny) *
+               ((bounds.bz - bounds.az + tile_nz - 1) / tile_nz);
+    };
+    auto const target_tile_n = size_t{user_state.thread_pool.thread_count()} * TILES_PER_WORKER;
+    while (tile_count() < target_tile_n && (tile_nx > 1 || tile_ny > 1 || tile_nz > 1)) {
+        auto &longest = (tile_nx >= tile_ny && tile_nx >= tile_nz) ? tile_nx : (tile_ny >= tile_nz ? tile_ny : tile_nz);
+        longest = (longest + 1) / 2;
+    }
+    // Workers take tiles off the pool's queue as they finish, which balances
+    // out tiles that take longer than others
+    for (uint32_t tzi = bounds.az; tzi < bounds.bz; tzi += tile_nz) {
+        for (uint32_t tyi = bounds.ay; tyi < bounds.by; tyi += tile_ny) {
+            for (uint32_t txi = bounds.ax; txi < bounds.bx; txi += tile_nx) {
+                auto const tile_bounds = RegionBounds{
+                    .ax = txi,
+                    .ay = tyi,
+                    .az = tzi,
+                    .bx = std::min(txi + tile_nx, bounds.bx),
+                    .by = std::min(tyi + tile_ny, bounds.by),
+                    .bz = std::min(tzi + tile_nz, bounds.bz),
+                };
+                user_state.thread_pool.enqueue([blit_ctx, &user_state, tile_bounds]() {
+                    handle_regions(blit_ctx, user_state, tile_bounds, nullptr);
+                });
+            }
+        }
     }
+    user_state.thread_pool.wait();
     user_state.thread_pool.stop();
 }
 
@@ -377,5 +649,5 @@ extern "C" void gvox_serialize_adapter_gvox_palette_serialize_region(GvoxBlitCon
 extern "C" void gvox_serialize_adapter_gvox_palette_receive_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegion const *region) {
     auto &user_state = *static_cast<GvoxPaletteSerializeUserState *>(gvox_adapter_get_user_pointer(ctx));
     auto temp_region = *region;
-    handle_region(blit_ctx, user_state, &region->range, &temp_region);
+    handle_regions(blit_ctx, user_state, region_bounds(user_state, region->range), &temp_region);
 }
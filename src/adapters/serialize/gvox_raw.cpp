@@ -2,23 +2,114 @@
 #include <gvox/adapters/serialize/gvox_raw.h>
 
 #include <cstdlib>
+#include <cstdint>
 
 #include <bit>
 #include <array>
 #include <vector>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+#include <mutex>
+#endif
+
+#include "../shared/staging_buffer.hpp"
+
+using namespace gvox_detail::staging_buffer;
+
+// One z-slice of the output, which is contiguous since the layout is z-major
+struct GvoxRawSlab {
+    StagingArray<uint32_t> voxels;
+    // A bit for each (x, y) position, set once a region has covered it
+    std::vector<uint64_t> covered{};
+    // Number of (x, y) positions covered so far
+    size_t received_n{};
+    // Regions still copying into the slab, which keep it from being flushed
+    uint32_t writer_n{};
+};
 
 struct GvoxRawUserState {
+    GvoxAdapterContext *ctx{};
     GvoxRegionRange range{};
-    std::vector<uint32_t> voxels;
+    // Set when the output can be mapped, in which case voxels go straight into
+    // it, and slabs only track which positions have been covered
+    uint32_t *mapped_voxels{};
+    // Otherwise, slabs are staged until all of their voxels have been
+    // received, and are then written out in order
+    std::unordered_map<uint32_t, GvoxRawSlab> slabs{};
+    uint32_t next_flushed_slab{};
+    size_t slab_position_n{};
+    size_t slab_voxel_n{};
+    GvoxRawSlab *cached_slab{};
+    uint32_t cached_slab_z{};
     std::vector<uint8_t> channels;
     size_t offset{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+    std::mutex mtx{};
+#endif
 };
 
+static auto get_slab(GvoxRawUserState &user_state, uint32_t slab_z) -> GvoxRawSlab & {
+    if (user_state.cached_slab != nullptr && user_state.cached_slab_z == slab_z) {
+        return *user_state.cached_slab;
+    }
+    auto [slab_iter, inserted] = user_state.slabs.try_emplace(slab_z);
+    if (inserted) {
+        if (user_state.mapped_voxels == nullptr) {
+            slab_iter->second.voxels.allocate(user_state.ctx, user_state.slab_voxel_n);
+        }
+        slab_iter->second.covered.resize((user_state.slab_position_n + 63) / 64);
+    }
+    user_state.cached_slab = &slab_iter->second;
+    user_state.cached_slab_z = slab_z;
+    return slab_iter->second;
+}
+
+// Writes out completed slabs in z order, so that streaming outputs only ever
+// see sequential writes. With `flush_all`, incomplete slabs are written too.
+// Mapped slabs are already in the output, so they're just dropped.
+static void flush_slabs(GvoxBlitContext *blit_ctx, GvoxRawUserState &user_state, bool flush_all) {
+    auto const slab_size = user_state.slab_voxel_n * sizeof(uint32_t);
+    auto zeros = StagingArray<uint32_t>{};
+    while (user_state.next_flushed_slab < user_state.range.extent.z) {
+        auto slab_iter = user_state.slabs.find(user_state.next_flushed_slab);
+        auto const is_complete = slab_iter != user_state.slabs.end() && slab_iter->second.received_n == user_state.slab_position_n && slab_iter->second.writer_n == 0;
+        if (!is_complete && !flush_all) {
+            break;
+        }
+        if (user_state.mapped_voxels != nullptr) {
+            if (slab_iter != user_state.slabs.end()) {
+                user_state.slabs.erase(slab_iter);
+            }
+            ++user_state.next_flushed_slab;
+            continue;
+        }
+        auto const position = user_state.offset + static_cast<size_t>(user_state.next_flushed_slab) * slab_size;
+        if (slab_iter != user_state.slabs.end() && slab_iter->second.voxels.data() != nullptr) {
+            gvox_output_write(blit_ctx, position, slab_size, slab_iter->second.voxels.data());
+        } else {
+            // Nothing was received for this slab
+            if (zeros.data() == nullptr) {
+                zeros.allocate(user_state.ctx, user_state.slab_voxel_n);
+            }
+            gvox_output_write(blit_ctx, position, slab_size, zeros.data());
+        }
+        if (slab_iter != user_state.slabs.end()) {
+            user_state.slabs.erase(slab_iter);
+        }
+        ++user_state.next_flushed_slab;
+    }
+    user_state.cached_slab = nullptr;
+}
+
 // Base
 extern "C" void gvox_serialize_adapter_gvox_raw_create(GvoxAdapterContext *ctx, void const * /*unused*/) {
     auto *user_state_ptr = malloc(sizeof(GvoxRawUserState));
-    new (user_state_ptr) GvoxRawUserState();
+    auto &user_state = *(new (user_state_ptr) GvoxRawUserState());
     gvox_adapter_set_user_pointer(ctx, user_state_ptr);
+    user_state.ctx = ctx;
 }
 
 extern "C" void gvox_serialize_adapter_gvox_raw_destroy(GvoxAdapterContext *ctx) {
@@ -46,40 +137,126 @@ extern "C" void gvox_serialize_adapter_gvox_raw_blit_begin(GvoxBlitContext *blit
             ++next_channel;
         }
     }
-    user_state.voxels.resize(user_state.channels.size() * range->extent.x * range->extent.y * range->extent.z);
+    user_state.slab_position_n = static_cast<size_t>(range->extent.x) * range->extent.y;
+    user_state.slab_voxel_n = user_state.channels.size() * user_state.slab_position_n;
+    auto const voxel_n = user_state.slab_voxel_n * range->extent.z;
+    // The final size is known up front, so try writing the voxels straight into the output
+    gvox_output_reserve(blit_ctx, user_state.offset + voxel_n * sizeof(uint32_t));
+    auto *mapped = gvox_output_map(blit_ctx, user_state.offset, voxel_n * sizeof(uint32_t));
+    auto const is_mapped = mapped != nullptr && reinterpret_cast<uintptr_t>(mapped) % alignof(uint32_t) == 0;
+    user_state.mapped_voxels = is_mapped ? static_cast<uint32_t *>(mapped) : nullptr;
+    user_state.slabs.clear();
+    user_state.cached_slab = nullptr;
+    user_state.next_flushed_slab = 0;
 }
 
 extern "C" void gvox_serialize_adapter_gvox_raw_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<GvoxRawUserState *>(gvox_adapter_get_user_pointer(ctx));
-    gvox_output_write(blit_ctx, user_state.offset, user_state.voxels.size() * sizeof(user_state.voxels[0]), user_state.voxels.data());
+    flush_slabs(blit_ctx, user_state, true);
+    user_state.mapped_voxels = nullptr;
+}
+
+// Marks the positions of the rectangle that no region has covered yet as
+// covered, and returns how many there were. When some of them already were
+// covered, `claimed` is set to which ones are left to this region, and
+// otherwise it's left empty.
+static auto claim_positions(GvoxRawUserState const &user_state, GvoxRawSlab &slab, int64_t x_begin, int64_t x_end, int64_t y_begin, int64_t y_end, std::vector<bool> &claimed) -> size_t {
+    auto const rect_x_n = static_cast<size_t>(x_end - x_begin);
+    claimed.assign(rect_x_n * static_cast<size_t>(y_end - y_begin), false);
+    auto claimed_n = size_t{0};
+    for (auto y = y_begin; y < y_end; ++y) {
+        for (auto x = x_begin; x < x_end; ++x) {
+            auto const position_index = static_cast<size_t>(x - user_state.range.offset.x) + static_cast<size_t>(y - user_state.range.offset.y) * user_state.range.extent.x;
+            auto &word = slab.covered[position_index / 64];
+            auto const bit = uint64_t{1} << (position_index % 64);
+            if ((word & bit) == 0) {
+                word |= bit;
+                claimed[static_cast<size_t>(x - x_begin) + static_cast<size_t>(y - y_begin) * rect_x_n] = true;
+                ++claimed_n;
+            }
+        }
+    }
+    if (claimed_n == claimed.size()) {
+        claimed.clear();
+    }
+    return claimed_n;
 }
 
-static void handle_region(GvoxRawUserState &user_state, GvoxRegionRange const *range, auto user_func) {
-    for (uint32_t zi = 0; zi < range->extent.z; ++zi) {
-        for (uint32_t yi = 0; yi < range->extent.y; ++yi) {
-            for (uint32_t xi = 0; xi < range->extent.x; ++xi) {
-                auto const pos = GvoxOffset3D{
-                    static_cast<int32_t>(xi) + range->offset.x,
-                    static_cast<int32_t>(yi) + range->offset.y,
-                    static_cast<int32_t>(zi) + range->offset.z,
-                };
-                if (pos.x < user_state.range.offset.x ||
-                    pos.y < user_state.range.offset.y ||
-                    pos.z < user_state.range.offset.z ||
-                    pos.x >= user_state.range.offset.x + static_cast<int32_t>(user_state.range.extent.x) ||
-                    pos.y >= user_state.range.offset.y + static_cast<int32_t>(user_state.range.extent.y) ||
-                    pos.z >= user_state.range.offset.z + static_cast<int32_t>(user_state.range.extent.z)) {
+// Calls `sample_func(channel_i, pos)` for every voxel of `range` within the
+// blit range, and stores the samples that are present. Where regions overlap,
+// the voxels are stored by whichever region covered them first, so each voxel
+// has one writer. Sampling happens without the lock, which is only taken to
+// claim positions and flush slabs.
+static void handle_region(GvoxBlitContext *blit_ctx, GvoxRawUserState &user_state, GvoxRegionRange const *range, auto sample_func) {
+    auto const clip = [](int32_t offset, uint32_t extent, int32_t bounds_offset, uint32_t bounds_extent) {
+        return std::pair{
+            std::max(int64_t{offset}, int64_t{bounds_offset}),
+            std::min(int64_t{offset} + extent, int64_t{bounds_offset} + bounds_extent),
+        };
+    };
+    auto const [x_begin, x_end] = clip(range->offset.x, range->extent.x, user_state.range.offset.x, user_state.range.extent.x);
+    auto const [y_begin, y_end] = clip(range->offset.y, range->extent.y, user_state.range.offset.y, user_state.range.extent.y);
+    auto const [z_begin, z_end] = clip(range->offset.z, range->extent.z, user_state.range.offset.z, user_state.range.extent.z);
+    if (x_begin >= x_end || y_begin >= y_end || z_begin >= z_end) {
+        return;
+    }
+    auto const channel_n = user_state.channels.size();
+    auto const rect_x_n = static_cast<size_t>(x_end - x_begin);
+    // Which of the region's positions of the current slab it claimed, if not all of them
+    auto claimed = std::vector<bool>{};
+    // Calls `store(index_in_slab, value)` for every present sample of one z-slice
+    auto const for_each_sample = [&](int64_t z, auto store) {
+        for (auto y = y_begin; y < y_end; ++y) {
+            for (auto x = x_begin; x < x_end; ++x) {
+                if (!claimed.empty() && !claimed[static_cast<size_t>(x - x_begin) + static_cast<size_t>(y - y_begin) * rect_x_n]) {
                     continue;
                 }
-                auto output_rel_x = static_cast<size_t>(pos.x - user_state.range.offset.x);
-                auto output_rel_y = static_cast<size_t>(pos.y - user_state.range.offset.y);
-                auto output_rel_z = static_cast<size_t>(pos.z - user_state.range.offset.z);
-                for (uint32_t channel_i = 0; channel_i < user_state.channels.size(); ++channel_i) {
-                    auto output_index = static_cast<size_t>(output_rel_x + output_rel_y * user_state.range.extent.x + output_rel_z * user_state.range.extent.x * user_state.range.extent.y) * user_state.channels.size() + channel_i;
-                    user_func(channel_i, output_index, pos);
+                auto const pos = GvoxOffset3D{static_cast<int32_t>(x), static_cast<int32_t>(y), static_cast<int32_t>(z)};
+                auto const slab_index = (static_cast<size_t>(x - user_state.range.offset.x) + static_cast<size_t>(y - user_state.range.offset.y) * user_state.range.extent.x) * channel_n;
+                for (uint32_t channel_i = 0; channel_i < channel_n; ++channel_i) {
+                    auto const sample = sample_func(channel_i, pos);
+                    if (sample.is_present != 0u) {
+                        store(slab_index + channel_i, sample.data);
+                    }
                 }
             }
         }
+    };
+    for (auto z = z_begin; z < z_end; ++z) {
+        auto const slab_z = static_cast<uint32_t>(z - user_state.range.offset.z);
+        GvoxRawSlab *slab = nullptr;
+        {
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+            [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+            if (slab_z < user_state.next_flushed_slab) {
+                // Other regions already covered all of this slab
+                continue;
+            }
+            slab = &get_slab(user_state, slab_z);
+            auto const claimed_n = claim_positions(user_state, *slab, x_begin, x_end, y_begin, y_end, claimed);
+            if (claimed_n == 0) {
+                continue;
+            }
+            slab->received_n += claimed_n;
+            ++slab->writer_n;
+        }
+        // The slab can't be flushed while this region is a writer, and no
+        // other region writes to the positions it claimed, so no lock is
+        // needed to fill them
+        auto *voxels = user_state.mapped_voxels != nullptr ? user_state.mapped_voxels + static_cast<size_t>(slab_z) * user_state.slab_voxel_n : slab->voxels.data();
+        if (voxels != nullptr) {
+            for_each_sample(z, [voxels](size_t index, uint32_t value) {
+                voxels[index] = value;
+            });
+        }
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+        [[maybe_unused]] auto lock = std::lock_guard{user_state.mtx};
+#endif
+        --slab->writer_n;
+        if (slab_z == user_state.next_flushed_slab) {
+            flush_slabs(blit_ctx, user_state, false);
+        }
     }
 }
 
@@ -87,8 +264,8 @@ static void handle_region(GvoxRawUserState &user_state, GvoxRegionRange const *r
 extern "C" void gvox_serialize_adapter_gvox_raw_serialize_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegionRange const *range, uint32_t /* channel_flags */) {
     auto &user_state = *static_cast<GvoxRawUserState *>(gvox_adapter_get_user_pointer(ctx));
     handle_region(
-        user_state, range,
-        [blit_ctx, &user_state](uint32_t channel_i, size_t output_index, GvoxOffset3D const &pos) {
+        blit_ctx, user_state, range,
+        [blit_ctx, &user_state](uint32_t channel_i, GvoxOffset3D const &pos) {
             auto const sample_range = GvoxRegionRange{
                 .offset = pos,
                 .extent = GvoxExtent3D{1, 1, 1},
@@ -96,22 +273,43 @@ extern "C" void gvox_serialize_adapter_gvox_raw_serialize_region(GvoxBlitContext
             auto region = gvox_load_region_range(blit_ctx, &sample_range, 1u << user_state.channels[channel_i]);
             auto sample = gvox_sample_region(blit_ctx, &region, &pos, user_state.channels[channel_i]);
             if (sample.is_present == 0u) {
-                sample.data = 0u;
+                sample = {0u, 1u};
             }
-            user_state.voxels[output_index] = sample.data;
             gvox_unload_region_range(blit_ctx, &region, &sample_range);
+            return sample;
         });
 }
 
 // Parse Driven
 extern "C" void gvox_serialize_adapter_gvox_raw_receive_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegion const *region) {
     auto &user_state = *static_cast<GvoxRawUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if ((region->flags & GVOX_REGION_FLAG_UNIFORM) != 0) {
+        // One sample per channel covers the whole region
+        auto uniform_samples = std::array<GvoxSample, 32>{};
+        for (uint32_t channel_i = 0; channel_i < user_state.channels.size(); ++channel_i) {
+            uniform_samples[channel_i] = gvox_sample_region(blit_ctx, region, &region->range.offset, user_state.channels[channel_i]);
+        }
+        handle_region(
+            blit_ctx, user_state, &region->range,
+            [&uniform_samples](uint32_t channel_i, GvoxOffset3D const & /*unused*/) {
+                return uniform_samples[channel_i];
+            });
+        return;
+    }
     handle_region(
-        user_state, &region->range,
-        [blit_ctx, region, &user_state](uint32_t channel_i, size_t output_index, GvoxOffset3D const &pos) {
-            auto sample = gvox_sample_region(blit_ctx, region, &pos, user_state.channels[channel_i]);
-            if (sample.is_present != 0u) {
-                user_state.voxels[output_index] = sample.data;
+        blit_ctx, user_state, &region->range,
+        [blit_ctx, region, &user_state](uint32_t channel_i, GvoxOffset3D const &pos) {
+            auto const channel_id = user_state.channels[channel_i];
+            if ((region->flags & GVOX_REGION_FLAG_DENSE) != 0 && (region->channels & (1u << channel_id)) != 0) {
+                // Voxels the parser doesn't have are 0 in the dense block, which is what they'd be left as anyway
+                auto const &extent = region->range.extent;
+                auto const voxel_n = static_cast<size_t>(extent.x) * extent.y * extent.z;
+                auto const channel_index = static_cast<size_t>(std::popcount(region->channels & ((1u << channel_id) - 1)));
+                auto const local_index = static_cast<size_t>(pos.x - region->range.offset.x) +
+                                         static_cast<size_t>(pos.y - region->range.offset.y) * extent.x +
+                                         static_cast<size_t>(pos.z - region->range.offset.z) * extent.x * extent.y;
+                return GvoxSample{static_cast<uint32_t const *>(region->data)[channel_index * voxel_n + local_index], 1u};
             }
+            return gvox_sample_region(blit_ctx, region, &pos, channel_id);
         });
 }
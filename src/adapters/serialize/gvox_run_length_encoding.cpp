@@ -7,9 +7,13 @@
 #include <array>
 #include <vector>
 
+#include "../shared/staging_buffer.hpp"
+
+using namespace gvox_detail::staging_buffer;
+
 struct RunLengthEncodingUserState {
     GvoxRegionRange range{};
-    std::vector<uint32_t> voxels;
+    StagingArray<uint32_t> voxels;
     std::vector<uint8_t> channels;
     size_t offset{};
 };
@@ -46,11 +50,14 @@ extern "C" void gvox_serialize_adapter_gvox_run_length_encoding_blit_begin(GvoxB
             ++next_channel;
         }
     }
-    user_state.voxels.resize(user_state.channels.size() * range->extent.x * range->extent.y * range->extent.z);
+    user_state.voxels.allocate(ctx, user_state.channels.size() * range->extent.x * range->extent.y * range->extent.z);
 }
 
 extern "C" void gvox_serialize_adapter_gvox_run_length_encoding_blit_end(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx) {
     auto &user_state = *static_cast<RunLengthEncodingUserState *>(gvox_adapter_get_user_pointer(ctx));
+    if (user_state.voxels.data() == nullptr) {
+        return;
+    }
     auto output = std::vector<uint32_t>{};
     output.resize(user_state.range.extent.x * user_state.range.extent.y);
     for (uint32_t yi = 0; yi < user_state.range.extent.y; ++yi) {
@@ -88,9 +95,13 @@ extern "C" void gvox_serialize_adapter_gvox_run_length_encoding_blit_end(GvoxBli
         }
     }
     gvox_output_write(blit_ctx, user_state.offset, output.size() * sizeof(output[0]), output.data());
+    user_state.voxels.release();
 }
 
 static void handle_region(RunLengthEncodingUserState &user_state, GvoxRegionRange const *range, auto user_func) {
+    if (user_state.voxels.data() == nullptr) {
+        return;
+    }
     for (uint32_t zi = 0; zi < range->extent.z; ++zi) {
         for (uint32_t yi = 0; yi < range->extent.y; ++yi) {
             for (uint32_t xi = 0; xi < range->extent.x; ++xi) {
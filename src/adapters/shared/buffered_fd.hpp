@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cerrno>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace gvox_detail::buffered_fd {
+    static constexpr auto DEFAULT_BUFFER_SIZE = size_t{1024} * 1024;
+
+    // Collects small sequential writes, and hands them to the OS in large write(2) calls
+    struct BufferedFd {
+        int fd = -1;
+        std::vector<uint8_t> buffer{};
+        size_t used = 0;
+
+        void start(int new_fd, size_t buffer_size) {
+            fd = new_fd;
+            buffer.resize(buffer_size != 0 ? buffer_size : DEFAULT_BUFFER_SIZE);
+            used = 0;
+        }
+        auto write(void const *data, size_t size) -> bool {
+            auto const *bytes = static_cast<uint8_t const *>(data);
+            if (used + size > buffer.size()) {
+                if (!flush()) {
+                    return false;
+                }
+                if (size >= buffer.size()) {
+                    return write_all(bytes, size);
+                }
+            }
+            std::copy(bytes, bytes + size, buffer.data() + used);
+            used += size;
+            return true;
+        }
+        auto flush() -> bool {
+            auto const result = write_all(buffer.data(), used);
+            used = 0;
+            return result;
+        }
+
+      private:
+        auto write_all(uint8_t const *data, size_t size) const -> bool {
+            while (size > 0) {
+#if defined(_WIN32)
+                auto const written = _write(fd, data, static_cast<unsigned int>(std::min(size, size_t{0x40000000})));
+#else
+                auto const written = ::write(fd, data, size);
+#endif
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+            return true;
+        }
+    };
+} // namespace gvox_detail::buffered_fd
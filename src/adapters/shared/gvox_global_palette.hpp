@@ -0,0 +1,73 @@
+#pragma once
+
+#include <gvox/gvox.h>
+
+#include <cstdint>
+#include <cstddef>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+// Linear files pack each channel's indices in x-fastest order over the whole range
+static constexpr auto GLOBAL_PALETTE_MAGIC = std::bit_cast<uint64_t>(std::array<char, 8>{'g', 'v', 'g', 'l', 'b', 'p', 'a', 'l'});
+// Bricked files are the same, except that the header also has a brick size,
+// and each channel's indices are split into bricks of that size. Every brick
+// is packed in x-fastest order and starts on a new element, and the packed
+// data of each channel follows a table of the element offset of each brick.
+static constexpr auto GLOBAL_PALETTE_BRICKED_MAGIC = std::bit_cast<uint64_t>(std::array<char, 8>{'g', 'v', 'g', 'l', 'b', 'p', 'b', 'k'});
+
+static constexpr auto MAX_GLOBAL_PALETTE_BRICK_SIZE = uint32_t{32};
+
+static constexpr auto is_valid_global_palette_brick_size(uint32_t brick_size) -> bool {
+    return brick_size != 0 && brick_size <= MAX_GLOBAL_PALETTE_BRICK_SIZE && std::has_single_bit(brick_size);
+}
+
+struct GlobalPaletteBrickLayout {
+    uint32_t brick_size{};
+    uint32_t brick_nx{};
+    uint32_t brick_ny{};
+    uint32_t brick_nz{};
+
+    auto brick_n() const -> size_t {
+        return static_cast<size_t>(brick_nx) * brick_ny * brick_nz;
+    }
+    // Bricks at the far edges of the range are clipped to it
+    auto brick_extent(GvoxExtent3D const &range_extent, uint32_t bxi, uint32_t byi, uint32_t bzi) const -> GvoxExtent3D {
+        return {
+            std::min(brick_size, range_extent.x - bxi * brick_size),
+            std::min(brick_size, range_extent.y - byi * brick_size),
+            std::min(brick_size, range_extent.z - bzi * brick_size),
+        };
+    }
+};
+
+// Fills in the element offset of each brick (if `brick_offsets` isn't null),
+// and returns the total number of elements
+static inline auto calc_global_palette_brick_offsets(GlobalPaletteBrickLayout const &layout, GvoxExtent3D const &range_extent, uint32_t voxels_per_element, uint32_t *brick_offsets) -> size_t {
+    auto element_n = size_t{0};
+    auto brick_i = size_t{0};
+    for (uint32_t bzi = 0; bzi < layout.brick_nz; ++bzi) {
+        for (uint32_t byi = 0; byi < layout.brick_ny; ++byi) {
+            for (uint32_t bxi = 0; bxi < layout.brick_nx; ++bxi) {
+                auto const brick_extent = layout.brick_extent(range_extent, bxi, byi, bzi);
+                auto const brick_voxel_n = static_cast<size_t>(brick_extent.x) * brick_extent.y * brick_extent.z;
+                if (brick_offsets != nullptr) {
+                    brick_offsets[brick_i] = static_cast<uint32_t>(element_n);
+                }
+                ++brick_i;
+                element_n += (brick_voxel_n + voxels_per_element - 1) / voxels_per_element;
+            }
+        }
+    }
+    return element_n;
+}
+
+static inline auto make_global_palette_brick_layout(GvoxExtent3D const &range_extent, uint32_t brick_size) -> GlobalPaletteBrickLayout {
+    return {
+        .brick_size = brick_size,
+        .brick_nx = (range_extent.x + brick_size - 1) / brick_size,
+        .brick_ny = (range_extent.y + brick_size - 1) / brick_size,
+        .brick_nz = (range_extent.z + brick_size - 1) / brick_size,
+    };
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <algorithm>
+
+#include "math_helpers.hpp"
+#include "gvox_palette_decode.hpp"
+
+// Everything needed to find a voxel's palette index, worked out once per
+// channel rather than on every sample
+struct GlobalPaletteDecodeParams {
+    uint32_t bits_per_voxel{};
+    uint32_t voxels_per_element{};
+    uint32_t mask{};
+    // ceil(2^64 / voxels_per_element), so that dividing by it is a multiply
+    uint64_t element_reciprocal{};
+};
+
+static inline auto make_global_palette_decode_params(uint32_t palette_size) -> GlobalPaletteDecodeParams {
+    auto result = GlobalPaletteDecodeParams{};
+    result.bits_per_voxel = ceil_log2(palette_size);
+    // A channel with only one value has no bits at all
+    if (result.bits_per_voxel == 0) {
+        return result;
+    }
+    result.voxels_per_element = 32 / result.bits_per_voxel;
+    result.mask = get_mask(result.bits_per_voxel);
+    result.element_reciprocal = result.voxels_per_element == 1 ? 0 : ~uint64_t{0} / result.voxels_per_element + 1;
+    return result;
+}
+
+// The element that holds voxel `voxel_i`, which is the high half of
+// `voxel_i * element_reciprocal`
+static inline auto global_palette_element_index(GlobalPaletteDecodeParams const &params, uint32_t voxel_i) -> uint32_t {
+    if (params.element_reciprocal == 0) {
+        return voxel_i;
+    }
+    auto const lo = (params.element_reciprocal & 0xffffffffu) * voxel_i;
+    auto const hi = (params.element_reciprocal >> 32) * voxel_i;
+    return static_cast<uint32_t>((hi + (lo >> 32)) >> 32);
+}
+
+static inline void decode_global_palette_row_scalar(GlobalPaletteDecodeParams const &params, uint32_t const *packed, uint32_t const *palette, uint32_t *out, uint32_t first_voxel, uint32_t n) {
+    auto element_i = global_palette_element_index(params, first_voxel);
+    auto shift = (first_voxel - element_i * params.voxels_per_element) * params.bits_per_voxel;
+    auto const element_bits = params.voxels_per_element * params.bits_per_voxel;
+    for (uint32_t i = 0; i < n; ++i) {
+        out[i] = palette[(packed[element_i] >> shift) & params.mask];
+        shift += params.bits_per_voxel;
+        if (shift == element_bits) {
+            shift = 0;
+            ++element_i;
+        }
+    }
+}
+
+#if GVOX_PALETTE_DECODE_AVX2
+GVOX_PALETTE_DECODE_AVX2_TARGET static inline void decode_global_palette_row_avx2(GlobalPaletteDecodeParams const &params, uint32_t const *packed, uint32_t const *palette, uint32_t *out, uint32_t first_voxel, uint32_t n) {
+    auto const vpe = params.voxels_per_element;
+    auto const bpv = params.bits_per_voxel;
+    auto const element_bits = static_cast<int32_t>(vpe * bpv);
+    // Each lane keeps track of its own element and shift, which are stepped
+    // forward by 8 voxels at a time, so that there's no division in the loop
+    auto const first_element = global_palette_element_index(params, first_voxel);
+    auto const first_in_element = first_voxel - first_element * vpe;
+    auto lane_elements = std::array<int32_t, 8>{};
+    auto lane_shifts = std::array<int32_t, 8>{};
+    for (uint32_t lane = 0; lane < 8; ++lane) {
+        lane_elements[lane] = static_cast<int32_t>(first_element + (first_in_element + lane) / vpe);
+        lane_shifts[lane] = static_cast<int32_t>(((first_in_element + lane) % vpe) * bpv);
+    }
+    auto elements = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(lane_elements.data()));
+    auto shifts = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(lane_shifts.data()));
+    auto const element_step = _mm256_set1_epi32(static_cast<int32_t>(8 / vpe));
+    auto const shift_step = _mm256_set1_epi32(static_cast<int32_t>((8 % vpe) * bpv));
+    auto const shift_wrap = _mm256_set1_epi32(element_bits);
+    auto const shift_limit = _mm256_set1_epi32(element_bits - 1);
+    auto const mask = _mm256_set1_epi32(static_cast<int32_t>(params.mask));
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto const words = _mm256_i32gather_epi32(reinterpret_cast<int const *>(packed), elements, 4);
+        auto const palette_ids = _mm256_and_si256(_mm256_srlv_epi32(words, shifts), mask);
+        auto const values = _mm256_i32gather_epi32(reinterpret_cast<int const *>(palette), palette_ids, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), values);
+        shifts = _mm256_add_epi32(shifts, shift_step);
+        elements = _mm256_add_epi32(elements, element_step);
+        // Lanes whose shift went past the end of their element move on to the next one
+        auto const wrapped = _mm256_cmpgt_epi32(shifts, shift_limit);
+        shifts = _mm256_sub_epi32(shifts, _mm256_and_si256(wrapped, shift_wrap));
+        elements = _mm256_sub_epi32(elements, wrapped);
+    }
+    decode_global_palette_row_scalar(params, packed, palette, out + i, first_voxel + i, n - i);
+}
+#endif
+
+// Writes the palette values of voxels [first_voxel, first_voxel + n) to `out`
+static inline void decode_global_palette_row(GlobalPaletteDecodeParams const &params, uint32_t const *packed, uint32_t const *palette, uint32_t *out, uint32_t first_voxel, uint32_t n) {
+    if (params.bits_per_voxel == 0) {
+        std::fill(out, out + n, palette[0]);
+        return;
+    }
+#if GVOX_PALETTE_DECODE_AVX2
+    if (cpu_has_avx2()) {
+        decode_global_palette_row_avx2(params, packed, palette, out, first_voxel, n);
+        return;
+    }
+#endif
+    decode_global_palette_row_scalar(params, packed, palette, out, first_voxel, n);
+}
@@ -2,31 +2,83 @@
 
 #include "math_helpers.hpp"
 
-static constexpr auto REGION_SIZE = size_t{8};
+#include <algorithm>
+#include <array>
+#include <bit>
+
+// Regions are cubes with a power of two edge length, which the serializer's
+// config picks and the file header records
+static constexpr auto DEFAULT_REGION_SIZE = uint32_t{8};
+static constexpr auto MAX_REGION_SIZE = uint32_t{32};
+
+static constexpr auto is_valid_region_size(uint32_t region_size) -> bool {
+    return region_size != 0 && region_size <= MAX_REGION_SIZE && std::has_single_bit(region_size);
+}
 
 static constexpr auto get_mask(uint32_t bits_per_variant) -> uint32_t {
     return (~0u) >> (32 - bits_per_variant);
 }
 
-static constexpr auto calc_palette_region_size(size_t bits_per_variant) -> size_t {
-    auto palette_region_size = (bits_per_variant * REGION_SIZE * REGION_SIZE * REGION_SIZE + 7) / 8;
+static constexpr auto calc_palette_region_size(size_t bits_per_variant, size_t region_size) -> size_t {
+    auto palette_region_size = (bits_per_variant * region_size * region_size * region_size + 7) / 8;
     palette_region_size = (palette_region_size + 3) / 4;
     auto size = palette_region_size + 1;
     return size * 4;
 }
 
-static constexpr auto calc_block_size(size_t variant_n) -> size_t {
-    return calc_palette_region_size(ceil_log2(static_cast<uint32_t>(variant_n))) + sizeof(uint32_t) * variant_n;
+static constexpr auto calc_block_size(size_t variant_n, size_t region_size) -> size_t {
+    return calc_palette_region_size(ceil_log2(static_cast<uint32_t>(variant_n)), region_size) + sizeof(uint32_t) * variant_n;
 }
 
-static constexpr auto MAX_REGION_ALLOCATION_SIZE = REGION_SIZE * REGION_SIZE * REGION_SIZE * sizeof(uint32_t);
-static constexpr auto MAX_REGION_COMPRESSED_VARIANT_N =
-    REGION_SIZE == 8 ? 367 : (REGION_SIZE == 16 ? 2559 : 0);
+// The size of a region stored without a palette
+static constexpr auto calc_region_allocation_size(size_t region_size) -> size_t {
+    return region_size * region_size * region_size * sizeof(uint32_t);
+}
+
+// Regions with more variants than this are stored without a palette, since it wouldn't make them any smaller
+static constexpr auto calc_max_compressed_variant_n(size_t region_size) -> size_t {
+    auto variant_n = size_t{1};
+    while (calc_block_size(variant_n + 1, region_size) <= calc_region_allocation_size(region_size)) {
+        ++variant_n;
+    }
+    return variant_n;
+}
 
-static_assert(calc_block_size(MAX_REGION_COMPRESSED_VARIANT_N) <= MAX_REGION_ALLOCATION_SIZE);
-static_assert(calc_block_size(MAX_REGION_COMPRESSED_VARIANT_N + 1) > MAX_REGION_ALLOCATION_SIZE);
+static_assert(calc_max_compressed_variant_n(8) == 367);
+static_assert(calc_max_compressed_variant_n(16) == 2559);
 
 struct ChannelHeader {
     uint32_t variant_n;
     uint32_t blob_offset; // if variant_n == 1, this is just the data
 };
+
+static constexpr auto PALETTE_MAGIC_V1 = std::bit_cast<uint32_t>(std::array<char, 4>{'g', 'v', 'p', '\0'});
+static constexpr auto PALETTE_MAGIC_V2 = std::bit_cast<uint32_t>(std::array<char, 4>{'g', 'v', 'p', '2'});
+
+// v1 files are the magic, range, blob size, channel flags and channel count,
+// then a ChannelHeader for every channel of every region, then the blob.
+// Their regions are always DEFAULT_REGION_SIZE.
+//
+// v2 files group regions into super-chunks of super_chunk_size^3 regions.
+// After the magic, range, channel flags, channel count, region size and
+// super-chunk size come a SuperChunkIndexEntry per super-chunk, then a ChannelHeader per
+// channel of every super-chunk which summarizes it: variant_n is 1 if every
+// region of the super-chunk holds `blob_offset`, and 0 otherwise.
+// A super-chunk's data (at `offset`) is a ChannelHeader for every channel of
+// each of its regions (fewer than super_chunk_size along an axis at the far
+// edges of the range), with blob offsets relative to the end of those
+// headers, followed by the region blobs. Super-chunks that are
+// uniform in every channel have no data.
+struct SuperChunkIndexEntry {
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Super-chunks span about this many voxels along each axis, whatever the region size
+static constexpr auto SUPER_CHUNK_EXTENT = uint32_t{128};
+// Keeps a super-chunk's blob offsets within 32 bits, even with every channel stored raw
+static constexpr auto MAX_SUPER_CHUNK_EXTENT = uint32_t{256};
+
+static constexpr auto calc_super_chunk_size(uint32_t region_size) -> uint32_t {
+    return std::max(SUPER_CHUNK_EXTENT / region_size, uint32_t{1});
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "gvox_palette.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#include <array>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+// Compiled for AVX2 regardless of the target, and only called if the CPU supports it
+#define GVOX_PALETTE_DECODE_AVX2 1
+#define GVOX_PALETTE_DECODE_AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && defined(__AVX2__)
+#include <immintrin.h>
+#define GVOX_PALETTE_DECODE_AVX2 1
+#define GVOX_PALETTE_DECODE_AVX2_TARGET
+#else
+#define GVOX_PALETTE_DECODE_AVX2 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define GVOX_PALETTE_DECODE_NEON 1
+#else
+#define GVOX_PALETTE_DECODE_NEON 0
+#endif
+
+// Bit-packed palette indices are read as unaligned 32-bit words starting at
+// the byte containing each index. This works for up to 25 bits per index,
+// and relies on the 4 bytes of padding at the end of each packed region (see
+// `calc_palette_region_size`).
+static inline auto load_packed_word(uint8_t const *packed, uint32_t byte_index) -> uint32_t {
+    auto word = uint32_t{};
+    std::memcpy(&word, packed + byte_index, sizeof(word));
+    return word;
+}
+
+static inline void decode_palette_indices_scalar(uint8_t const *packed, uint32_t bits_per_variant, uint32_t const *palette, uint32_t *out, uint32_t first, uint32_t n) {
+    auto const mask = get_mask(bits_per_variant);
+    for (uint32_t index = first; index < n; ++index) {
+        auto const bit_index = index * bits_per_variant;
+        auto const palette_id = (load_packed_word(packed, bit_index / 8) >> (bit_index % 8)) & mask;
+        out[index] = palette[palette_id];
+    }
+}
+
+#if GVOX_PALETTE_DECODE_AVX2
+GVOX_PALETTE_DECODE_AVX2_TARGET static inline void decode_palette_indices_avx2(uint8_t const *packed, uint32_t bits_per_variant, uint32_t const *palette, uint32_t *out, uint32_t n) {
+    auto const lane_bit_indices = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int32_t>(bits_per_variant)));
+    auto const mask = _mm256_set1_epi32(static_cast<int32_t>(get_mask(bits_per_variant)));
+    auto const seven = _mm256_set1_epi32(7);
+    uint32_t index = 0;
+    for (; index + 8 <= n; index += 8) {
+        auto const bit_indices = _mm256_add_epi32(lane_bit_indices, _mm256_set1_epi32(static_cast<int32_t>(index * bits_per_variant)));
+        auto const words = _mm256_i32gather_epi32(reinterpret_cast<int const *>(packed), _mm256_srli_epi32(bit_indices, 3), 1);
+        auto const palette_ids = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(bit_indices, seven)), mask);
+        auto const values = _mm256_i32gather_epi32(reinterpret_cast<int const *>(palette), palette_ids, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + index), values);
+    }
+    decode_palette_indices_scalar(packed, bits_per_variant, palette, out, index, n);
+}
+
+static inline auto cpu_has_avx2() -> bool {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return true;
+#else
+    static bool const result = __builtin_cpu_supports("avx2") != 0;
+    return result;
+#endif
+}
+#endif
+
+#if GVOX_PALETTE_DECODE_NEON
+static inline void decode_palette_indices_neon(uint8_t const *packed, uint32_t bits_per_variant, uint32_t const *palette, uint32_t *out, uint32_t n) {
+    auto const mask = vdupq_n_u32(get_mask(bits_per_variant));
+    uint32_t index = 0;
+    for (; index + 4 <= n; index += 4) {
+        // NEON has no gather, so the words are loaded one by one, and the shifting and masking is vectorized
+        auto words = std::array<uint32_t, 4>{};
+        auto shifts = std::array<int32_t, 4>{};
+        for (uint32_t lane = 0; lane < 4; ++lane) {
+            auto const bit_index = (index + lane) * bits_per_variant;
+            words[lane] = load_packed_word(packed, bit_index / 8);
+            shifts[lane] = -static_cast<int32_t>(bit_index % 8);
+        }
+        auto palette_ids = std::array<uint32_t, 4>{};
+        vst1q_u32(palette_ids.data(), vandq_u32(vshlq_u32(vld1q_u32(words.data()), vld1q_s32(shifts.data())), mask));
+        for (uint32_t lane = 0; lane < 4; ++lane) {
+            out[index + lane] = palette[palette_ids[lane]];
+        }
+    }
+    decode_palette_indices_scalar(packed, bits_per_variant, palette, out, index, n);
+}
+#endif
+
+// Unpacks `n` bit-packed palette indices, and writes the palette value for each one to `out`
+static inline void decode_palette_indices(uint8_t const *packed, uint32_t bits_per_variant, uint32_t const *palette, uint32_t *out, uint32_t n) {
+#if GVOX_PALETTE_DECODE_AVX2
+    if (cpu_has_avx2()) {
+        decode_palette_indices_avx2(packed, bits_per_variant, palette, out, n);
+        return;
+    }
+#endif
+#if GVOX_PALETTE_DECODE_NEON
+    decode_palette_indices_neon(packed, bits_per_variant, palette, out, n);
+#else
+    decode_palette_indices_scalar(packed, bits_per_variant, palette, out, 0, n);
+#endif
+}
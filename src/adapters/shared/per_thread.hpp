@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+#include <mutex>
+#endif
+
+namespace gvox_detail::per_thread {
+    inline auto next_blit_id() -> uint64_t {
+        static auto counter = std::atomic<uint64_t>{0};
+        return ++counter;
+    }
+
+    // A T for each thread that works on a blit, made the first time the
+    // thread asks for it. They're kept until the next blit begins (or until
+    // cleared), so that the adapter can go through them once the threads are
+    // done with them.
+    template <typename T>
+    struct PerThread {
+        void begin_blit() {
+            blit_id = next_blit_id();
+            items.clear();
+        }
+        void clear() {
+            items.clear();
+        }
+
+        // `init(item)` is called on the calling thread's item when it's made
+        template <typename InitFunc>
+        auto get(InitFunc init) -> T & {
+            thread_local auto item_blit_id = uint64_t{0};
+            thread_local T *item = nullptr;
+            if (item_blit_id != blit_id) {
+                auto new_item = std::make_unique<T>();
+                init(*new_item);
+                item = new_item.get();
+                item_blit_id = blit_id;
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+                auto lock = std::lock_guard{mtx};
+#endif
+                items.push_back(std::move(new_item));
+            }
+            return *item;
+        }
+        auto get() -> T & {
+            return get([](T & /*unused*/) {});
+        }
+
+        auto begin() const { return items.begin(); }
+        auto end() const { return items.end(); }
+
+      private:
+        // Unique to each blit, so that threads can tell whether the item they
+        // last used still belongs to this one
+        uint64_t blit_id{};
+        std::vector<std::unique_ptr<T>> items{};
+#if GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY
+        std::mutex mtx{};
+#endif
+    };
+} // namespace gvox_detail::per_thread
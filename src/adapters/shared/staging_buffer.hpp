@@ -0,0 +1,47 @@
+#pragma once
+
+#include <gvox/gvox.h>
+
+#include <cstddef>
+#include <type_traits>
+
+namespace gvox_detail::staging_buffer {
+    // Zero-initialized array in staging storage, which spills to disk once
+    // the context's memory budget is used up
+    template <typename T>
+    struct StagingArray {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+        StagingArray() = default;
+        StagingArray(StagingArray const &) = delete;
+        auto operator=(StagingArray const &) -> StagingArray & = delete;
+        ~StagingArray() { release(); }
+
+        // Leaves the array empty on failure, with an error pushed to `new_ctx`
+        void allocate(GvoxAdapterContext *new_ctx, size_t count) {
+            release();
+            ctx = new_ctx;
+            ptr = static_cast<T *>(gvox_adapter_allocate_staging(ctx, count * sizeof(T)));
+            n = ptr != nullptr ? count : 0;
+        }
+        void release() {
+            if (ptr != nullptr) {
+                gvox_adapter_free_staging(ctx, ptr);
+            }
+            ptr = nullptr;
+            n = 0;
+        }
+
+        auto data() -> T * { return ptr; }
+        auto data() const -> T const * { return ptr; }
+        auto size() const -> size_t { return n; }
+        auto empty() const -> bool { return n == 0; }
+        auto operator[](size_t i) -> T & { return ptr[i]; }
+        auto operator[](size_t i) const -> T const & { return ptr[i]; }
+
+      private:
+        GvoxAdapterContext *ctx{};
+        T *ptr{};
+        size_t n{};
+    };
+} // namespace gvox_detail::staging_buffer
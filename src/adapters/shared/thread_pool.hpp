@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <algorithm>
 
 #define ENABLE_THREAD_POOL (GVOX_ENABLE_MULTITHREADED_ADAPTERS && GVOX_ENABLE_THREADSAFETY)
 
@@ -15,7 +16,8 @@ namespace gvox_detail::thread_pool {
     struct ThreadPool {
         void start() {
 #if ENABLE_THREAD_POOL
-            uint32_t const num_threads = std::thread::hardware_concurrency();
+            should_terminate = false;
+            uint32_t const num_threads = std::max(std::thread::hardware_concurrency(), 1u);
             threads.resize(num_threads);
             for (uint32_t i = 0; i < num_threads; i++) {
                 threads.at(i) = std::thread(&ThreadPool::thread_loop, this);
@@ -44,6 +46,23 @@ namespace gvox_detail::thread_pool {
                 active_thread.join();
             }
             threads.clear();
+#endif
+        }
+        // Blocks until every enqueued job has finished running
+        void wait() {
+#if ENABLE_THREAD_POOL
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            idle_condition.wait(lock, [this] {
+                return jobs.empty() && active_job_n == 0;
+            });
+#endif
+        }
+        // How many jobs can run at once, once started
+        auto thread_count() const -> uint32_t {
+#if ENABLE_THREAD_POOL
+            return std::max(static_cast<uint32_t>(threads.size()), 1u);
+#else
+            return 1;
 #endif
         }
         auto busy() -> bool {
@@ -74,8 +93,16 @@ namespace gvox_detail::thread_pool {
                     }
                     job = jobs.front();
                     jobs.pop();
+                    ++active_job_n;
                 }
                 job();
+                {
+                    std::unique_lock<std::mutex> lock(queue_mutex);
+                    --active_job_n;
+                    if (jobs.empty() && active_job_n == 0) {
+                        idle_condition.notify_all();
+                    }
+                }
             }
 #endif
         }
@@ -83,6 +110,8 @@ namespace gvox_detail::thread_pool {
         bool should_terminate = false;
         std::mutex queue_mutex;
         std::condition_variable mutex_condition;
+        std::condition_variable idle_condition;
+        uint32_t active_job_n = 0;
         std::vector<std::thread> threads;
         std::queue<std::function<void()>> jobs;
 #endif
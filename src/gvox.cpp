@@ -1,6 +1,7 @@
 #include <gvox/gvox.h>
 
 #include <cassert>
+#include <cstdlib>
 #include <unordered_map>
 #include <string>
 #include <vector>
@@ -14,6 +15,18 @@
 #include "utils/patch_wasm.h"
 #endif
 
+#if GVOX_ENABLE_FILE_IO && (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define GVOX_ENABLE_FILE_BACKED_STAGING 1
+#else
+#define GVOX_ENABLE_FILE_BACKED_STAGING 0
+#endif
+
+#if GVOX_ENABLE_FILE_BACKED_STAGING
+#include <cstdio>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 struct _GvoxAdapter {
     GvoxAdapterBaseInfo base_info;
 };
@@ -29,12 +42,19 @@ struct GvoxParseAdapter {
 struct GvoxSerializeAdapter {
     GvoxSerializeAdapterInfo info;
 };
+struct GvoxStagingAllocation {
+    size_t size;
+    bool is_file_backed;
+};
 struct _GvoxContext {
     std::unordered_map<std::string, GvoxInputAdapter *> input_adapter_table{};
     std::unordered_map<std::string, GvoxOutputAdapter *> output_adapter_table{};
     std::unordered_map<std::string, GvoxParseAdapter *> parse_adapter_table{};
     std::unordered_map<std::string, GvoxSerializeAdapter *> serialize_adapter_table{};
     std::queue<std::pair<std::string, GvoxResult>> errors{};
+    size_t memory_budget{};
+    size_t staging_memory_usage{};
+    std::unordered_map<void *, GvoxStagingAllocation> staging_allocations{};
 #if GVOX_ENABLE_THREADSAFETY
     std::mutex mtx{};
 #endif
@@ -125,6 +145,13 @@ void gvox_pop_result(GvoxContext *ctx) {
     ctx->errors.pop();
 }
 
+void gvox_set_memory_budget(GvoxContext *ctx, size_t budget) {
+#if GVOX_ENABLE_THREADSAFETY
+    auto lock = std::lock_guard{ctx->mtx};
+#endif
+    ctx->memory_budget = budget;
+}
+
 auto gvox_register_input_adapter(GvoxContext *ctx, GvoxInputAdapterInfo const *adapter_info) -> GvoxAdapter * {
     auto adapter_iter = ctx->input_adapter_table.find(adapter_info->base_info.name_str);
     if (adapter_iter != ctx->input_adapter_table.end()) {
@@ -367,18 +394,65 @@ void gvox_blit_region_serialize_driven(
 // Adapter API
 
 // Input
+void gvox_adapter_input_read(GvoxAdapterContext *input_ctx, size_t position, size_t size, void *data) {
+    auto &i_adapter = *reinterpret_cast<GvoxInputAdapter *>(input_ctx->adapter);
+    i_adapter.info.read(input_ctx, position, size, data);
+}
+void gvox_adapter_input_prefetch(GvoxAdapterContext *input_ctx, size_t position, size_t size) {
+    if (input_ctx == nullptr || input_ctx->adapter == nullptr) {
+        return;
+    }
+    auto &i_adapter = *reinterpret_cast<GvoxInputAdapter *>(input_ctx->adapter);
+    // Backwards compat cope
+    if (i_adapter.info.prefetch != nullptr) {
+        i_adapter.info.prefetch(input_ctx, position, size);
+    }
+}
 void gvox_input_read(GvoxBlitContext *blit_ctx, size_t position, size_t size, void *data) {
-    auto &i_adapter = *reinterpret_cast<GvoxInputAdapter *>(blit_ctx->i_ctx->adapter);
-    i_adapter.info.read(reinterpret_cast<GvoxAdapterContext *>(blit_ctx->i_ctx), position, size, data);
+    gvox_adapter_input_read(blit_ctx->i_ctx, position, size, data);
+}
+void gvox_input_prefetch(GvoxBlitContext *blit_ctx, size_t position, size_t size) {
+    gvox_adapter_input_prefetch(blit_ctx->i_ctx, position, size);
 }
 // Output
+void gvox_adapter_output_write(GvoxAdapterContext *output_ctx, size_t position, size_t size, void const *data) {
+    auto &o_adapter = *reinterpret_cast<GvoxOutputAdapter *>(output_ctx->adapter);
+    o_adapter.info.write(output_ctx, position, size, data);
+}
+void gvox_adapter_output_reserve(GvoxAdapterContext *output_ctx, size_t size) {
+    auto &o_adapter = *reinterpret_cast<GvoxOutputAdapter *>(output_ctx->adapter);
+    o_adapter.info.reserve(output_ctx, size);
+}
+void gvox_adapter_output_writev(GvoxAdapterContext *output_ctx, GvoxIoVec const *iovs, size_t iov_n) {
+    auto &o_adapter = *reinterpret_cast<GvoxOutputAdapter *>(output_ctx->adapter);
+    // Backwards compat cope
+    if (o_adapter.info.writev != nullptr) {
+        o_adapter.info.writev(output_ctx, iovs, iov_n);
+        return;
+    }
+    for (size_t i = 0; i < iov_n; ++i) {
+        o_adapter.info.write(output_ctx, iovs[i].position, iovs[i].size, iovs[i].data);
+    }
+}
+auto gvox_adapter_output_map(GvoxAdapterContext *output_ctx, size_t position, size_t size) -> void * {
+    auto &o_adapter = *reinterpret_cast<GvoxOutputAdapter *>(output_ctx->adapter);
+    // Backwards compat cope
+    if (o_adapter.info.map == nullptr) {
+        return nullptr;
+    }
+    return o_adapter.info.map(output_ctx, position, size);
+}
 void gvox_output_write(GvoxBlitContext *blit_ctx, size_t position, size_t size, void const *data) {
-    auto &o_adapter = *reinterpret_cast<GvoxOutputAdapter *>(blit_ctx->o_ctx->adapter);
-    o_adapter.info.write(reinterpret_cast<GvoxAdapterContext *>(blit_ctx->o_ctx), position, size, data);
+    gvox_adapter_output_write(blit_ctx->o_ctx, position, size, data);
 }
 void gvox_output_reserve(GvoxBlitContext *blit_ctx, size_t size) {
-    auto &o_adapter = *reinterpret_cast<GvoxOutputAdapter *>(blit_ctx->o_ctx->adapter);
-    o_adapter.info.reserve(reinterpret_cast<GvoxAdapterContext *>(blit_ctx->o_ctx), size);
+    gvox_adapter_output_reserve(blit_ctx->o_ctx, size);
+}
+void gvox_output_writev(GvoxBlitContext *blit_ctx, GvoxIoVec const *iovs, size_t iov_n) {
+    gvox_adapter_output_writev(blit_ctx->o_ctx, iovs, iov_n);
+}
+auto gvox_output_map(GvoxBlitContext *blit_ctx, size_t position, size_t size) -> void * {
+    return gvox_adapter_output_map(blit_ctx->o_ctx, position, size);
 }
 // General
 void gvox_adapter_push_error(GvoxAdapterContext *ctx, GvoxResult result_code, char const *message) {
@@ -396,6 +470,96 @@ void gvox_adapter_set_user_pointer(GvoxAdapterContext *ctx, void *ptr) {
 auto gvox_adapter_get_user_pointer(GvoxAdapterContext *ctx) -> void * {
     return ctx->user_ptr;
 }
+
+#if GVOX_ENABLE_FILE_BACKED_STAGING
+// The file is already unlinked, and the mapping outlives it being closed.
+// The OS pages it out to disk rather than to swap (or the OOM killer).
+static auto allocate_file_backed_staging(size_t size) -> void * {
+    auto *file = std::tmpfile();
+    if (file == nullptr) {
+        return nullptr;
+    }
+    void *result = nullptr;
+    if (ftruncate(fileno(file), static_cast<off_t>(size)) == 0) {
+        result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+        if (result == MAP_FAILED) {
+            result = nullptr;
+        }
+    }
+    std::fclose(file);
+    return result;
+}
+#endif
+
+auto gvox_adapter_allocate_staging(GvoxAdapterContext *ctx, size_t size) -> void * {
+    auto &gvox_ctx = *ctx->gvox_context_ptr;
+    // Never hand out null for an empty allocation, as it's also the failure value
+    size = std::max(size, size_t{1});
+    void *result = nullptr;
+    auto is_file_backed = false;
+    {
+#if GVOX_ENABLE_THREADSAFETY
+        auto lock = std::lock_guard{gvox_ctx.mtx};
+#endif
+        is_file_backed = gvox_ctx.memory_budget != 0 && gvox_ctx.staging_memory_usage + size > gvox_ctx.memory_budget;
+        if (!is_file_backed) {
+            gvox_ctx.staging_memory_usage += size;
+        }
+    }
+#if GVOX_ENABLE_FILE_BACKED_STAGING
+    if (is_file_backed) {
+        result = allocate_file_backed_staging(size);
+    }
+#else
+    // Without file-backed storage, there's nowhere to spill to
+    is_file_backed = false;
+#endif
+    if (!is_file_backed) {
+        result = calloc(size, 1);
+    }
+    if (result == nullptr) {
+        gvox_adapter_push_error(ctx, GVOX_RESULT_ERROR_UNKNOWN, "Failed to allocate staging storage");
+    }
+#if GVOX_ENABLE_THREADSAFETY
+    auto lock = std::lock_guard{gvox_ctx.mtx};
+#endif
+    if (result == nullptr) {
+        if (!is_file_backed) {
+            gvox_ctx.staging_memory_usage -= size;
+        }
+        return nullptr;
+    }
+    gvox_ctx.staging_allocations.emplace(result, GvoxStagingAllocation{.size = size, .is_file_backed = is_file_backed});
+    return result;
+}
+void gvox_adapter_free_staging(GvoxAdapterContext *ctx, void *ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    auto &gvox_ctx = *ctx->gvox_context_ptr;
+    auto allocation = GvoxStagingAllocation{};
+    {
+#if GVOX_ENABLE_THREADSAFETY
+        auto lock = std::lock_guard{gvox_ctx.mtx};
+#endif
+        auto allocation_iter = gvox_ctx.staging_allocations.find(ptr);
+        if (allocation_iter == gvox_ctx.staging_allocations.end()) {
+            return;
+        }
+        allocation = allocation_iter->second;
+        gvox_ctx.staging_allocations.erase(allocation_iter);
+        if (!allocation.is_file_backed) {
+            gvox_ctx.staging_memory_usage -= allocation.size;
+        }
+    }
+#if GVOX_ENABLE_FILE_BACKED_STAGING
+    if (allocation.is_file_backed) {
+        munmap(ptr, allocation.size);
+        return;
+    }
+#endif
+    free(ptr);
+}
 auto gvox_sample_region(GvoxBlitContext *blit_ctx, GvoxRegion const *region, GvoxOffset3D const *offset, uint32_t channel_id) -> GvoxSample {
     auto &p_adapter = *reinterpret_cast<GvoxParseAdapter *>(blit_ctx->p_ctx->adapter);
     auto offset_copy = *offset;
@@ -0,0 +1,463 @@
+#include <gvox/gvox.h>
+
+#include <gvox/adapters/input/byte_buffer.h>
+#include <gvox/adapters/output/byte_buffer.h>
+#include <gvox/adapters/serialize/colored_text.h>
+#include <gvox/adapters/serialize/gvox_palette.h>
+#include <gvox/adapters/serialize/global_palette.h>
+#include <adapters/procedural.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <vector>
+
+// Encodes the procedural scene in each format, decodes it again, and checks
+// the result against what gvox_raw gives for the same scene.
+
+void handle_gvox_error(GvoxContext *gvox_ctx) {
+    GvoxResult res = gvox_get_result(gvox_ctx);
+    int error_count = 0;
+    while (res != GVOX_RESULT_SUCCESS) {
+        size_t size = 0;
+        gvox_get_result_message(gvox_ctx, nullptr, &size);
+        char *str = new char[size + 1];
+        gvox_get_result_message(gvox_ctx, str, nullptr);
+        str[size] = '\0';
+        printf("ERROR: %s\n", str);
+        gvox_pop_result(gvox_ctx);
+        delete[] str;
+        res = gvox_get_result(gvox_ctx);
+        ++error_count;
+    }
+    if (error_count != 0) {
+        exit(-error_count);
+    }
+}
+
+void check(bool condition, char const *what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        exit(-1);
+    }
+}
+
+auto const procedural_adapter_info = GvoxParseAdapterInfo{
+    .base_info = {
+        .name_str = "procedural",
+        .create = procedural_create,
+        .destroy = procedural_destroy,
+        .blit_begin = procedural_blit_begin,
+        .blit_end = procedural_blit_end,
+    },
+    .query_details = procedural_query_details,
+    .sample_region = procedural_sample_region,
+    .query_region_flags = procedural_query_region_flags,
+    .load_region = procedural_load_region,
+    .unload_region = procedural_unload_region,
+    .parse_region = procedural_parse_region,
+};
+
+auto sparse_procedural_sample_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegion const *region, GvoxOffset3D const *offset, uint32_t channel_id) -> GvoxSample {
+    if (procedural_sample_region(blit_ctx, ctx, region, offset, GVOX_CHANNEL_ID_MATERIAL_ID).data == 0) {
+        return {0u, 0u};
+    }
+    return procedural_sample_region(blit_ctx, ctx, region, offset, channel_id);
+}
+
+auto const sparse_procedural_adapter_info = GvoxParseAdapterInfo{
+    .base_info = {
+        .name_str = "sparse_procedural",
+        .create = procedural_create,
+        .destroy = procedural_destroy,
+        .blit_begin = procedural_blit_begin,
+        .blit_end = procedural_blit_end,
+    },
+    .query_details = procedural_query_details,
+    .sample_region = sparse_procedural_sample_region,
+    .query_region_flags = procedural_query_region_flags,
+    .load_region = procedural_load_region,
+    .unload_region = procedural_unload_region,
+    .parse_region = procedural_parse_region,
+};
+
+// The procedural scene, except that each voxel with a negative x has its own
+// material ID, so that formats also have to store regions too varied to compress
+auto noisy_procedural_sample_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext *ctx, GvoxRegion const *region, GvoxOffset3D const *offset, uint32_t channel_id) -> GvoxSample {
+    if (channel_id == GVOX_CHANNEL_ID_MATERIAL_ID && offset->x < 0) {
+        auto const hash = static_cast<uint32_t>(offset->x) * 73856093u ^ static_cast<uint32_t>(offset->y) * 19349663u ^ static_cast<uint32_t>(offset->z) * 83492791u;
+        return {hash, 1u};
+    }
+    return procedural_sample_region(blit_ctx, ctx, region, offset, channel_id);
+}
+
+auto const noisy_procedural_adapter_info = GvoxParseAdapterInfo{
+    .base_info = {
+        .name_str = "noisy_procedural",
+        .create = procedural_create,
+        .destroy = procedural_destroy,
+        .blit_begin = procedural_blit_begin,
+        .blit_end = procedural_blit_end,
+    },
+    .query_details = procedural_query_details,
+    .sample_region = noisy_procedural_sample_region,
+    .query_region_flags = procedural_query_region_flags,
+    .load_region = procedural_load_region,
+    .unload_region = procedural_unload_region,
+    .parse_region = procedural_parse_region,
+};
+
+// The procedural scene, parsed as regions which overlap their neighbours
+void overlapping_procedural_parse_region(GvoxBlitContext *blit_ctx, GvoxAdapterContext * /*unused*/, GvoxRegionRange const *range, uint32_t channel_flags) {
+    constexpr auto STEP = int32_t{8};
+    constexpr auto SIZE = uint32_t{12};
+    for (int32_t z = range->offset.z - 2; z < range->offset.z + static_cast<int32_t>(range->extent.z); z += STEP) {
+        for (int32_t y = range->offset.y - 2; y < range->offset.y + static_cast<int32_t>(range->extent.y); y += STEP) {
+            for (int32_t x = range->offset.x - 2; x < range->offset.x + static_cast<int32_t>(range->extent.x); x += STEP) {
+                auto const region = GvoxRegion{
+                    .range = {.offset = {x, y, z}, .extent = {SIZE, SIZE, SIZE}},
+                    .channels = channel_flags,
+                    .flags = 0u,
+                    .data = nullptr,
+                };
+                gvox_emit_region(blit_ctx, &region);
+            }
+        }
+    }
+}
+
+auto const overlapping_procedural_adapter_info = GvoxParseAdapterInfo{
+    .base_info = {
+        .name_str = "overlapping_procedural",
+        .create = procedural_create,
+        .destroy = procedural_destroy,
+        .blit_begin = procedural_blit_begin,
+        .blit_end = procedural_blit_end,
+    },
+    .query_details = procedural_query_details,
+    .sample_region = procedural_sample_region,
+    .query_region_flags = procedural_query_region_flags,
+    .load_region = procedural_load_region,
+    .unload_region = procedural_unload_region,
+    .parse_region = overlapping_procedural_parse_region,
+};
+
+// Appends every write to the std::vector<uint8_t> it's configured with,
+// whatever its position, like the stdout adapter does
+void sequential_create(GvoxAdapterContext *ctx, void const *config) {
+    gvox_adapter_set_user_pointer(ctx, const_cast<void *>(config));
+}
+void sequential_destroy(GvoxAdapterContext * /*unused*/) {}
+void sequential_blit_begin(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/, GvoxRegionRange const * /*unused*/, uint32_t /*unused*/) {}
+void sequential_blit_end(GvoxBlitContext * /*unused*/, GvoxAdapterContext * /*unused*/) {}
+void sequential_write(GvoxAdapterContext *ctx, size_t /*unused*/, size_t size, void const *data) {
+    auto &bytes = *static_cast<std::vector<uint8_t> *>(gvox_adapter_get_user_pointer(ctx));
+    bytes.insert(bytes.end(), static_cast<uint8_t const *>(data), static_cast<uint8_t const *>(data) + size);
+}
+void sequential_reserve(GvoxAdapterContext * /*unused*/, size_t /*unused*/) {}
+
+auto const sequential_adapter_info = GvoxOutputAdapterInfo{
+    .base_info = {
+        .name_str = "sequential",
+        .create = sequential_create,
+        .destroy = sequential_destroy,
+        .blit_begin = sequential_blit_begin,
+        .blit_end = sequential_blit_end,
+    },
+    .write = sequential_write,
+    .reserve = sequential_reserve,
+    .writev = nullptr,
+    .map = nullptr,
+};
+
+struct Blit {
+    GvoxRegionRange range;
+    uint32_t channels;
+    bool parse_driven;
+};
+
+// Blits from `i_ctx` through the `parse_name` parser into the `serialize_name`
+// serializer, and returns the bytes it wrote
+auto blit_to_bytes(GvoxContext *gvox_ctx, GvoxAdapterContext *i_ctx, char const *parse_name, char const *serialize_name, void const *s_config, Blit const &blit) -> std::vector<uint8_t> {
+    uint8_t *output_bytes = nullptr;
+    size_t output_size = 0;
+    auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &output_size, .out_byte_buffer_ptr = &output_bytes};
+    auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+    auto *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, parse_name), nullptr);
+    auto *s_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_serialize_adapter(gvox_ctx, serialize_name), s_config);
+    if (blit.parse_driven) {
+        gvox_blit_region_parse_driven(i_ctx, o_ctx, p_ctx, s_ctx, &blit.range, blit.channels);
+    } else {
+        gvox_blit_region_serialize_driven(i_ctx, o_ctx, p_ctx, s_ctx, &blit.range, blit.channels);
+    }
+    gvox_destroy_adapter_context(o_ctx);
+    gvox_destroy_adapter_context(p_ctx);
+    gvox_destroy_adapter_context(s_ctx);
+    handle_gvox_error(gvox_ctx);
+    auto result = std::vector<uint8_t>(output_bytes, output_bytes + output_size);
+    free(output_bytes);
+    return result;
+}
+
+auto encode_scene(GvoxContext *gvox_ctx, char const *format, void const *s_config, Blit const &blit) -> std::vector<uint8_t> {
+    return blit_to_bytes(gvox_ctx, nullptr, "procedural", format, s_config, blit);
+}
+
+auto decode(GvoxContext *gvox_ctx, std::vector<uint8_t> const &encoded, char const *format, char const *serialize_name, void const *s_config, Blit const &blit) -> std::vector<uint8_t> {
+    auto i_config = GvoxByteBufferInputAdapterConfig{.data = encoded.data(), .size = encoded.size()};
+    auto *i_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "byte_buffer"), &i_config);
+    auto result = blit_to_bytes(gvox_ctx, i_ctx, format, serialize_name, s_config, blit);
+    gvox_destroy_adapter_context(i_ctx);
+    return result;
+}
+
+// Parsers that emit a range as many smaller regions, possibly in parallel,
+// should print the same picture as gvox_raw, which emits it as one region
+void test_colored_text(GvoxContext *gvox_ctx, char const *format, GvoxRegionRange const &range) {
+    auto const text_config = GvoxColoredTextSerializeAdapterConfig{
+        .downscale_factor = 1,
+        .downscale_mode = GVOX_COLORED_TEXT_SERIALIZE_ADAPTER_DOWNSCALE_MODE_NEAREST,
+        .non_color_max_value = 3,
+        .vertical = 0,
+    };
+    for (bool const parse_driven : {false, true}) {
+        auto const blit = Blit{.range = range, .channels = GVOX_CHANNEL_BIT_COLOR | GVOX_CHANNEL_BIT_MATERIAL_ID, .parse_driven = parse_driven};
+        auto const raw = encode_scene(gvox_ctx, "gvox_raw", nullptr, blit);
+        auto const encoded = encode_scene(gvox_ctx, format, nullptr, blit);
+        auto const expected = decode(gvox_ctx, raw, "gvox_raw", "colored_text", &text_config, blit);
+        check(decode(gvox_ctx, encoded, format, "colored_text", &text_config, blit) == expected, "colored_text output should match gvox_raw's");
+    }
+}
+
+// Encodes the scene with its air left out (as in MagicaVoxel files), so that
+// some voxels and whole regions aren't present, which formats store as 0
+void test_sparse(GvoxContext *gvox_ctx, char const *format, void const *s_config) {
+    for (bool const parse_driven : {false, true}) {
+        auto const blit = Blit{.range = {.offset = {-13, -12, -20}, .extent = {27, 24, 45}}, .channels = GVOX_CHANNEL_BIT_COLOR | GVOX_CHANNEL_BIT_MATERIAL_ID, .parse_driven = parse_driven};
+        auto const expected = blit_to_bytes(gvox_ctx, nullptr, "sparse_procedural", "gvox_raw", nullptr, blit);
+        auto const encoded = blit_to_bytes(gvox_ctx, nullptr, "sparse_procedural", format, s_config, blit);
+        check(decode(gvox_ctx, encoded, format, "gvox_raw", nullptr, blit) == expected, "sparse scene should round trip");
+    }
+}
+
+// Overlapping regions must not make gvox_raw write slabs before they're
+// complete, and then patch them, which outputs that can only append can't do
+void test_overlapping_regions(GvoxContext *gvox_ctx) {
+    auto const blit = Blit{.range = {.offset = {-13, -12, -20}, .extent = {27, 24, 45}}, .channels = GVOX_CHANNEL_BIT_COLOR | GVOX_CHANNEL_BIT_MATERIAL_ID, .parse_driven = true};
+    auto const expected = encode_scene(gvox_ctx, "gvox_raw", nullptr, blit);
+    // Mapped straight into the output
+    check(blit_to_bytes(gvox_ctx, nullptr, "overlapping_procedural", "gvox_raw", nullptr, blit) == expected, "overlapping regions should match gvox_raw's output");
+    // Staged in slabs
+    auto output_bytes = std::vector<uint8_t>{};
+    auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "sequential"), &output_bytes);
+    auto *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, "overlapping_procedural"), nullptr);
+    auto *s_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_serialize_adapter(gvox_ctx, "gvox_raw"), nullptr);
+    gvox_blit_region_parse_driven(nullptr, o_ctx, p_ctx, s_ctx, &blit.range, blit.channels);
+    gvox_destroy_adapter_context(o_ctx);
+    gvox_destroy_adapter_context(p_ctx);
+    gvox_destroy_adapter_context(s_ctx);
+    handle_gvox_error(gvox_ctx);
+    check(output_bytes == expected, "overlapping regions should be written sequentially");
+}
+
+// Odd extents, spanning more than one palette super-chunk along x
+static constexpr auto ROUND_TRIP_RANGE = GvoxRegionRange{.offset = {-70, -9, -13}, .extent = {131, 19, 27}};
+static constexpr auto ROUND_TRIP_CHANNELS = uint32_t{GVOX_CHANNEL_BIT_COLOR | GVOX_CHANNEL_BIT_MATERIAL_ID};
+
+// Whichever blit mode encodes the scene, decoding it in either mode should
+// give back exactly what gvox_raw stores for it
+void test_round_trip(GvoxContext *gvox_ctx, char const *format, void const *s_config) {
+    auto const expected = blit_to_bytes(gvox_ctx, nullptr, "noisy_procedural", "gvox_raw", nullptr, {ROUND_TRIP_RANGE, ROUND_TRIP_CHANNELS, true});
+    for (bool const encode_parse_driven : {false, true}) {
+        auto const encoded = blit_to_bytes(gvox_ctx, nullptr, "noisy_procedural", format, s_config, {ROUND_TRIP_RANGE, ROUND_TRIP_CHANNELS, encode_parse_driven});
+        for (bool const decode_parse_driven : {false, true}) {
+            check(decode(gvox_ctx, encoded, format, "gvox_raw", nullptr, {ROUND_TRIP_RANGE, ROUND_TRIP_CHANNELS, decode_parse_driven}) == expected, "scene should round trip");
+        }
+    }
+}
+
+// The serializer only writes v2 files, so this builds a v1 file (8^3 regions,
+// with one flat table of headers) from a gvox_raw file of the same scene
+auto make_v1_palette_file(std::vector<uint8_t> const &raw) -> std::vector<uint8_t> {
+    constexpr auto REGION_SIZE = uint32_t{8};
+    constexpr auto REGION_VOXEL_N = REGION_SIZE * REGION_SIZE * REGION_SIZE;
+    constexpr auto MAX_COMPRESSED_VARIANT_N = size_t{367};
+    constexpr auto raw_header_size = sizeof(uint32_t) + sizeof(GvoxRegionRange) + sizeof(uint32_t);
+    auto range = GvoxRegionRange{};
+    auto channel_flags = uint32_t{};
+    memcpy(&range, raw.data() + sizeof(uint32_t), sizeof(range));
+    memcpy(&channel_flags, raw.data() + sizeof(uint32_t) + sizeof(range), sizeof(channel_flags));
+    auto const channel_n = static_cast<uint32_t>(std::popcount(channel_flags));
+    auto const raw_voxel = [&](uint32_t x, uint32_t y, uint32_t z, uint32_t ci) -> uint32_t {
+        if (x >= range.extent.x || y >= range.extent.y || z >= range.extent.z) {
+            return 0;
+        }
+        auto value = uint32_t{};
+        auto const index = ((x + y * size_t{range.extent.x} + z * size_t{range.extent.x} * range.extent.y) * channel_n + ci);
+        memcpy(&value, raw.data() + raw_header_size + index * sizeof(uint32_t), sizeof(value));
+        return value;
+    };
+    auto const append_u32 = [](std::vector<uint8_t> &bytes, uint32_t value) {
+        auto const size = bytes.size();
+        bytes.resize(size + sizeof(value));
+        memcpy(bytes.data() + size, &value, sizeof(value));
+    };
+
+    auto const r_nx = (range.extent.x + REGION_SIZE - 1) / REGION_SIZE;
+    auto const r_ny = (range.extent.y + REGION_SIZE - 1) / REGION_SIZE;
+    auto const r_nz = (range.extent.z + REGION_SIZE - 1) / REGION_SIZE;
+    auto headers = std::vector<uint8_t>{};
+    auto blob = std::vector<uint8_t>{};
+    auto values = std::array<uint32_t, REGION_VOXEL_N>{};
+    for (uint32_t rzi = 0; rzi < r_nz; ++rzi) {
+        for (uint32_t ryi = 0; ryi < r_ny; ++ryi) {
+            for (uint32_t rxi = 0; rxi < r_nx; ++rxi) {
+                for (uint32_t ci = 0; ci < channel_n; ++ci) {
+                    auto palette = std::vector<uint32_t>{};
+                    for (uint32_t i = 0; i < REGION_VOXEL_N; ++i) {
+                        values[i] = raw_voxel(rxi * REGION_SIZE + i % REGION_SIZE, ryi * REGION_SIZE + (i / REGION_SIZE) % REGION_SIZE, rzi * REGION_SIZE + i / (REGION_SIZE * REGION_SIZE), ci);
+                        if (std::find(palette.begin(), palette.end(), values[i]) == palette.end()) {
+                            palette.push_back(values[i]);
+                        }
+                    }
+                    auto const variant_n = static_cast<uint32_t>(palette.size());
+                    append_u32(headers, variant_n);
+                    if (variant_n == 1) {
+                        append_u32(headers, palette[0]);
+                        continue;
+                    }
+                    append_u32(headers, static_cast<uint32_t>(blob.size()));
+                    if (variant_n > MAX_COMPRESSED_VARIANT_N) {
+                        for (auto const value : values) {
+                            append_u32(blob, value);
+                        }
+                        continue;
+                    }
+                    for (auto const value : palette) {
+                        append_u32(blob, value);
+                    }
+                    auto const bits_per_variant = static_cast<uint32_t>(std::bit_width(variant_n - 1));
+                    // Rounded up to whole words, plus one word of padding
+                    auto packed = std::vector<uint8_t>(((bits_per_variant * REGION_VOXEL_N + 7) / 8 + 3) / 4 * 4 + 4);
+                    for (uint32_t i = 0; i < REGION_VOXEL_N; ++i) {
+                        auto const palette_id = static_cast<uint32_t>(std::find(palette.begin(), palette.end(), values[i]) - palette.begin());
+                        for (uint32_t bi = 0; bi < bits_per_variant; ++bi) {
+                            auto const bit_index = i * bits_per_variant + bi;
+                            packed[bit_index / 8] |= static_cast<uint8_t>(((palette_id >> bi) & 1u) << (bit_index % 8));
+                        }
+                    }
+                    blob.insert(blob.end(), packed.begin(), packed.end());
+                }
+            }
+        }
+    }
+
+    auto const magic = std::bit_cast<uint32_t>(std::array<char, 4>{'g', 'v', 'p', '\0'});
+    auto const blob_size = static_cast<uint32_t>(blob.size());
+    auto result = std::vector<uint8_t>(sizeof(magic) + sizeof(range) + sizeof(blob_size) + sizeof(channel_flags) + sizeof(channel_n) + headers.size() + blob.size());
+    auto *out = result.data();
+    memcpy(out, &magic, sizeof(magic));
+    out += sizeof(magic);
+    memcpy(out, &range, sizeof(range));
+    out += sizeof(range);
+    memcpy(out, &blob_size, sizeof(blob_size));
+    out += sizeof(blob_size);
+    memcpy(out, &channel_flags, sizeof(channel_flags));
+    out += sizeof(channel_flags);
+    memcpy(out, &channel_n, sizeof(channel_n));
+    out += sizeof(channel_n);
+    memcpy(out, headers.data(), headers.size());
+    out += headers.size();
+    memcpy(out, blob.data(), blob.size());
+    return result;
+}
+
+// Files written before super-chunks were added should still decode
+void test_v1_palette(GvoxContext *gvox_ctx) {
+    auto const expected = blit_to_bytes(gvox_ctx, nullptr, "noisy_procedural", "gvox_raw", nullptr, {ROUND_TRIP_RANGE, ROUND_TRIP_CHANNELS, true});
+    auto const v1_file = make_v1_palette_file(expected);
+    for (bool const parse_driven : {false, true}) {
+        check(decode(gvox_ctx, v1_file, "gvox_palette", "gvox_raw", nullptr, {ROUND_TRIP_RANGE, ROUND_TRIP_CHANNELS, parse_driven}) == expected, "v1 palette file should decode");
+    }
+}
+
+// Bricked global palette files have a table of where each brick's packed
+// data starts, which the parser mustn't trust
+void test_bad_brick_offsets(GvoxContext *gvox_ctx) {
+    auto const s_config = GvoxGlobalPaletteSerializeAdapterConfig{.brick_size = 8};
+    auto encoded = blit_to_bytes(gvox_ctx, nullptr, "noisy_procedural", "gvox_global_palette", &s_config, {ROUND_TRIP_RANGE, ROUND_TRIP_CHANNELS, true});
+    // The magic, range, brick size and palette sizes, then the first channel's palette and brick offsets
+    auto const palette_sizes_offset = sizeof(uint64_t) + sizeof(GvoxRegionRange) + sizeof(uint32_t);
+    auto palette_size = uint32_t{};
+    memcpy(&palette_size, encoded.data() + palette_sizes_offset, sizeof(palette_size));
+    auto const brick_offsets_offset = palette_sizes_offset + 2 * sizeof(uint32_t) + palette_size * sizeof(uint32_t);
+    auto const bad_offset = uint32_t{0x10000000};
+    memcpy(encoded.data() + brick_offsets_offset + sizeof(uint32_t), &bad_offset, sizeof(bad_offset));
+
+    auto i_config = GvoxByteBufferInputAdapterConfig{.data = encoded.data(), .size = encoded.size()};
+    auto *i_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "byte_buffer"), &i_config);
+    uint8_t *output_bytes = nullptr;
+    size_t output_size = 0;
+    auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &output_size, .out_byte_buffer_ptr = &output_bytes};
+    auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+    auto *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, "gvox_global_palette"), nullptr);
+    auto *s_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_serialize_adapter(gvox_ctx, "gvox_raw"), nullptr);
+    gvox_blit_region(i_ctx, o_ctx, p_ctx, s_ctx, &ROUND_TRIP_RANGE, ROUND_TRIP_CHANNELS);
+    check(gvox_get_result(gvox_ctx) != GVOX_RESULT_SUCCESS, "bad brick offsets should be rejected");
+    while (gvox_get_result(gvox_ctx) != GVOX_RESULT_SUCCESS) {
+        gvox_pop_result(gvox_ctx);
+    }
+    gvox_destroy_adapter_context(i_ctx);
+    gvox_destroy_adapter_context(o_ctx);
+    gvox_destroy_adapter_context(p_ctx);
+    gvox_destroy_adapter_context(s_ctx);
+    free(output_bytes);
+}
+
+auto main() -> int {
+    auto *gvox_ctx = gvox_create_context();
+    gvox_register_parse_adapter(gvox_ctx, &procedural_adapter_info);
+    gvox_register_parse_adapter(gvox_ctx, &sparse_procedural_adapter_info);
+    gvox_register_parse_adapter(gvox_ctx, &noisy_procedural_adapter_info);
+    gvox_register_parse_adapter(gvox_ctx, &overlapping_procedural_adapter_info);
+    gvox_register_output_adapter(gvox_ctx, &sequential_adapter_info);
+
+    printf("raw, overlapping regions\n");
+    test_overlapping_regions(gvox_ctx);
+    printf("palette\n");
+    test_round_trip(gvox_ctx, "gvox_palette", nullptr);
+    for (uint32_t const region_size : {1u, 2u, 4u, 8u, 16u, 32u}) {
+        printf("palette, region size %u\n", region_size);
+        auto const s_config = GvoxPaletteSerializeAdapterConfig{.region_size = region_size};
+        test_round_trip(gvox_ctx, "gvox_palette", &s_config);
+        test_sparse(gvox_ctx, "gvox_palette", &s_config);
+    }
+    printf("v1 palette\n");
+    test_v1_palette(gvox_ctx);
+
+    // A brick size of 0 picks the linear layout
+    for (uint32_t const brick_size : {0u, 1u, 4u, 8u, 32u}) {
+        printf("global palette, brick size %u\n", brick_size);
+        auto const s_config = GvoxGlobalPaletteSerializeAdapterConfig{.brick_size = brick_size};
+        test_round_trip(gvox_ctx, "gvox_global_palette", &s_config);
+        test_sparse(gvox_ctx, "gvox_global_palette", &s_config);
+    }
+    printf("global palette, bad brick offsets\n");
+    test_bad_brick_offsets(gvox_ctx);
+
+    printf("brickmap\n");
+    test_round_trip(gvox_ctx, "gvox_brickmap", nullptr);
+    test_sparse(gvox_ctx, "gvox_brickmap", nullptr);
+
+    printf("palette colored text\n");
+    test_colored_text(gvox_ctx, "gvox_palette", {.offset = {-10, -10, -10}, .extent = {20, 20, 20}});
+    printf("global palette colored text\n");
+    // Large enough to be emitted as several z-slabs
+    test_colored_text(gvox_ctx, "gvox_global_palette", {.offset = {-40, -40, -40}, .extent = {80, 80, 80}});
+
+    gvox_destroy_context(gvox_ctx);
+}
@@ -0,0 +1,434 @@
+#include <gvox/gvox.h>
+
+#include <gvox/adapters/input/byte_buffer.h>
+#include <gvox/adapters/output/byte_buffer.h>
+#include <gvox/adapters/output/async.h>
+#if GVOX_ENABLE_FILE_IO && defined(__unix__)
+#include <gvox/adapters/output/mmap.h>
+#include <gvox/adapters/output/fd.h>
+#include <gvox/adapters/input/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if GVOX_ENABLE_ZSTD
+#include <gvox/adapters/input/zstd.h>
+#include <gvox/adapters/output/zstd.h>
+#endif
+#include <adapters/procedural.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+// Blits the procedural scene through each of the wrapping input and output
+// adapters, and checks that what comes out matches a plain byte_buffer blit.
+// byte_buffer's caller storage modes are checked against it too.
+// Also checks that the adapters can be destroyed after a blit that failed
+// part way through.
+
+auto pop_errors(GvoxContext *gvox_ctx, bool print) -> int {
+    int error_count = 0;
+    while (gvox_get_result(gvox_ctx) != GVOX_RESULT_SUCCESS) {
+        size_t size = 0;
+        gvox_get_result_message(gvox_ctx, nullptr, &size);
+        char *str = new char[size + 1];
+        gvox_get_result_message(gvox_ctx, str, nullptr);
+        str[size] = '\0';
+        if (print) {
+            printf("ERROR: %s\n", str);
+        }
+        gvox_pop_result(gvox_ctx);
+        delete[] str;
+        ++error_count;
+    }
+    return error_count;
+}
+
+void handle_gvox_error(GvoxContext *gvox_ctx) {
+    int error_count = pop_errors(gvox_ctx, true);
+    if (error_count != 0) {
+        exit(-error_count);
+    }
+}
+
+void check(bool condition, char const *what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        exit(-1);
+    }
+}
+
+auto const procedural_adapter_info = GvoxParseAdapterInfo{
+    .base_info = {
+        .name_str = "procedural",
+        .create = procedural_create,
+        .destroy = procedural_destroy,
+        .blit_begin = procedural_blit_begin,
+        .blit_end = procedural_blit_end,
+    },
+    .query_details = procedural_query_details,
+    .sample_region = procedural_sample_region,
+    .query_region_flags = procedural_query_region_flags,
+    .load_region = procedural_load_region,
+    .unload_region = procedural_unload_region,
+    .parse_region = procedural_parse_region,
+};
+
+auto const scene_range = GvoxRegionRange{.offset = {-9, -9, -9}, .extent = {19, 19, 19}};
+auto const scene_channels = uint32_t{GVOX_CHANNEL_BIT_COLOR | GVOX_CHANNEL_BIT_MATERIAL_ID};
+
+// Serializes the procedural scene as gvox_raw into `o_ctx`
+void write_scene(GvoxContext *gvox_ctx, GvoxAdapterContext *o_ctx, bool parse_driven) {
+    auto *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, "procedural"), nullptr);
+    auto *s_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_serialize_adapter(gvox_ctx, "gvox_raw"), nullptr);
+    if (parse_driven) {
+        gvox_blit_region_parse_driven(nullptr, o_ctx, p_ctx, s_ctx, &scene_range, scene_channels);
+    } else {
+        gvox_blit_region_serialize_driven(nullptr, o_ctx, p_ctx, s_ctx, &scene_range, scene_channels);
+    }
+    gvox_destroy_adapter_context(p_ctx);
+    gvox_destroy_adapter_context(s_ctx);
+}
+
+auto take_bytes(uint8_t *bytes, size_t size) -> std::vector<uint8_t> {
+    auto result = std::vector<uint8_t>(bytes, bytes + size);
+    free(bytes);
+    return result;
+}
+
+auto read_file(char const *filepath) -> std::vector<uint8_t> {
+    auto file = std::ifstream{filepath, std::ios::binary};
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+auto write_scene_to_bytes(GvoxContext *gvox_ctx, bool parse_driven) -> std::vector<uint8_t> {
+    uint8_t *output_bytes = nullptr;
+    size_t output_size = 0;
+    auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &output_size, .out_byte_buffer_ptr = &output_bytes};
+    auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+    write_scene(gvox_ctx, o_ctx, parse_driven);
+    gvox_destroy_adapter_context(o_ctx);
+    handle_gvox_error(gvox_ctx);
+    return take_bytes(output_bytes, output_size);
+}
+
+// Blits `i_ctx` (which must hold something that isn't a gvox_palette file)
+// through the gvox_palette parser, which fails at blit begin, after the
+// input and output adapters have begun their blits.
+void blit_and_fail(GvoxContext *gvox_ctx, GvoxAdapterContext *i_ctx, GvoxAdapterContext *o_ctx) {
+    auto *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, "gvox_palette"), nullptr);
+    auto *s_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_serialize_adapter(gvox_ctx, "gvox_raw"), nullptr);
+    gvox_blit_region(i_ctx, o_ctx, p_ctx, s_ctx, nullptr, GVOX_CHANNEL_BIT_COLOR);
+    check(pop_errors(gvox_ctx, false) != 0, "parsing garbage as gvox_palette should fail");
+    gvox_destroy_adapter_context(p_ctx);
+    gvox_destroy_adapter_context(s_ctx);
+}
+
+void test_async(GvoxContext *gvox_ctx, std::vector<uint8_t> const &expected, bool parse_driven) {
+    uint8_t *output_bytes = nullptr;
+    size_t output_size = 0;
+    {
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &output_size, .out_byte_buffer_ptr = &output_bytes};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        // Small buffers, so that the writer has to keep up
+        auto a_config = GvoxAsyncOutputAdapterConfig{.output_ctx = o_ctx, .buffer_size = 100, .buffer_count = 3};
+        auto *a_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "async"), &a_config);
+        write_scene(gvox_ctx, a_ctx, parse_driven);
+        gvox_destroy_adapter_context(a_ctx);
+        gvox_destroy_adapter_context(o_ctx);
+    }
+    handle_gvox_error(gvox_ctx);
+    check(take_bytes(output_bytes, output_size) == expected, "async output should match");
+
+    // An async output whose blit fails after its writer has started
+    {
+        auto const garbage = std::vector<uint8_t>(64, 0);
+        auto i_config = GvoxByteBufferInputAdapterConfig{.data = garbage.data(), .size = garbage.size()};
+        auto *i_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "byte_buffer"), &i_config);
+        uint8_t *unused_bytes = nullptr;
+        size_t unused_size = 0;
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &unused_size, .out_byte_buffer_ptr = &unused_bytes};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        auto a_config = GvoxAsyncOutputAdapterConfig{.output_ctx = o_ctx};
+        auto *a_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "async"), &a_config);
+        blit_and_fail(gvox_ctx, i_ctx, a_ctx);
+        gvox_destroy_adapter_context(a_ctx);
+        gvox_destroy_adapter_context(o_ctx);
+        gvox_destroy_adapter_context(i_ctx);
+        free(unused_bytes);
+    }
+    handle_gvox_error(gvox_ctx);
+}
+
+// The most recent block handed out by counting_reallocate
+void *last_reallocation = nullptr;
+size_t reallocation_count = 0;
+
+auto counting_reallocate(void *ptr, size_t size) -> void * {
+    last_reallocation = realloc(ptr, size);
+    ++reallocation_count;
+    return last_reallocation;
+}
+
+void test_byte_buffer(GvoxContext *gvox_ctx, std::vector<uint8_t> const &expected, bool parse_driven) {
+    // Caller storage, which starts too small and is grown through `reallocate`
+    {
+        auto *output_bytes = static_cast<uint8_t *>(malloc(16));
+        size_t output_size = 0;
+        reallocation_count = 0;
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &output_size, .out_byte_buffer_ptr = &output_bytes, .reallocate = counting_reallocate, .capacity = 16};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        write_scene(gvox_ctx, o_ctx, parse_driven);
+        gvox_destroy_adapter_context(o_ctx);
+        handle_gvox_error(gvox_ctx);
+        check(reallocation_count != 0 && output_bytes == last_reallocation, "byte_buffer output should be grown through reallocate");
+        check(take_bytes(output_bytes, output_size) == expected, "reallocated byte_buffer output should match");
+    }
+
+    // A fixed capacity that the output fits in exactly
+    {
+        auto buffer = std::vector<uint8_t>(expected.size());
+        auto *output_bytes = buffer.data();
+        size_t output_size = 0;
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &output_size, .out_byte_buffer_ptr = &output_bytes, .capacity = buffer.size()};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        write_scene(gvox_ctx, o_ctx, parse_driven);
+        gvox_destroy_adapter_context(o_ctx);
+        handle_gvox_error(gvox_ctx);
+        check(output_bytes == buffer.data() && output_size == buffer.size(), "byte_buffer output should stay in the fixed buffer");
+        check(buffer == expected, "fixed capacity byte_buffer output should match");
+    }
+
+    // A fixed capacity that's too small
+    {
+        auto buffer = std::vector<uint8_t>(expected.size() - 1);
+        auto *output_bytes = buffer.data();
+        size_t output_size = 0;
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &output_size, .out_byte_buffer_ptr = &output_bytes, .capacity = buffer.size()};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        write_scene(gvox_ctx, o_ctx, parse_driven);
+        gvox_destroy_adapter_context(o_ctx);
+        check(pop_errors(gvox_ctx, false) != 0, "overflowing a fixed capacity byte_buffer should fail");
+        check(output_bytes == buffer.data(), "fixed byte_buffer should be left alone");
+    }
+
+    // A blit that fails after the caller storage has been reallocated, which
+    // skips blit_end, must still leave the caller with the live block
+    if (parse_driven) {
+        uint8_t *output_bytes = nullptr;
+        size_t output_size = 0;
+        reallocation_count = 0;
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &output_size, .out_byte_buffer_ptr = &output_bytes, .reallocate = counting_reallocate};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        auto *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, "procedural"), nullptr);
+        auto *s_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_serialize_adapter(gvox_ctx, "gvox_raw"), nullptr);
+        // The procedural parser doesn't have roughness
+        gvox_blit_region_parse_driven(nullptr, o_ctx, p_ctx, s_ctx, &scene_range, scene_channels | GVOX_CHANNEL_BIT_ROUGHNESS);
+        check(pop_errors(gvox_ctx, false) != 0, "parsing a channel procedural doesn't have should fail");
+        gvox_destroy_adapter_context(o_ctx);
+        gvox_destroy_adapter_context(p_ctx);
+        gvox_destroy_adapter_context(s_ctx);
+        check(reallocation_count != 0 && output_bytes == last_reallocation, "byte_buffer output should be handed back as it grows");
+        free(output_bytes);
+    }
+    handle_gvox_error(gvox_ctx);
+}
+
+#if GVOX_ENABLE_FILE_IO && defined(__unix__)
+void test_mmap(GvoxContext *gvox_ctx, std::vector<uint8_t> const &expected, bool parse_driven) {
+    auto const *const filepath = "tests/simple/outputs/io_adapters_mmap.gvr";
+    {
+        auto o_config = GvoxMmapOutputAdapterConfig{.filepath = filepath};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "mmap"), &o_config);
+        write_scene(gvox_ctx, o_ctx, parse_driven);
+        gvox_destroy_adapter_context(o_ctx);
+    }
+    handle_gvox_error(gvox_ctx);
+    check(read_file(filepath) == expected, "mmap output should match");
+}
+
+void test_fd(GvoxContext *gvox_ctx, std::vector<uint8_t> const &expected, bool parse_driven) {
+    auto const *const filepath = "tests/simple/outputs/io_adapters_fd.gvr";
+    auto const fd = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    check(fd != -1, "opening the fd output file");
+    {
+        // A small buffer, so that it gets flushed many times
+        auto o_config = GvoxFdOutputAdapterConfig{.fd = fd, .buffer_size = 100};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "fd"), &o_config);
+        write_scene(gvox_ctx, o_ctx, parse_driven);
+        gvox_destroy_adapter_context(o_ctx);
+    }
+    close(fd);
+    handle_gvox_error(gvox_ctx);
+    check(read_file(filepath) == expected, "fd output should match");
+}
+#endif
+
+#if GVOX_ENABLE_FILE_IO && defined(__linux__)
+auto open_fd_count() -> size_t {
+    auto result = size_t{0};
+    for ([[maybe_unused]] auto const &entry : std::filesystem::directory_iterator{"/proc/self/fd"}) {
+        ++result;
+    }
+    return result;
+}
+
+// Failed blits skip blit_end, which mustn't leave the file input's files
+// open, or stop the next blit through the same context from reading
+void test_file_input(GvoxContext *gvox_ctx, std::vector<uint8_t> const &expected) {
+    auto const *const garbage_filepath = "tests/simple/outputs/io_adapters_garbage.bin";
+    auto const *const raw_filepath = "tests/simple/outputs/io_adapters_file_input.gvr";
+    {
+        auto const garbage = std::vector<char>(64, 0);
+        std::ofstream{garbage_filepath, std::ios::binary}.write(garbage.data(), static_cast<std::streamsize>(garbage.size()));
+        std::ofstream{raw_filepath, std::ios::binary}.write(reinterpret_cast<char const *>(expected.data()), static_cast<std::streamsize>(expected.size()));
+    }
+    auto const fd_n = open_fd_count();
+    for (int i = 0; i < 4; ++i) {
+        auto i_config = GvoxFileInputAdapterConfig{.filepath = garbage_filepath, .byte_offset = 0};
+        auto *i_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "file"), &i_config);
+        uint8_t *unused_bytes = nullptr;
+        size_t unused_size = 0;
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &unused_size, .out_byte_buffer_ptr = &unused_bytes};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        blit_and_fail(gvox_ctx, i_ctx, o_ctx);
+        // Again through the same context
+        blit_and_fail(gvox_ctx, i_ctx, o_ctx);
+        gvox_destroy_adapter_context(i_ctx);
+        gvox_destroy_adapter_context(o_ctx);
+        free(unused_bytes);
+    }
+    handle_gvox_error(gvox_ctx);
+    check(open_fd_count() == fd_n, "failed blits shouldn't leak the file input's fds");
+
+    // A failed blit, and then a good one through the same input context
+    uint8_t *output_bytes = nullptr;
+    size_t output_size = 0;
+    {
+        auto i_config = GvoxFileInputAdapterConfig{.filepath = raw_filepath, .byte_offset = 0};
+        auto *i_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "file"), &i_config);
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &output_size, .out_byte_buffer_ptr = &output_bytes};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        blit_and_fail(gvox_ctx, i_ctx, o_ctx);
+        auto *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, "gvox_raw"), nullptr);
+        auto *s_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_serialize_adapter(gvox_ctx, "gvox_raw"), nullptr);
+        gvox_blit_region(i_ctx, o_ctx, p_ctx, s_ctx, &scene_range, scene_channels);
+        gvox_destroy_adapter_context(i_ctx);
+        gvox_destroy_adapter_context(o_ctx);
+        gvox_destroy_adapter_context(p_ctx);
+        gvox_destroy_adapter_context(s_ctx);
+    }
+    handle_gvox_error(gvox_ctx);
+    check(take_bytes(output_bytes, output_size) == expected, "file input should read back what was written after a failed blit");
+}
+#endif
+
+#if GVOX_ENABLE_ZSTD
+void test_zstd(GvoxContext *gvox_ctx, std::vector<uint8_t> const &expected, bool parse_driven) {
+    uint8_t *compressed_bytes = nullptr;
+    size_t compressed_size = 0;
+    {
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &compressed_size, .out_byte_buffer_ptr = &compressed_bytes};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        // Small frames, so that the scene is spread over many of them
+        auto z_config = GvoxZstdOutputAdapterConfig{.output_ctx = o_ctx, .frame_size = 1000};
+        auto *z_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "zstd"), &z_config);
+        write_scene(gvox_ctx, z_ctx, parse_driven);
+        gvox_destroy_adapter_context(z_ctx);
+        gvox_destroy_adapter_context(o_ctx);
+    }
+    handle_gvox_error(gvox_ctx);
+    auto const compressed = take_bytes(compressed_bytes, compressed_size);
+
+    // Read it back through the gvox_raw parser, which re-serializes it
+    uint8_t *output_bytes = nullptr;
+    size_t output_size = 0;
+    {
+        auto i_config = GvoxByteBufferInputAdapterConfig{.data = compressed.data(), .size = compressed.size()};
+        auto *i_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "byte_buffer"), &i_config);
+        auto z_config = GvoxZstdInputAdapterConfig{.input_ctx = i_ctx, .size = compressed.size(), .frame_cache_size = 2};
+        auto *z_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "zstd"), &z_config);
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &output_size, .out_byte_buffer_ptr = &output_bytes};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        auto *p_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_parse_adapter(gvox_ctx, "gvox_raw"), nullptr);
+        auto *s_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_serialize_adapter(gvox_ctx, "gvox_raw"), nullptr);
+        gvox_blit_region(z_ctx, o_ctx, p_ctx, s_ctx, &scene_range, scene_channels);
+        gvox_destroy_adapter_context(z_ctx);
+        gvox_destroy_adapter_context(i_ctx);
+        gvox_destroy_adapter_context(o_ctx);
+        gvox_destroy_adapter_context(p_ctx);
+        gvox_destroy_adapter_context(s_ctx);
+    }
+    handle_gvox_error(gvox_ctx);
+    check(take_bytes(output_bytes, output_size) == expected, "zstd output, read back through zstd input, should match");
+
+    // A zstd output whose blit fails after it has started its compression threads
+    {
+        auto const garbage = std::vector<uint8_t>(64, 0);
+        auto i_config = GvoxByteBufferInputAdapterConfig{.data = garbage.data(), .size = garbage.size()};
+        auto *i_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "byte_buffer"), &i_config);
+        uint8_t *unused_bytes = nullptr;
+        size_t unused_size = 0;
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &unused_size, .out_byte_buffer_ptr = &unused_bytes};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        auto z_config = GvoxZstdOutputAdapterConfig{.output_ctx = o_ctx};
+        auto *z_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "zstd"), &z_config);
+        blit_and_fail(gvox_ctx, i_ctx, z_ctx);
+        gvox_destroy_adapter_context(z_ctx);
+        gvox_destroy_adapter_context(o_ctx);
+        gvox_destroy_adapter_context(i_ctx);
+        free(unused_bytes);
+    }
+    handle_gvox_error(gvox_ctx);
+
+    // A zstd input whose blit fails after it has started decompressing
+    {
+        auto i_config = GvoxByteBufferInputAdapterConfig{.data = compressed.data(), .size = compressed.size()};
+        auto *i_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "byte_buffer"), &i_config);
+        auto z_config = GvoxZstdInputAdapterConfig{.input_ctx = i_ctx, .size = compressed.size()};
+        auto *z_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_input_adapter(gvox_ctx, "zstd"), &z_config);
+        uint8_t *unused_bytes = nullptr;
+        size_t unused_size = 0;
+        auto o_config = GvoxByteBufferOutputAdapterConfig{.out_size = &unused_size, .out_byte_buffer_ptr = &unused_bytes};
+        auto *o_ctx = gvox_create_adapter_context(gvox_ctx, gvox_get_output_adapter(gvox_ctx, "byte_buffer"), &o_config);
+        blit_and_fail(gvox_ctx, z_ctx, o_ctx);
+        gvox_destroy_adapter_context(z_ctx);
+        gvox_destroy_adapter_context(i_ctx);
+        gvox_destroy_adapter_context(o_ctx);
+        free(unused_bytes);
+    }
+    handle_gvox_error(gvox_ctx);
+}
+#endif
+
+auto main() -> int {
+    auto *gvox_ctx = gvox_create_context();
+    gvox_register_parse_adapter(gvox_ctx, &procedural_adapter_info);
+    for (bool const parse_driven : {false, true}) {
+        printf("%s\n", parse_driven ? "parse driven" : "serialize driven");
+        auto const expected = write_scene_to_bytes(gvox_ctx, parse_driven);
+        printf("byte_buffer\n");
+        test_byte_buffer(gvox_ctx, expected, parse_driven);
+        printf("async\n");
+        test_async(gvox_ctx, expected, parse_driven);
+#if GVOX_ENABLE_FILE_IO && defined(__unix__)
+        printf("mmap\n");
+        test_mmap(gvox_ctx, expected, parse_driven);
+        printf("fd\n");
+        test_fd(gvox_ctx, expected, parse_driven);
+#endif
+#if GVOX_ENABLE_FILE_IO && defined(__linux__)
+        printf("file input\n");
+        test_file_input(gvox_ctx, expected);
+#endif
+#if GVOX_ENABLE_ZSTD
+        printf("zstd\n");
+        test_zstd(gvox_ctx, expected, parse_driven);
+#endif
+    }
+    gvox_destroy_context(gvox_ctx);
+}